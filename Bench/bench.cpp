@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bench/corpus.hpp"
+#include "Compiler/include/compiler.hpp"
+#include "Compiler/include/macro.hpp"
+#include "Compiler/include/scan.hpp"
+#include "VM/include/lockstep.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  microbenchmarks for the VM, the scanner, the macro engine and the whole
+  compiler; results are written as JSON so that they can be tracked over
+  time:
+    {"scale": 1, "benchmarks": [{"name": ..., "size": ...,
+     "repetitions": ..., "min_ns": ..., "mean_ns": ..., "items": ...,
+     "ns_per_item": ...}, ...]}
+  items counts the unit of work of a benchmark (instructions executed,
+  tokens scanned, ...)
+ */
+
+using namespace Theo;
+
+struct Result {
+  std::string name;
+  int size;
+  int repetitions;
+  double min_ns;
+  double mean_ns;
+  unsigned long long items;
+};
+
+struct Options {
+  int scale;
+  int repetitions;
+  std::string filter;
+  std::string out;
+  std::string corpus_dir;
+};
+
+typedef std::function<unsigned long long()> Run;
+
+Result measure(std::string name, int size, int repetitions, Run run) {
+  Result r = {.name = name,
+              .size = size,
+              .repetitions = repetitions,
+              .min_ns = 0,
+              .mean_ns = 0,
+              .items = 0};
+  double total = 0;
+  for (int k = 0; k < repetitions; k++) {
+    auto start = std::chrono::steady_clock::now();
+    r.items = run();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    r.min_ns = (k == 0) ? ns : std::min(r.min_ns, ns);
+    total += ns;
+  }
+  r.mean_ns = total / repetitions;
+  return r;
+}
+
+Program compileOrDie(const std::string &code) {
+  CodegenResult cr = compile({{"main.theo", code}}, "main.theo");
+  if (!cr.generated_correctly) {
+    std::cerr << "benchmark program doesn't compile:" << std::endl;
+    for (auto &e : cr.errors)
+      std::cerr << e.file << ":" << e.line << " " << e.message << std::endl;
+    std::exit(1);
+  }
+  return cr.code;
+}
+
+Run vmRun(const std::string &code, VM::Engine engine, bool checked = false) {
+  Program p = compileOrDie(code);
+  return [p, engine, checked]() -> unsigned long long {
+    VM v(p);
+    v.setEngine(engine);
+    v.setCheckedExecution(checked);
+    v.execute();
+    return v.getExecutedInstructions();
+  };
+}
+
+// the program on a full chunk of lanes; items are the instructions of all
+// runs, so that ns_per_item compares with the other engines
+Run lockstepRun(const std::string &code) {
+  Program p = compileOrDie(code);
+  return [p]() -> unsigned long long {
+    LockstepVM l(p);
+    std::vector<LockstepVM::Inputs> inputs(LockstepVM::width);
+    unsigned long long items = 0;
+    for (auto &run : l.run(inputs).runs) items += run.instructions;
+    return items;
+  };
+}
+
+struct Benchmark {
+  std::string name;
+  int size;
+  std::string corpus;  // the program, if the benchmark is based on one
+  std::function<Run()> prepare;
+  // the files, if the benchmark is based on a project of several
+  std::map<std::string, std::string> project = {};
+};
+
+std::vector<Benchmark> benchmarks(int scale) {
+  std::vector<Benchmark> res = {};
+
+  int loop_n = 1000 * scale;
+  std::string loop = Bench::loopKernel(loop_n);
+  int while_n = 1000000 * scale;
+  std::string whl = Bench::whileKernel(while_n);
+  int depth = 15 + std::min(scale, 8);
+  std::string calls = Bench::callTree(depth);
+
+  for (auto engine : {VM::Engine::SWITCH, VM::Engine::CLOSURES}) {
+    std::string prefix =
+        engine == VM::Engine::SWITCH ? "vm/" : "vm/closures/";
+    res.push_back({prefix + "loop", loop_n, loop,
+                   [=]() { return vmRun(loop, engine); }});
+    res.push_back({prefix + "while", while_n, whl,
+                   [=]() { return vmRun(whl, engine); }});
+    res.push_back({prefix + "calls", depth, calls,
+                   [=]() { return vmRun(calls, engine); }});
+  }
+  res.push_back({"vm/lockstep/loop", loop_n, loop,
+                 [=]() { return lockstepRun(loop); }});
+  res.push_back({"vm/lockstep/calls", depth, calls,
+                 [=]() { return lockstepRun(calls); }});
+  // the path of programs that don't pass verification
+  res.push_back({"vm/checked/loop", loop_n, loop,
+                 [=]() { return vmRun(loop, VM::Engine::SWITCH, true); }});
+  res.push_back({"vm/checked/calls", depth, calls,
+                 [=]() { return vmRun(calls, VM::Engine::SWITCH, true); }});
+
+  int scan_n = 2000 * scale;
+  std::string mixed = Bench::mixedProgram(scan_n);
+  res.push_back({"scan", scan_n, mixed, [=]() -> Run {
+                   return [=]() -> unsigned long long {
+                     return scan({{"main.theo", mixed}}, "main.theo")
+                         .toks.size();
+                   };
+                 }});
+
+  // every expansion is a pass of the macro engine, which is limited to
+  // THEO_MACRO_PASSES; each use of the generated macros takes two
+  int macro_m = std::min(100 * scale, THEO_MACRO_PASSES / 2 - 2);
+  std::string macros = Bench::macroProgram(macro_m);
+  res.push_back({"macro/extract+apply", macro_m, macros, [=]() -> Run {
+                   auto toks = scan({{"main.theo", macros}}, "main.theo").toks;
+                   return [=]() -> unsigned long long {
+                     MacroExtractionResult mer = extract_macros(toks);
+                     apply_macros(mer.tokens, mer.macros, THEO_MACRO_PASSES);
+                     return mer.macros.size();
+                   };
+                 }});
+
+  // without passes, applying macros only generates the parse tables of the
+  // detectors for all definitions
+  res.push_back({"macro/parse_tables", macro_m, "", [=]() -> Run {
+                   auto toks = scan({{"main.theo", macros}}, "main.theo").toks;
+                   MacroExtractionResult mer = extract_macros(toks);
+                   return [=]() mutable -> unsigned long long {
+                     apply_macros(mer.tokens, mer.macros, 0);
+                     return mer.macros.size();
+                   };
+                 }});
+
+  int compile_n = 200 * scale;
+  std::string program = Bench::mixedProgram(compile_n);
+  res.push_back({"compile", compile_n, program, [=]() -> Run {
+                   return [=]() -> unsigned long long {
+                     return compile({{"main.theo", program}}, "main.theo")
+                         .code.code.size();
+                   };
+                 }});
+
+  // code generation alone, one PROGRAM after another or in parallel
+  for (unsigned int threads : {1u, 0u}) {
+    std::string name = threads == 1 ? "" : "/parallel";
+    res.push_back({"gen" + name, compile_n, "", [=]() -> Run {
+                     ParseResult pr =
+                         parse({{"main.theo", program}}, "main.theo");
+                     std::shared_ptr<AST> ast(new AST(pr.a), [](AST *a) {
+                       a->clear();
+                       delete a;
+                     });
+                     return [=]() -> unsigned long long {
+                       return gen(*ast, threads).code.code.size();
+                     };
+                   }});
+  }
+
+  // the whole sequence of a project compared to the macro pipeline, whose
+  // stages run in sequence or concurrently; two expansions per PROGRAM and
+  // the whole sequence is limited to THEO_MACRO_PASSES
+  int project_m = 8;
+  int project_n = std::min(4 * scale, THEO_MACRO_PASSES / (2 * project_m) - 1);
+  auto project = Bench::project(project_n, project_m);
+  res.push_back({"macro/apply/project", project_n, "", [=]() -> Run {
+                   auto toks = scan(project, "main.theo").toks;
+                   return [=]() -> unsigned long long {
+                     MacroExtractionResult mer = extract_macros(toks);
+                     return apply_macros(mer.tokens, mer.macros,
+                                         THEO_MACRO_PASSES)
+                         .transformed_sequence.size();
+                   };
+                 }});
+  for (unsigned int threads : {1u, 0u}) {
+    std::string name = threads == 1 ? "" : "/pipelined";
+    res.push_back({"macro/pipeline/project" + name, project_n, "",
+                   [=]() -> Run {
+                     return [=]() -> unsigned long long {
+                       TokenStream ts(string_sources(project), "main.theo");
+                       MacroPipeline pipeline(ts, THEO_MACRO_PASSES, threads);
+                       std::vector<Token> region = {};
+                       unsigned long long items = 0;
+                       while (pipeline.next(region)) items += region.size();
+                       return items;
+                     };
+                   }});
+    res.push_back({"compile/project" + name, project_n, "",
+                   [=]() -> Run {
+                     return [=]() -> unsigned long long {
+                       return compile(project, "main.theo", threads)
+                           .code.code.size();
+                     };
+                   },
+                   project});
+  }
+
+  // a library compiled with its user, or once as a module that is linked
+  int library_n = 200 * scale;
+  auto library = Bench::library(library_n);
+  res.push_back({"compile/library", library_n, "", [=]() -> Run {
+                   return [=]() -> unsigned long long {
+                     return compile(library, "main.theo").code.code.size();
+                   };
+                 },
+                 library});
+  res.push_back(
+      {"compile/library/module", library_n, "", [=]() -> Run {
+         auto cache = std::make_shared<ModuleCache>("");
+         compile(string_sources(library), "main.theo", *cache);
+         return [=]() -> unsigned long long {
+           return compile(string_sources(library), "main.theo", *cache)
+               .code.code.size();
+         };
+       }});
+
+  return res;
+}
+
+void writeJson(std::ostream &o, const Options &opt,
+               const std::vector<Result> &results) {
+  o << "{\"scale\": " << opt.scale << ", \"benchmarks\": [";
+  for (std::size_t k = 0; k < results.size(); k++) {
+    const Result &r = results[k];
+    o << (k == 0 ? "" : ",") << std::endl
+      << "  {\"name\": \"" << r.name << "\", \"size\": " << r.size
+      << ", \"repetitions\": " << r.repetitions
+      << ", \"min_ns\": " << (unsigned long long)r.min_ns
+      << ", \"mean_ns\": " << (unsigned long long)r.mean_ns
+      << ", \"items\": " << r.items << ", \"ns_per_item\": "
+      << (r.items == 0 ? 0.0 : r.min_ns / r.items) << "}";
+  }
+  o << std::endl << "]}" << std::endl;
+}
+
+void usage() {
+  std::cout << "Usage: theo_bench [OPTIONS...]" << std::endl
+            << "OPTIONS:" << std::endl
+            << "  --scale <n>\t\tmultiply the size of all inputs by n "
+               "(default 1)"
+            << std::endl
+            << "  --repetitions <n>\trun every benchmark n times (default 5)"
+            << std::endl
+            << "  --filter <text>\tonly run benchmarks whose name contains "
+               "<text>"
+            << std::endl
+            << "  --out <file>\t\twrite the JSON results to <file> instead of "
+               "stdout"
+            << std::endl
+            << "  --write-corpus <dir>\twrite the generated programs to <dir>"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  Options opt = {
+      .scale = 1, .repetitions = 5, .filter = "", .out = "", .corpus_dir = ""};
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return 0;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Option '" << arg << "' expects a value" << std::endl;
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--scale" || arg == "--repetitions") {
+      int n = 0;
+      try {
+        n = std::stoi(value);
+      } catch (std::exception &e) {
+      }
+      if (n < 1) {
+        std::cerr << "Option '" << arg << "' expects a positive number"
+                  << std::endl;
+        return 1;
+      }
+      (arg == "--scale" ? opt.scale : opt.repetitions) = n;
+    } else if (arg == "--filter") {
+      opt.filter = value;
+    } else if (arg == "--out") {
+      opt.out = value;
+    } else if (arg == "--write-corpus") {
+      opt.corpus_dir = value;
+    } else {
+      std::cerr << "Unknown option '" << arg << "'" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Result> results = {};
+  for (auto &b : benchmarks(opt.scale)) {
+    if (b.name.find(opt.filter) == std::string::npos) continue;
+
+    if (opt.corpus_dir != "" && b.corpus != "") {
+      std::string file = b.name + ".theo";
+      std::replace(file.begin(), file.end(), '/', '_');
+      std::filesystem::create_directories(opt.corpus_dir);
+      std::ofstream(std::filesystem::path(opt.corpus_dir) / file) << b.corpus;
+    }
+    if (opt.corpus_dir != "" && !b.project.empty()) {
+      // a directory per project
+      std::string dir = b.name;
+      std::replace(dir.begin(), dir.end(), '/', '_');
+      std::filesystem::path p = std::filesystem::path(opt.corpus_dir) / dir;
+      std::filesystem::create_directories(p);
+      for (auto &f : b.project) std::ofstream(p / f.first) << f.second;
+    }
+
+    std::cerr << "running " << b.name << " (size " << b.size << ")"
+              << std::endl;
+    results.push_back(measure(b.name, b.size, opt.repetitions, b.prepare()));
+  }
+
+  if (opt.out == "") {
+    writeJson(std::cout, opt, results);
+  } else {
+    std::ofstream o(opt.out);
+    writeJson(o, opt, results);
+    if (!o) {
+      std::cerr << "Couldn't write results to '" << opt.out << "'"
+                << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "Bench/corpus.hpp"
+
+#include <sstream>
+
+using namespace Theo;
+
+std::string Bench::loopKernel(int n) {
+  std::stringstream s;
+  s << "n := " << n << ";" << std::endl
+    << "LOOP n DO" << std::endl
+    << "  LOOP n DO" << std::endl
+    << "    y := y + 1" << std::endl
+    << "  END" << std::endl
+    << "END" << std::endl;
+  return s.str();
+}
+
+std::string Bench::whileKernel(int n) {
+  std::stringstream s;
+  s << "x := " << n << ";" << std::endl
+    << "WHILE x != 0 DO" << std::endl
+    << "  x := x - 1;" << std::endl
+    << "  y := y + 1" << std::endl
+    << "END" << std::endl;
+  return s.str();
+}
+
+std::string Bench::callTree(int depth) {
+  std::stringstream s;
+  s << "PROGRAM f0 IN x1 DO" << std::endl
+    << "  x0 := x1 + 1" << std::endl
+    << "END" << std::endl;
+  for (int k = 1; k <= depth; k++) {
+    s << "PROGRAM f" << k << " IN x1 DO" << std::endl
+      << "  a := RUN f" << k - 1 << " WITH x1 END;" << std::endl
+      << "  x0 := RUN f" << k - 1 << " WITH a END" << std::endl
+      << "END" << std::endl;
+  }
+  s << "r := RUN f" << depth << " WITH 0 END" << std::endl;
+  return s.str();
+}
+
+std::string Bench::mixedProgram(int n) {
+  std::stringstream s;
+  for (int k = 0; k < n; k++) {
+    s << "PROGRAM p" << k << " IN x1, x2 DO" << std::endl
+      << "  x0 := x1;" << std::endl
+      << "  LOOP x2 DO" << std::endl
+      << "    t := x0;" << std::endl
+      << "    x0 := t" << std::endl
+      << "  END;" << std::endl
+      << "  WHILE x2 != 0 DO" << std::endl
+      << "    x2 := 0" << std::endl
+      << "  END" << std::endl
+      << "END" << std::endl;
+  }
+  s << "a := 3;" << std::endl << "b := a + 2";
+  for (int k = 0; k < n; k++)
+    s << ";" << std::endl << "r" << k << " := RUN p" << k << " WITH a, b END";
+  s << std::endl;
+  return s.str();
+}
+
+std::string Bench::macroProgram(int m) {
+  std::stringstream s;
+  for (int k = 0; k < m; k++) {
+    s << "DEFINE PRIO " << k << " bump" << k << " <ID> AS $0 := $0 + " << k
+      << " END DEFINE" << std::endl;
+  }
+  s << "x := 0";
+  for (int k = 0; k < m; k++) s << ";" << std::endl << "bump" << k << " x";
+  s << std::endl;
+  return s.str();
+}
+
+std::map<std::string, std::string> Bench::project(int n, int m) {
+  std::map<std::string, std::string> files = {};
+  files["macros.theo"] =
+      "DEFINE <ID> := <ID> PLUS <INT> AS $0 := RUN __INC__ WITH $1, $2 END "
+      "END DEFINE\n"
+      "DEFINE <ID> := <ID> MINUS <INT> AS $0 := RUN __DEC__ WITH $1, $2 END "
+      "END DEFINE\n";
+  std::stringstream main;
+  main << "INCLUDE \"macros.theo\"" << std::endl;
+  for (int f = 0; f < n; f++) {
+    std::stringstream s;
+    for (int k = 0; k < m; k++) {
+      s << "PROGRAM f" << f << "_" << k << " IN x1, x2 DO" << std::endl
+        << "  x0 := x1 PLUS " << k + 1 << ";" << std::endl
+        << "  LOOP x2 DO" << std::endl
+        << "    x0 := x0 MINUS 1" << std::endl
+        << "  END" << std::endl
+        << "END" << std::endl;
+    }
+    std::string name = "m" + std::to_string(f) + ".theo";
+    files[name] = s.str();
+    main << "INCLUDE \"" << name << "\"" << std::endl;
+  }
+  main << "a := 3";
+  for (int f = 0; f < n; f++) {
+    for (int k = 0; k < m; k++) {
+      main << ";" << std::endl
+           << "r" << f << "_" << k << " := RUN f" << f << "_" << k
+           << " WITH a, a END";
+    }
+  }
+  main << std::endl;
+  files["main.theo"] = main.str();
+  return files;
+}
+
+std::map<std::string, std::string> Bench::library(int n) {
+  std::stringstream lib;
+  lib << "DEFINE double <ID> AS $0 := RUN l0 WITH $0, $0 END END DEFINE"
+      << std::endl;
+  for (int k = 0; k < n; k++) {
+    lib << "PROGRAM l" << k << " IN x1, x2 DO" << std::endl
+        << "  x0 := x1;" << std::endl
+        << "  LOOP x2 DO x0 := x0 + 1 END";
+    if (k > 0)
+      lib << ";" << std::endl
+          << "  x0 := RUN l" << k - 1 << " WITH x0, 1 END";
+    lib << std::endl << "END" << std::endl;
+  }
+  return {{"lib.theo", lib.str()},
+          {"main.theo", "INCLUDE \"lib.theo\"\na := 1;\ndouble a\n"}};
+}
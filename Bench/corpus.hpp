@@ -0,0 +1,56 @@
+#ifndef _LIBTHEO_BENCH_CORPUS_HPP_
+#define _LIBTHEO_BENCH_CORPUS_HPP_
+
+#include <map>
+#include <string>
+
+/*
+  generators for the benchmark corpus; every program scales with its
+  parameter and can be written to disk with theo_bench --write-corpus
+ */
+
+namespace Theo::Bench {
+
+/**
+ * two nested LOOPs incrementing a variable n * n times
+ */
+std::string loopKernel(int n);
+
+/**
+ * a WHILE loop counting down from n
+ */
+std::string whileKernel(int n);
+
+/**
+ * PROGRAMs f0 ... f<depth> where each one calls its predecessor twice,
+ * so that the root script performs 2^(depth + 1) - 1 calls
+ */
+std::string callTree(int depth);
+
+/**
+ * n PROGRAMs made of assignments, LOOPs and WHILEs, all called by the root
+ * script; only the root script uses (standard) macros
+ */
+std::string mixedProgram(int n);
+
+/**
+ * m macro definitions and a root script using each of them once
+ */
+std::string macroProgram(int m);
+
+/**
+ * a project of n files with m PROGRAMs each, which use macros defined in a
+ * file of their own, and a main file including all of them and calling every
+ * PROGRAM; by file name, the main file is "main.theo"
+ */
+std::map<std::string, std::string> project(int n, int m);
+
+/**
+ * a main file including a library of n PROGRAMs, which defines a macro the
+ * main file uses once; by file name, the main file is "main.theo"
+ */
+std::map<std::string, std::string> library(int n);
+
+}  // namespace Theo::Bench
+
+#endif
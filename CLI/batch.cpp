@@ -0,0 +1,333 @@
+#include "CLI/batch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#include "Compiler/include/parallel.hpp"
+#include "VM/include/analysis.hpp"
+#include "VM/include/lockstep.hpp"
+#include "VM/include/vm.hpp"
+
+using namespace Theo;
+
+typedef std::chrono::steady_clock Clock;
+
+static long long nanoseconds(Clock::time_point since) {
+  auto d = Clock::now() - since;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+static std::string quoted(std::string_view s) {
+  std::string res = "\"";
+  for (char c : s) {
+    switch (c) {
+      case '"':
+        res += "\\\"";
+        break;
+      case '\\':
+        res += "\\\\";
+        break;
+      case '\n':
+        res += "\\n";
+        break;
+      case '\t':
+        res += "\\t";
+        break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          res += escaped;
+        } else {
+          res += c;
+        }
+    }
+  }
+  return res + "\"";
+}
+
+bool parse_input(const std::string &binding, std::string &name,
+                 VM::Word &value) {
+  std::size_t eq = binding.find('=');
+  if (eq == std::string::npos || eq == 0) return false;
+  name = binding.substr(0, eq);
+  std::string number = binding.substr(eq + 1);
+  try {
+    std::size_t len = 0;
+    value = std::stoi(number, &len);
+    return len == number.size() && value >= 0;
+  } catch (std::exception &e) {
+    return false;
+  }
+}
+
+bool read_manifest(const std::string &path, std::vector<BatchJob> &jobs,
+                   std::string &error) {
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    error = "couldn't open '" + path + "'";
+    return false;
+  }
+  std::string directory =
+      std::filesystem::path(path).parent_path().generic_string();
+  std::string line;
+  for (int number = 1; std::getline(f, line); number++) {
+    std::stringstream sstr(line);
+    BatchJob job = {.files = {}, .directory = directory, .inputs = {}};
+    std::string word;
+    while (sstr >> word) {
+      if (job.files.empty() || word.find('=') == std::string::npos) {
+        job.files.push_back(word);
+        continue;
+      }
+      std::string name;
+      VM::Word value;
+      if (!parse_input(word, name, value)) {
+        error = "invalid input '" + word + "' in line " +
+                std::to_string(number) + " of '" + path + "'";
+        return false;
+      }
+      job.inputs[name] = value;
+    }
+    if (job.files.empty() || job.files[0][0] == '#') continue;
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+namespace {
+
+// a distinct set of files, compiled (and analyzed) once for all jobs
+// running it
+struct Compiled {
+  std::optional<Program> program;
+  Analysis analysis;
+  long long compile_ns;
+  // the rest of the JSON line if it couldn't be compiled
+  std::string failure;
+  // set if the jobs of the program run in lockstep
+  std::optional<LockstepVM> lockstep;
+};
+
+struct JobResult {
+  std::string line;  // without the newline
+  bool ok;
+};
+
+}  // namespace
+
+static Compiled compile_job(const BatchJob &job) {
+  std::stringstream res;
+  std::map<FileName, FileContent> files = {};
+  for (auto &name : job.files) {
+    std::filesystem::path p(name);
+    if (p.is_relative() && job.directory != "") p = job.directory / p;
+    std::ifstream f(p);
+    if (!f.is_open()) {
+      res << ", \"status\": \"io_error\", \"error\": "
+          << quoted("couldn't open '" + p.generic_string() + "'") << "}";
+      return {.program = std::nullopt,
+              .analysis = {},
+              .compile_ns = 0,
+              .failure = res.str(),
+              .lockstep = std::nullopt};
+    }
+    std::stringstream content;
+    content << f.rdbuf();
+    files[name] = content.str();
+  }
+
+  auto start = Clock::now();
+  CodegenResult cr = compile(files, job.files[0]);
+  long long compile_ns = nanoseconds(start);
+  res << ", \"compile_ns\": " << compile_ns;
+  if (!cr.generated_correctly) {
+    res << ", \"status\": \"compile_error\", \"errors\": [";
+    for (std::size_t k = 0; k < cr.errors.size(); k++) {
+      auto &e = cr.errors[k];
+      res << (k == 0 ? "" : ", ") << "{\"file\": " << quoted(e.file)
+          << ", \"line\": " << e.line << ", \"message\": " << quoted(e.message)
+          << "}";
+    }
+    res << "]}";
+    return {.program = std::nullopt,
+            .analysis = {},
+            .compile_ns = compile_ns,
+            .failure = res.str(),
+            .lockstep = std::nullopt};
+  }
+  return {.program = cr.code,
+          .analysis = Analysis::analyze(cr.code),
+          .compile_ns = compile_ns,
+          .failure = "",
+          .lockstep = std::nullopt};
+}
+
+// the start of a job's line, up to the result of its run
+static std::stringstream job_line(std::size_t index, const BatchJob &job,
+                                  const Compiled &compiled) {
+  std::stringstream res;
+  res << "{\"job\": " << index << ", \"main\": " << quoted(job.files[0]);
+  if (!compiled.program) return res;
+  res << ", \"compile_ns\": " << compiled.compile_ns << ", \"terminates\": "
+      << (compiled.analysis.terminates() ? "true" : "false");
+  return res;
+}
+
+static JobResult run_job(std::size_t index, const BatchJob &job,
+                         const Compiled &compiled,
+                         VM::InstructionCount budget) {
+  std::stringstream res = job_line(index, job, compiled);
+  if (!compiled.program)
+    return {.line = res.str() + compiled.failure, .ok = false};
+  bool terminates = compiled.analysis.terminates();
+
+  VM v(*compiled.program);
+  v.preallocate(compiled.analysis);
+  for (auto &i : job.inputs) {
+    if (!v.setInput(i.first, i.second)) {
+      res << ", \"status\": \"input_error\", \"error\": "
+          << quoted("no variable '" + i.first + "' in the root script") << "}";
+      return {.line = res.str(), .ok = false};
+    }
+  }
+  auto start = Clock::now();
+  bool ended = true;
+  if (budget == 0 || terminates)
+    v.execute();
+  else
+    ended = v.executeSlice(budget);
+  long long run_ns = nanoseconds(start);
+
+  auto fault = v.getFault();
+  res << ", \"status\": "
+      << (fault ? "\"fault\"" : ended ? "\"ok\"" : "\"budget_exceeded\"");
+  if (fault) res << ", \"fault\": " << quoted(*fault);
+  res << ", \"run_ns\": " << run_ns
+      << ", \"instructions\": " << v.getExecutedInstructions()
+      << ", \"variables\": {";
+  // the root script's frame is the bottom of the stack
+  auto &activations = v.getActivations();
+  if (!activations.empty()) {
+    bool first = true;
+    for (auto var : activations.front().getVariables()) {
+      res << (first ? "" : ", ") << quoted(var.name) << ": " << var.value;
+      first = false;
+    }
+  }
+  res << "}}";
+  return {.line = res.str(), .ok = ended && !fault};
+}
+
+// runs the jobs (all of the same program) in lockstep, or one by one if an
+// input is invalid
+static std::vector<JobResult> run_lockstep(
+    const std::vector<std::size_t> &unit, const std::vector<BatchJob> &jobs,
+    const Compiled &compiled) {
+  std::vector<LockstepVM::Inputs> inputs = {};
+  for (std::size_t k : unit) inputs.push_back(jobs[k].inputs);
+  auto start = Clock::now();
+  LockstepVM::Result r = compiled.lockstep->run(inputs);
+  long long run_ns = nanoseconds(start) / unit.size();
+
+  std::vector<JobResult> results = {};
+  for (std::size_t u = 0; u < unit.size(); u++) {
+    if (!r.ran) {
+      results.push_back(run_job(unit[u], jobs[unit[u]], compiled, 0));
+      continue;
+    }
+    std::stringstream res = job_line(unit[u], jobs[unit[u]], compiled);
+    res << ", \"status\": \"ok\", \"run_ns\": " << run_ns
+        << ", \"instructions\": " << r.runs[u].instructions
+        << ", \"variables\": {";
+    bool first = true;
+    for (auto &var : r.runs[u].variables) {
+      res << (first ? "" : ", ") << quoted(var.first) << ": " << var.second;
+      first = false;
+    }
+    res << "}}";
+    results.push_back({.line = res.str(), .ok = true});
+  }
+  return results;
+}
+
+bool run_batch(const std::vector<BatchJob> &jobs, const BatchOptions &options,
+               std::ostream &out) {
+  unsigned int threads = options.threads;
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  std::size_t most = std::max<std::size_t>(jobs.size(), 1);
+  threads = std::clamp<std::size_t>(threads, 1, most);
+
+  // jobs that only differ in their inputs run the same program
+  std::map<std::pair<std::string, std::vector<std::string>>, std::size_t>
+      distinct = {};
+  std::vector<std::size_t> program_of(jobs.size());
+  std::vector<std::size_t> first_job = {};
+  for (std::size_t k = 0; k < jobs.size(); k++) {
+    auto key = std::make_pair(jobs[k].directory, jobs[k].files);
+    auto [it, inserted] = distinct.try_emplace(key, first_job.size());
+    if (inserted) first_job.push_back(k);
+    program_of[k] = it->second;
+  }
+  std::vector<Compiled> programs(first_job.size());
+  parallel_for(programs.size(), threads, [&](std::size_t p) {
+    Compiled &c = programs[p];
+    c = compile_job(jobs[first_job[p]]);
+    bool bounded = options.budget == 0 || c.analysis.terminates();
+    if (options.lockstep && c.program && bounded) {
+      c.lockstep.emplace(*c.program);
+      if (!c.lockstep->isVerified()) c.lockstep = std::nullopt;
+    }
+  });
+
+  // units of work: single jobs, or up to a chunk of lanes of jobs that run
+  // in lockstep, ordered by their first job
+  std::vector<std::vector<std::size_t>> units = {};
+  std::vector<std::size_t> open(programs.size(), -1);
+  for (std::size_t k = 0; k < jobs.size(); k++) {
+    std::size_t p = program_of[k];
+    if (!programs[p].lockstep) {
+      units.push_back({k});
+      continue;
+    }
+    if (open[p] == (std::size_t)-1 ||
+        units[open[p]].size() == LockstepVM::width) {
+      open[p] = units.size();
+      units.push_back({});
+    }
+    units[open[p]].push_back(k);
+  }
+
+  // results are written in the order of the jobs as soon as all previous
+  // ones are done, without flushing after every line
+  std::vector<std::optional<JobResult>> results(jobs.size());
+  std::size_t written = 0;
+  bool ok = true;
+  std::mutex m;
+  parallel_for(units.size(), threads, [&](std::size_t u) {
+    const Compiled &c = programs[program_of[units[u][0]]];
+    std::vector<JobResult> r = {};
+    if (c.lockstep)
+      r = run_lockstep(units[u], jobs, c);
+    else
+      r.push_back(run_job(units[u][0], jobs[units[u][0]], c, options.budget));
+    std::lock_guard<std::mutex> l(m);
+    for (std::size_t k = 0; k < r.size(); k++)
+      results[units[u][k]] = std::move(r[k]);
+    for (; written < jobs.size() && results[written]; written++) {
+      out << results[written]->line << '\n';
+      ok &= results[written]->ok;
+      results[written] = std::nullopt;
+    }
+  });
+
+  out << std::flush;
+  return ok;
+}
@@ -0,0 +1,81 @@
+#ifndef _THEO_CLI_BATCH_HPP_
+#define _THEO_CLI_BATCH_HPP_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/vm.hpp"
+
+/**
+ * non-interactive execution of many programs: every distinct program is
+ * compiled once, every job runs one of them with its inputs to the end, jobs
+ * are distributed over a number of threads and each result is written as
+ * one line of JSON, in the order of the jobs:
+ *   {"job": 0, "main": "a.theo", "status": "ok", "compile_ns": ...,
+ *    "terminates": true, "run_ns": ..., "instructions": ...,
+ *    "variables": {"x": 1, ...}}
+ * terminates tells whether the program provably ends on every input (see
+ * Analysis), only other programs are limited by the instruction budget;
+ * status is one of
+ *   ok               the program halted, variables are those of the root
+ *                    script
+ *   fault            execution stopped at an invalid instruction ("fault")
+ *   budget_exceeded  the program didn't end within the budget
+ *   compile_error    "errors": [{"file", "line", "message"}]
+ *   io_error         a file couldn't be read ("error")
+ *   input_error      an input isn't a variable of the root script ("error")
+ * jobs of the same program share its compilation, compile_ns is reported
+ * for each of them; in lockstep mode, they are also executed together (see
+ * LockstepVM), run_ns is then the time of the lockstep run divided by the
+ * number of jobs in it
+ */
+struct BatchJob {
+  // names of the files as referenced by include directives, main first
+  std::vector<std::string> files;
+  // where files with relative names are read from ("" for the working
+  // directory)
+  std::string directory;
+  // values of root variables set before the run, see VM::setInput
+  std::map<std::string, Theo::VM::Word> inputs;
+};
+
+/**
+ * parse an input binding "name=value"
+ * @return false if it isn't one, or the value isn't a non-negative number
+ */
+bool parse_input(const std::string &binding, std::string &name,
+                 Theo::VM::Word &value);
+
+/**
+ * read a manifest: one job per line, the files of the job separated by
+ * whitespace with the main file first, followed by any number of input
+ * bindings "name=value"; relative paths are relative to the directory of the
+ * manifest, empty lines and lines starting with '#' are ignored
+ * @return false if the manifest couldn't be read or is invalid, error
+ * describes why
+ */
+bool read_manifest(const std::string &path, std::vector<BatchJob> &jobs,
+                   std::string &error);
+
+struct BatchOptions {
+  // 0: one per hardware thread
+  unsigned int threads;
+  // instructions after which programs that may not terminate are stopped
+  // (0: no limit)
+  Theo::VM::InstructionCount budget;
+  // run jobs of the same program in lockstep, if it was verified and either
+  // terminates or there is no budget
+  bool lockstep;
+};
+
+/**
+ * run all jobs
+ * @return true if every job finished with status ok
+ */
+bool run_batch(const std::vector<BatchJob> &jobs, const BatchOptions &options,
+               std::ostream &out);
+
+#endif
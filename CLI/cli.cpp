@@ -1,13 +1,16 @@
 #define CLI_VER "1.1.0"
 
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 #include <string>
 
+#include "CLI/batch.hpp"
 #include "Compiler/include/compiler.hpp"
 #include "Compiler/include/gen.hpp"
+#include "VM/include/native.hpp"
 #include "VM/include/vm.hpp"
 
 using namespace Theo;
@@ -22,6 +25,54 @@ void usage() {
             << std::endl
             << "OPTIONS:" << std::endl
             << "  -d, --debug\t\tenables interactive debug mode" << std::endl
+            << "  --emit-bytecode <file>\tcompile and write the program to "
+               "<file> instead of executing it"
+            << std::endl
+            << "  --run-bytecode <file>\texecute a program written by "
+               "--emit-bytecode instead of compiling source files"
+            << std::endl
+            << "  --emit-cpp <file>\ttranslate the program to C++ for "
+               "compilation into a module (see cmake/TheoNative.cmake)"
+            << std::endl
+            << "  --run-native <file>\texecute a module built from the "
+               "output of --emit-cpp"
+            << std::endl
+            << "  --profile\t\tprint instruction counts per PROGRAM and line "
+               "after execution"
+            << std::endl
+            << "  --profile-collapsed <file>\twrite the call tree in the "
+               "collapsed stack format for flame graphs"
+            << std::endl
+            << "  --set <name>=<value>\tset a variable of the root script "
+               "before execution, can be repeated"
+            << std::endl
+            << "  --json\t\trun the program and write the result as a line "
+               "of JSON"
+            << std::endl
+            << "  --batch\t\trun every file as a separate program, in "
+               "parallel, and write a line of JSON per program"
+            << std::endl
+            << "  --manifest <file>\trun the programs listed in <file> in "
+               "batch mode, one per line: the main file, then its includes"
+            << std::endl
+            << "  --modules <dir>\tcompile the files included by the main "
+               "file as modules, which are kept in <dir> until they change"
+            << std::endl
+            << "  -j, --jobs <n>\tnumber of threads in batch mode and for "
+               "compiling (default: 1, 0: one per core)"
+            << std::endl
+            << "  --max-instructions <n>\tin JSON mode, stop programs that "
+               "may not terminate after <n> instructions"
+            << std::endl
+            << "  --lockstep\t\tin batch mode, run the jobs of the same "
+               "program together on vector lanes"
+            << std::endl
+            << "  --analyze\t\tprint which PROGRAMs terminate on every "
+               "input and the memory the program needs instead of executing it"
+            << std::endl
+            << "  --time-report\t\tprint the time and the work of every "
+               "compilation phase"
+            << std::endl
             << "  -v, --version\t\treport version and license information"
             << std::endl
             << "  -h, --help\t\tproduce this help message" << std::endl;
@@ -31,15 +82,26 @@ void debug_usage() {
   std::cout << "Commands: " << std::endl
             << "e - execute until next breakpoint" << std::endl
             << "s - step to next line" << std::endl
+            << "E - execute backwards until previous breakpoint" << std::endl
+            << "S - step back to previous line" << std::endl
             << "r - reset vm" << std::endl
             << "m - print memory contents of current program" << std::endl
             << "l - list current position in program" << std::endl
             << "i - like <l> followed by <m> " << std::endl
             << "b <file> <line> - set a breakpoint at specified position"
             << std::endl
+            << "b <file> <line> [if <var> <op> <var or number>] [after <n>] -"
+               " stop only if the condition holds (op: = != < <= > >=),"
+               " after it held n times"
+            << std::endl
             << "d <file> <line> - unset a breakpoint" << std::endl
-            << "c - clear all breakpoints" << std::endl
-            << "a - list active breakpoints" << std::endl
+            << "w <program> <variable> [value] - stop when the variable "
+               "changes (to value); the root script is called #root"
+            << std::endl
+            << "u <program> <variable> [value] - unset a watchpoint"
+            << std::endl
+            << "c - clear all breakpoints and watchpoints" << std::endl
+            << "a - list active breakpoints and watchpoints" << std::endl
             << "o - list bytecode" << std::endl
             << "h - print this menu" << std::endl
             << "q - quit" << std::endl;
@@ -74,10 +136,53 @@ void sectionPrint(std::map<FileName, FileContent> &files, FileName file,
   }
 }
 
+// parses "[if <variable> <op> <variable or number>] [after <hits>]"
+std::optional<BreakCondition> parse_condition(std::stringstream &sstr) {
+  BreakCondition c = {.cmp = BreakCondition::ALWAYS,
+                      .variable = "",
+                      .other = "",
+                      .constant = 0,
+                      .ignore_count = 0};
+  const std::map<std::string, BreakCondition::Comparison> ops = {
+      {"=", BreakCondition::EQ},  {"==", BreakCondition::EQ},
+      {"!=", BreakCondition::NE}, {"<", BreakCondition::LT},
+      {"<=", BreakCondition::LE}, {">", BreakCondition::GT},
+      {">=", BreakCondition::GE}};
+  std::string word;
+  while (sstr >> word) {
+    if (word == "if") {
+      std::string op, rhs;
+      if (!(sstr >> c.variable >> op >> rhs) || !ops.contains(op))
+        return std::nullopt;
+      c.cmp = ops.at(op);
+      try {
+        std::size_t len = 0;
+        c.constant = std::stoi(rhs, &len);
+        if (len != rhs.size()) c.other = rhs;
+      } catch (std::exception &e) {
+        c.other = rhs;
+      }
+    } else if (word == "after") {
+      std::string hits;
+      sstr >> hits;
+      try {
+        c.ignore_count = std::stoull(hits);
+      } catch (std::exception &e) {
+        return std::nullopt;
+      }
+    } else {
+      return std::nullopt;
+    }
+  }
+  return c;
+}
+
 void debug_mode(VM &v, std::map<FileName, FileContent> &files,
-                CodegenResult &cr) {
+                Program &program) {
   std::cout << "debug mode, type 'h' and enter for a list of commands"
             << std::endl;
+  v.setRecording(true);
+  VM::Snapshot last_stop = v.snapshot();
   bool running = true;
   while (running) {
     std::cout << ">>";
@@ -85,8 +190,14 @@ void debug_mode(VM &v, std::map<FileName, FileContent> &files,
     std::getline(std::cin, cmd);
     if (cmd == "h") debug_usage();
     if (cmd == "q") running = false;
+    // remember the state at the last stop to highlight changed variables
+    if (cmd == "e" || cmd == "s" || cmd == "E" || cmd == "S")
+      last_stop = v.snapshot();
     if (cmd == "e") v.execute();
-    if (cmd == "r") v.reset();
+    if (cmd == "r") {
+      v.reset();
+      last_stop = v.snapshot();
+    }
     if (cmd == "l" || cmd == "i") {
       BreakPoint bp = v.getCurrentBreak();
       std::cout << "program is held on breakpoint '" << bp.file << ":"
@@ -95,14 +206,20 @@ void debug_mode(VM &v, std::map<FileName, FileContent> &files,
     }
     if (cmd == "m" || cmd == "i") {
       std::cout << "memory:" << std::endl;
-      auto activations = v.getActivations();
+      auto &activations = v.getActivations();
       if (activations.size() == 0) {
         std::cout << "nothing to print, execution hasn't started" << std::endl;
         continue;
       }
-      auto data = activations.back().getActivationVariables();
-      for (auto p : data) {
-        std::cout << p.first << ": " << p.second << std::endl;
+      std::map<std::string_view, VM::Word> before = {};
+      for (auto &c : v.changedSince(last_stop)) {
+        if (c.frame + 1 == activations.size()) before[c.name] = c.before;
+      }
+      for (auto var : activations.back().getVariables()) {
+        std::cout << var.name << ": " << var.value;
+        if (before.contains(var.name))
+          std::cout << " (was " << before[var.name] << ")";
+        std::cout << std::endl;
       }
     }
     if (cmd == "s") {
@@ -110,6 +227,10 @@ void debug_mode(VM &v, std::map<FileName, FileContent> &files,
       v.execute();
       v.setSteppingMode(false);
     }
+    if (cmd == "E" && !v.reverseContinue())
+      std::cout << "no earlier breakpoint, at start of recording" << std::endl;
+    if (cmd == "S" && !v.reverseStep())
+      std::cout << "no earlier line, at start of recording" << std::endl;
     if (cmd[0] == 'b' || cmd[0] == 'd') {
       std::stringstream sstr(cmd);
       std::string t, _file, _line;
@@ -121,27 +242,166 @@ void debug_mode(VM &v, std::map<FileName, FileContent> &files,
         std::cout << "invalid number as second argument" << std::endl;
       }
       bool mode = cmd[0] == 'b' ? true : false;
-      bool res = v.setBreakPoint(_file, _iline, mode);
+      std::optional<BreakCondition> cond = std::nullopt;
+      if (mode) {
+        cond = parse_condition(sstr);
+        if (!cond) {
+          std::cout << "invalid condition, expected 'if <variable> <op> "
+                       "<variable or number>' and/or 'after <hits>'"
+                    << std::endl;
+          continue;
+        }
+      }
+      bool unconditional = !cond || (cond->cmp == BreakCondition::ALWAYS &&
+                                     cond->ignore_count == 0);
+      bool res = unconditional
+                     ? v.setBreakPoint(_file, _iline, mode)
+                     : v.setConditionalBreakPoint(_file, _iline, *cond);
       if (!res)
         std::cout << "no possible breakpoint in file '" << _file << "' at line "
-                  << _iline << std::endl;
+                  << _iline << " (or unknown variable in condition)"
+                  << std::endl;
+    }
+    if (cmd[0] == 'w' || cmd[0] == 'u') {
+      std::stringstream sstr(cmd);
+      std::string t, _value;
+      WatchPoint wp = {.program = "", .variable = "", .value = std::nullopt};
+      sstr >> t >> wp.program >> wp.variable >> _value;
+      if (_value != "") {
+        try {
+          wp.value = std::stoi(_value);
+        } catch (std::exception &e) {
+          std::cout << "invalid number as third argument" << std::endl;
+          continue;
+        }
+      }
+      if (!v.setWatchPoint(wp, cmd[0] == 'w'))
+        std::cout << "no variable '" << wp.variable << "' in program '"
+                  << wp.program << "'" << std::endl;
+    }
+    if (cmd == "e" || cmd == "s") {
+      if (auto hit = v.getCurrentWatch()) {
+        std::cout << "watchpoint: " << hit->watch.program << "."
+                  << hit->watch.variable << " changed from " << hit->before
+                  << " to " << hit->after << std::endl;
+      }
     }
     if (cmd == "c") {
       v.clearBreakpoints();
-      std::cout << "breakpoints cleared" << std::endl;
+      v.clearWatchPoints();
+      std::cout << "breakpoints and watchpoints cleared" << std::endl;
     }
     if (cmd == "a") {
       std::cout << "activated breakpoints: " << std::endl;
       for (auto b : v.getEnabledBreakPoints()) {
-        std::cout << "- " << b.file << ":" << b.line << std::endl;
+        std::cout << "- " << b.file << ":" << b.line;
+        if (auto c = v.getBreakCondition(b)) {
+          const char *ops[] = {"", "=", "!=", "<", "<=", ">", ">="};
+          if (c->cmp != BreakCondition::ALWAYS)
+            std::cout << " if " << c->variable << " " << ops[c->cmp] << " "
+                      << (c->other.empty() ? std::to_string(c->constant)
+                                           : c->other);
+          if (c->ignore_count != 0) std::cout << " after " << c->ignore_count;
+        }
+        std::cout << std::endl;
+      }
+      std::cout << "activated watchpoints: " << std::endl;
+      for (auto &w : v.getEnabledWatchPoints()) {
+        std::cout << "- " << w.program << "." << w.variable;
+        if (w.value) std::cout << " = " << *w.value;
+        std::cout << std::endl;
       }
     }
     if (cmd == "o") {
-      cr.code.disassemble(std::cout);
+      program.disassemble(std::cout);
     }
   }
 }
 
+void print_profile(const Profile &profile, const Program &program) {
+  Profile::Count total = profile.total();
+  std::cout << "profile: " << total << " instructions executed" << std::endl;
+  std::cout << "calls\tinclusive\texclusive\tPROGRAM" << std::endl;
+  for (auto &f : profile.functions(program)) {
+    std::cout << f.calls << "\t" << f.inclusive << "\t\t" << f.exclusive
+              << "\t\t" << f.name << std::endl;
+  }
+  std::cout << "instructions\t%\tline" << std::endl;
+  for (auto &l : profile.lines(program)) {
+    std::cout << l.instructions << "\t\t"
+              << (total == 0 ? 0 : (100 * l.instructions) / total) << "\t"
+              << l.line.file << ":" << l.line.line << std::endl;
+  }
+}
+
+void print_analysis(const Analysis &a) {
+  if (a.terminates())
+    std::cout << "the program terminates on every input" << std::endl;
+  else
+    std::cout << "the program may not terminate" << std::endl;
+  if (a.max_depth && a.max_data) {
+    std::cout << "at most " << *a.max_depth << " activations and "
+              << *a.max_data << " words of data" << std::endl;
+  } else {
+    std::cout << "memory isn't bounded (recursion)" << std::endl;
+  }
+  std::cout << "frame\tterminates\tPROGRAM" << std::endl;
+  for (auto &f : a.functions) {
+    std::cout << f.frame_size << "\t";
+    if (f.terminates)
+      std::cout << "yes\t";
+    else if (f.recursive)
+      std::cout << "recursive";
+    else if (!f.loop_only)
+      std::cout << "loops\t";
+    else
+      std::cout << "calls\t";
+    std::cout << "\t" << f.name << std::endl;
+  }
+}
+
+void print_time_report(const CompileStats &stats) {
+  auto ms = [](long long ns) {
+    std::stringstream s;
+    s << std::fixed << std::setprecision(3) << ns / 1e6;
+    return s.str();
+  };
+  std::cout << "time report:" << std::endl << "ms\tphase" << std::endl;
+  std::pair<long long, std::string> phases[] = {
+      {stats.ns.modules, "modules"},
+      {stats.ns.scan, "scan and macro extraction"},
+      {stats.ns.detectors, "macro detectors"},
+      {stats.ns.expansion, "macro expansion (all threads)"},
+      {stats.ns.parse, "parse"},
+      {stats.ns.gen, "code generation"},
+      {stats.ns.link, "link"},
+      {stats.ns.total, "total"}};
+  for (auto &p : phases)
+    std::cout << ms(p.first) << "\t" << p.second << std::endl;
+
+  std::cout << "tokens\tfile" << std::endl;
+  for (auto &[file, n] : stats.tokens)
+    std::cout << n << "\t" << file << std::endl;
+
+  std::cout << stats.macros << " macros extracted, " << stats.passes
+            << " expansion passes, " << stats.matches << " matches replaced"
+            << std::endl;
+  std::cout << "states\tentries\tms\tmatches\tmacro" << std::endl;
+  for (auto &d : stats.detectors) {
+    std::cout << d.states << "\t" << d.table_entries << "\t" << ms(d.ns)
+              << "\t" << d.matches << "\t" << d.file << ":" << d.line << " "
+              << d.rule << std::endl;
+  }
+
+  std::cout << stats.nodes << " AST nodes, " << stats.instructions
+            << " instructions" << std::endl;
+  std::cout << "instructions\tregisters\tPROGRAM" << std::endl;
+  for (auto &p : stats.programs) {
+    std::cout << p.instructions << "\t\t" << p.registers << "\t\t" << p.name
+              << std::endl;
+  }
+}
+
 void print_version() {
   std::cout
       << "Theo-IDE Command Line Interpreter / Debuger " << CLI_VER << std::endl
@@ -155,6 +415,9 @@ void print_version() {
 int main(int argc, char *argv[]) {
   if (argc < 2) usage();
 
+  // in batch mode, stdout only carries JSON
+  bool json = false;
+  bool batch = false;
   for (int i = 1; i < argc; i++) {
     std::string cArg = argv[i];
     if (cArg == "-h" || cArg == "--help") {
@@ -165,12 +428,30 @@ int main(int argc, char *argv[]) {
       print_version();
       return 0;
     }
+    json |= cArg == "--json" || cArg == "--batch" || cArg == "--manifest";
+    batch |= cArg == "--batch" || cArg == "--manifest";
   }
 
   bool enable_debug = false;
+  bool enable_profile = false;
+  bool enable_analysis = false;
+  bool time_report = false;
+  std::string profileCollapsed = "";
+  std::string emitBytecode = "";
+  std::string runBytecode = "";
+  std::string emitCpp = "";
+  std::string runNative = "";
+  std::string manifest = "";
+  std::string modules = "";
+  unsigned int jobs = 1;
+  VM::InstructionCount budget = 0;
+  bool lockstep = false;
+  std::map<std::string, VM::Word> variables = {};
 
   std::string mainFile = "";
   std::map<FileName, FileContent> files = {};
+  // all file arguments in order, for batch mode
+  std::vector<std::string> inputs = {};
 
   for (int i = 1; i < argc; i++) {
     std::string cArg = argv[i];
@@ -179,8 +460,93 @@ int main(int argc, char *argv[]) {
       continue;
     }
 
+    if (cArg == "--profile") {
+      enable_profile = true;
+      continue;
+    }
+
+    if (cArg == "--analyze") {
+      enable_analysis = true;
+      continue;
+    }
+
+    if (cArg == "--time-report") {
+      time_report = true;
+      continue;
+    }
+
+    if (cArg == "--json" || cArg == "--batch") continue;
+
+    if (cArg == "--lockstep") {
+      lockstep = true;
+      continue;
+    }
+
+    if (cArg == "--max-instructions") {
+      try {
+        budget = std::stoull(i + 1 < argc ? argv[++i] : "");
+      } catch (std::exception &e) {
+        std::cout << "Option '--max-instructions' expects a number"
+                  << std::endl;
+        return 1;
+      }
+      continue;
+    }
+
+    if (cArg == "-j" || cArg == "--jobs") {
+      try {
+        jobs = std::stoul(i + 1 < argc ? argv[++i] : "");
+      } catch (std::exception &e) {
+        std::cout << "Option '--jobs' expects a number" << std::endl;
+        return 1;
+      }
+      continue;
+    }
+
+    if (cArg == "--set") {
+      std::string name;
+      VM::Word value;
+      if (i + 1 >= argc || !parse_input(argv[++i], name, value)) {
+        std::cout << "Option '--set' expects <name>=<value> with a "
+                     "non-negative value"
+                  << std::endl;
+        return 1;
+      }
+      variables[name] = value;
+      continue;
+    }
+
+    if (cArg == "--emit-bytecode" || cArg == "--run-bytecode" ||
+        cArg == "--profile-collapsed" || cArg == "--emit-cpp" ||
+        cArg == "--run-native" || cArg == "--manifest" ||
+        cArg == "--modules") {
+      if (i + 1 >= argc) {
+        std::cout << "Option '" << cArg << "' expects a file name" << std::endl;
+        return 1;
+      }
+      if (cArg == "--emit-bytecode")
+        emitBytecode = argv[++i];
+      else if (cArg == "--run-bytecode")
+        runBytecode = argv[++i];
+      else if (cArg == "--emit-cpp")
+        emitCpp = argv[++i];
+      else if (cArg == "--run-native")
+        runNative = argv[++i];
+      else if (cArg == "--manifest")
+        manifest = argv[++i];
+      else if (cArg == "--modules")
+        modules = argv[++i];
+      else
+        profileCollapsed = argv[++i];
+      continue;
+    }
+
     if (cArg[0] == '-') continue;
 
+    inputs.push_back(cArg);
+    // batch jobs read their own files
+    if (json) continue;
+
     // read in file
     std::ifstream f(cArg);
     if (!f.is_open()) {
@@ -196,33 +562,144 @@ int main(int argc, char *argv[]) {
     files[cArg] = sbf.str();
   }
 
-  if (mainFile == "") {
-    std::cout << "No files were opened, aborting." << std::endl;
-    return 1;
+  if (json) {
+    std::vector<BatchJob> batch_jobs = {};
+    std::string error;
+    if (manifest != "" && !read_manifest(manifest, batch_jobs, error)) {
+      std::cout << "Couldn't read manifest: " << error << std::endl;
+      return 1;
+    }
+    if (batch) {
+      for (auto &f : inputs)
+        batch_jobs.push_back({.files = {f}, .directory = "", .inputs = {}});
+    } else if (!inputs.empty()) {
+      batch_jobs.push_back({.files = inputs, .directory = "", .inputs = {}});
+    }
+    // bindings in the manifest take precedence
+    for (auto &j : batch_jobs)
+      j.inputs.insert(variables.begin(), variables.end());
+    BatchOptions options = {
+        .threads = jobs, .budget = budget, .lockstep = lockstep};
+    return run_batch(batch_jobs, options, std::cout) ? 0 : 1;
   }
 
-  CodegenResult cr = compile(files, mainFile);
+  if (runNative != "") {
+    if (!variables.empty()) {
+      std::cout << "Option '--set' isn't supported with '--run-native'"
+                << std::endl;
+      return 1;
+    }
+    NativeLoadResult lr = NativeProgram::load(runNative);
+    if (!lr.loaded_correctly) {
+      std::cout << "Couldn't load native program: " << lr.error << std::endl;
+      return 1;
+    }
+    std::cout << "variables after execution:" << std::endl;
+    for (auto p : lr.program->run()) {
+      std::cout << p.first << ": " << p.second << std::endl;
+    }
+    return 0;
+  }
+
+  Program program;
+
+  if (runBytecode != "") {
+    BytecodeLoadResult lr = Program::load(runBytecode);
+    if (!lr.loaded_correctly) {
+      std::cout << "Couldn't load bytecode: " << lr.error << std::endl;
+      return 1;
+    }
+    program = lr.program;
+  } else {
+    if (mainFile == "") {
+      std::cout << "No files were opened, aborting." << std::endl;
+      return 1;
+    }
+
+    CodegenResult cr;
+    CompileStats stats;
+    CompileStats *counted = time_report ? &stats : NULL;
+    if (modules != "") {
+      ModuleCache cache(modules);
+      cr = compile(string_sources(files), mainFile, cache, jobs, NULL,
+                   counted);
+    } else {
+      cr = compile(files, mainFile, jobs, NULL, counted);
+    }
+    if (time_report) print_time_report(stats);
+
+    if (!cr.generated_correctly) {
+      std::cout << "Compilation Errors: " << std::endl;
+      for (auto e : cr.errors) {
+        std::cout << "[" << (int)e.t << "] "
+                  << "in '" << e.file << "', line " << e.line << " '"
+                  << e.message << "'" << std::endl;
+      }
+      return 1;
+    }
+    program = cr.code;
+  }
 
-  if (!cr.generated_correctly) {
-    std::cout << "Compilation Errors: " << std::endl;
-    for (auto e : cr.errors) {
-      std::cout << "[" << (int)e.t << "] "
-                << "in '" << e.file << "', line " << e.line << " '" << e.message
-                << "'" << std::endl;
+  if (enable_analysis) {
+    print_analysis(Analysis::analyze(program));
+    return 0;
+  }
+
+  if (emitBytecode != "") {
+    if (!program.save(emitBytecode)) {
+      std::cout << "Couldn't write bytecode to '" << emitBytecode << "'"
+                << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (emitCpp != "") {
+    std::ofstream o(emitCpp);
+    if (!program.emitCpp(o)) {
+      std::cout << "Couldn't translate the program to '" << emitCpp << "'"
+                << std::endl;
+      return 1;
     }
-    return 1;
+    return 0;
   }
 
-  VM v(cr.code);
+  VM v(program);
+  v.setProfiling(enable_profile || profileCollapsed != "");
+  for (auto &var : variables) {
+    if (!v.setInput(var.first, var.second)) {
+      std::cout << "No variable '" << var.first << "' in the root script"
+                << std::endl;
+      return 1;
+    }
+  }
 
   if (enable_debug) {
-    debug_mode(v, files, cr);
+    debug_mode(v, files, program);
   } else {
     v.execute();
+    if (v.getFault())
+      std::cout << "execution stopped: " << *v.getFault() << std::endl;
     std::cout << "variables after execution:" << std::endl;
-    auto data = v.getActivations().back().getActivationVariables();
-    for (auto p : data) {
-      std::cout << p.first << ": " << p.second << std::endl;
+    // unverified bytecode may fault before the root frame exists
+    auto &activations = v.getActivations();
+    if (!activations.empty()) {
+      auto data = activations.back().getActivationVariables();
+      for (auto p : data) {
+        std::cout << p.first << ": " << p.second << std::endl;
+      }
+    }
+  }
+
+  if (enable_profile) print_profile(v.getProfile(), program);
+
+  if (profileCollapsed != "") {
+    std::ofstream o(profileCollapsed);
+    v.getProfile().writeCollapsed(o, program);
+    if (!o) {
+      std::cout << "Couldn't write profile to '" << profileCollapsed << "'"
+                << std::endl;
+      return 1;
     }
   }
 
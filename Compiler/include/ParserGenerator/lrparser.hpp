@@ -70,6 +70,15 @@ struct LRParser {
   template <typename Iterable>
   ParseResult parse(Iterable in);
 
+  /* the number of states of the generated tables */
+  std::size_t states() const { return action.size(); }
+
+  /* the number of entries of the generated action and jump tables */
+  std::size_t tableEntries() const {
+    if (action.empty()) return 0;
+    return action.size() * (action[0].size() + jump[0].size());
+  }
+
  private:
   SemanticGrammar<SemanticType> G;
   bool accept_prefix;
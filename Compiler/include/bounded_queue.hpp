@@ -0,0 +1,54 @@
+#ifndef __LIBTHEO_C_BOUNDED_QUEUE_HPP_
+#define __LIBTHEO_C_BOUNDED_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Theo {
+
+/**
+ * a queue of limited capacity between exactly one producing and one
+ * consuming thread, without locks: both sides only synchronize through the
+ * positions of the next value to push and to pop, and wait for each other
+ * (without spinning) only if the queue is full or empty
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  BoundedQueue(std::size_t capacity) : slots(capacity), head(0), tail(0) {}
+
+  /* add a value, waits while the queue is full */
+  void push(T value) {
+    std::size_t t = this->tail.load(std::memory_order_relaxed);
+    for (std::size_t h = this->head.load(std::memory_order_acquire);
+         t - h == this->slots.size();
+         h = this->head.load(std::memory_order_acquire))
+      this->head.wait(h, std::memory_order_acquire);
+    this->slots[t % this->slots.size()] = std::move(value);
+    this->tail.store(t + 1, std::memory_order_release);
+    this->tail.notify_one();
+  }
+
+  /* remove the oldest value, waits while the queue is empty */
+  T pop() {
+    std::size_t h = this->head.load(std::memory_order_relaxed);
+    for (std::size_t t = this->tail.load(std::memory_order_acquire); t == h;
+         t = this->tail.load(std::memory_order_acquire))
+      this->tail.wait(t, std::memory_order_acquire);
+    T value = std::move(this->slots[h % this->slots.size()]);
+    this->head.store(h + 1, std::memory_order_release);
+    this->head.notify_one();
+    return value;
+  }
+
+ private:
+  std::vector<T> slots;
+  // number of values popped and pushed so far
+  std::atomic<std::size_t> head, tail;
+};
+
+};  // namespace Theo
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __LIBTHEO_C_BUDGET_HPP_
+#define __LIBTHEO_C_BUDGET_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+namespace Theo {
+
+/**
+ * bounds on the work of a compilation, e.g. for an editor that compiles on
+ * every change and abandons the compilations it no longer needs; a
+ * compilation that is cancelled or reaches the maximum number of syntax
+ * errors ends early and reports the errors found until then
+ */
+class CompileBudget {
+ public:
+  /**
+   * @param max_errors number of syntax errors after which the rest of the
+   * input isn't parsed (0: no limit)
+   */
+  CompileBudget(std::size_t max_errors = 0);
+
+  /**
+   * stop the compilations using this budget as soon as possible; may be
+   * called from any thread
+   */
+  void cancel();
+
+  bool cancelled() const;
+
+  std::size_t maxErrors() const;
+
+ private:
+  std::atomic<bool> stopped;
+  std::size_t max_errors;
+};
+
+};  // namespace Theo
+
+#endif
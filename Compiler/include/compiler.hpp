@@ -3,16 +3,53 @@
 
 #include "Compiler/include/ast.hpp"
 #include "Compiler/include/gen.hpp"
+#include "Compiler/include/module.hpp"
 #include "Compiler/include/parse.hpp"
+#include "Compiler/include/stats.hpp"
 namespace Theo {
 
 /**
  * main compilation api;
  * @param files all valid files
  * @param main key of the main file in files
+ * @param threads number of threads the compilation stages may use (0: one per
+ * hardware thread, 1: compile on the calling thread only)
+ * @param budget bounds on the work, e.g. to cancel the compilation from
+ * another thread, see CompileBudget
+ * @param stats if given, the time and the work of every phase are added to it
  * @return a codegen result which will contain a valid program or error messages
  */
-CodegenResult compile(std::map<FileName, FileContent> files, FileName main);
+CodegenResult compile(std::map<FileName, FileContent> files, FileName main,
+                      unsigned int threads = 1,
+                      const CompileBudget *budget = NULL,
+                      CompileStats *stats = NULL);
+
+/**
+ * compile files that are read as they are scanned, without holding them in
+ * memory as a whole;
+ * @param resolve opens the files by name, see file_sources
+ * @param main name of the main file
+ * @param threads see above
+ * @param budget see above
+ * @param stats see above
+ */
+CodegenResult compile(TokenStream::Resolver resolve, FileName main,
+                      unsigned int threads = 1,
+                      const CompileBudget *budget = NULL,
+                      CompileStats *stats = NULL);
+
+/**
+ * compile a main file whose includes are modules: every file the main file
+ * includes is compiled on its own (see compile_module), or taken from the
+ * cache if it didn't change, and contributes its macros and PROGRAMs, as if
+ * they were defined before the main file; the code of the modules is linked
+ * into the result
+ * @param modules cache of the compiled modules
+ */
+CodegenResult compile(TokenStream::Resolver resolve, FileName main,
+                      ModuleCache &modules, unsigned int threads = 1,
+                      const CompileBudget *budget = NULL,
+                      CompileStats *stats = NULL);
 
 };  // namespace Theo
 #endif
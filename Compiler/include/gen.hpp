@@ -14,6 +14,18 @@
 #include "VM/include/program.hpp"
 namespace Theo {
 
+/**
+ * a PROGRAM as it can be called from other code, e.g. of a module (see
+ * module.hpp)
+ */
+struct Symbol {
+  std::string name;
+  ProgramIndex entry;  // position of its first instruction
+  StackMapIndex map;   // index of its stack map
+  int argnum;
+  int stack_size;
+};
+
 struct CodegenResult {
   struct Error {
     enum class Type {
@@ -23,6 +35,7 @@ struct CodegenResult {
       ARGSIZE_MISMATCH = 4, /*function called with wrong number of arguments*/
       INTERNAL_ERROR = 5,   /*codegen error, e.g. couldn't backpatch*/
       UNKNOWN_MARK = 6,     /*GOTO to undefined jump mark*/
+      NOT_A_MODULE = 7,     /*module with instructions outside of programs*/
     };
     Type t;
     std::string message;
@@ -36,9 +49,29 @@ struct CodegenResult {
 
   /* file names that weren't found in the inpu */
   std::vector<std::string> file_requests;
+
+  /* the PROGRAMs defined by the code, in the order they are defined */
+  std::vector<Symbol> symbols;
+
+  /* a call of an imported PROGRAM (an index into the imports) */
+  struct External {
+    ProgramIndex prepare, exec;
+    int symbol;
+  };
+  /* the calls whose PREPARE_EXEC and EXEC are left for the linker to fill */
+  std::vector<External> externals;
 };
 
-CodegenResult gen(Theo::AST);
+/**
+ * generate the bytecode of a program
+ * @param threads number of threads (0: one per hardware thread); with more
+ * than one, every PROGRAM is generated into a buffer of its own in parallel
+ * and the buffers are linked afterwards, the result is the same
+ * @param imports PROGRAMs defined elsewhere, which count as defined before
+ * the code; calls to them are listed in .externals
+ */
+CodegenResult gen(Theo::AST, unsigned int threads = 1,
+                  const std::vector<Symbol> &imports = {});
 
 };  // namespace Theo
 
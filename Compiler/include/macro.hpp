@@ -1,11 +1,15 @@
 #ifndef __LIBTHEO_C_MACRO_HPP_
 #define __LIBTHEO_C_MACRO_HPP_
 
+#include <memory>
 #include <optional>
 #include <vector>
 
 #include "Compiler/include/ParserGenerator/lrparser.hpp"
+#include "Compiler/include/budget.hpp"
 #include "Compiler/include/parse_error.hpp"
+#include "Compiler/include/scan.hpp"
+#include "Compiler/include/stats.hpp"
 #include "Compiler/include/token.hpp"
 
 namespace Theo {
@@ -40,6 +44,13 @@ struct MacroApplicationResult {
  */
 Theo::MacroExtractionResult extract_macros(std::vector<Theo::Token> tokens);
 
+/**
+ * Extract the macro definitions while pulling the tokens from a stream, which
+ * is read to its end;
+ * @param tokens scanner output, see TokenStream
+ */
+Theo::MacroExtractionResult extract_macros(Theo::TokenStream &tokens);
+
 /**
  * Apply macros to a token stream;
  * Possible Erros:
@@ -49,10 +60,82 @@ Theo::MacroExtractionResult extract_macros(std::vector<Theo::Token> tokens);
  * extract_macros)
  * @param definitions macro definitions extracted by extract_macros
  * @param passes      maximum number of macro expansions to perform
+ * @param budget      if it is cancelled, the expansion ends early and the
+ * sequence is only partially expanded
  */
 Theo::MacroApplicationResult apply_macros(
     std::vector<Theo::Token> input,
-    std::vector<Theo::MacroDefinition> &definitions, unsigned int passes);
+    std::vector<Theo::MacroDefinition> &definitions, unsigned int passes,
+    const CompileBudget *budget = NULL);
+
+/**
+ * Extract and apply the macros of a token stream in concurrent stages:
+ *  - the stream is scanned on a thread of its own, ahead of the extraction
+ *  - the detectors of the extracted macros are generated in parallel
+ *  - the token sequence is split into regions, each starting at a PROGRAM
+ *    token, which are expanded in parallel, every one on its own
+ *  - the expanded regions are handed out in order as soon as each is done,
+ *    while later ones are still being expanded
+ * no macro can match across the start of a region, so the result is that of
+ * apply_macros, except that the maximum number of passes applies to every
+ * region and the names of temporaries (TEMP_VAL) are only unique within their
+ * region; if a macro contains a PROGRAM token, the whole sequence is one
+ * region
+ */
+class MacroPipeline {
+ public:
+  /**
+   * extract the macros and start expanding them
+   * @param tokens  output from scanner, read to its end
+   * @param passes  maximum number of macro expansions per region
+   * @param threads number of threads (0: one per hardware thread); with 1,
+   * every stage runs on the calling thread and regions are only expanded
+   * when they are requested
+   * @param imported macros defined elsewhere (e.g. by modules), which count
+   * as defined before the ones of the stream
+   * @param budget  if it is cancelled, the stream is read no further and the
+   * regions are handed out as far as they are expanded
+   */
+  MacroPipeline(TokenStream &tokens, unsigned int passes, unsigned int threads,
+                const std::vector<MacroDefinition> &imported = {},
+                const CompileBudget *budget = NULL);
+  ~MacroPipeline();
+  MacroPipeline(const MacroPipeline &) = delete;
+  MacroPipeline &operator=(const MacroPipeline &) = delete;
+
+  /**
+   * get the expanded tokens of the next region, waiting for its expansion;
+   * the last region ends with the T_EOF token
+   * @return false after the last region
+   */
+  bool next(std::vector<Token> &region);
+
+  /**
+   * stop expanding, e.g. once the parser needs no more tokens: the regions
+   * are handed out as far as they are expanded
+   */
+  void abandon();
+
+  /* the macros defined by the stream, without the imported ones */
+  const std::vector<MacroDefinition> &getMacros();
+
+  /**
+   * the errors of the extraction, followed by those of the application;
+   * waits until all regions are expanded
+   */
+  std::vector<ParseError> getErrors();
+
+  /**
+   * add the work of the stages to stats: the scanned tokens, the macros and
+   * their detectors, the expansion and the time of each stage; waits until
+   * all regions are expanded
+   */
+  void report(CompileStats &stats);
+
+ private:
+  struct Stages;
+  std::unique_ptr<Stages> stages;
+};
 
 /**
  * attempt to back-convert a token sequence into a string;
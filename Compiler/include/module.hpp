@@ -0,0 +1,95 @@
+#ifndef __LIBTHEO_C_MODULE_HPP_
+#define __LIBTHEO_C_MODULE_HPP_
+
+/**
+ * Separately compiled modules
+ */
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Compiler/include/gen.hpp"
+#include "Compiler/include/macro.hpp"
+#include "Compiler/include/scan.hpp"
+#include "VM/include/program.hpp"
+
+namespace Theo {
+
+/**
+ * a file (with the files it includes) that only defines PROGRAMs and macros,
+ * compiled on its own so that it can be linked into other programs
+ */
+struct Module {
+  FileName file;
+  /* the PROGRAMs of the module, after an empty root script */
+  Program code;
+  /* the PROGRAMs others can call, the last definition of every name */
+  std::vector<Symbol> symbols;
+  /* the macros the module defines, without the standard macros */
+  std::vector<MacroDefinition> macros;
+  /* the files the module was compiled from, with a hash of their content */
+  std::vector<std::pair<FileName, std::uint64_t>> sources;
+};
+
+struct ModuleResult {
+  bool compiled_correctly;
+  std::vector<CodegenResult::Error> errors;
+  std::vector<std::string> file_requests;
+  Module module;
+};
+
+/**
+ * compile a file as a module
+ * @param resolve opens the files by name, see file_sources
+ * @param file    name of the module's file
+ * @param threads see compile()
+ * @param budget  see compile()
+ */
+ModuleResult compile_module(TokenStream::Resolver resolve, FileName file,
+                            unsigned int threads = 1,
+                            const CompileBudget *budget = NULL);
+
+/**
+ * append the code of modules to a program compiled against their symbols
+ * (in this order) and resolve its calls to them (unit.externals)
+ */
+void link(CodegenResult &unit, const std::vector<Module> &modules);
+
+/**
+ * modules by file name, which are only compiled again if one of their
+ * sources changed; not thread-safe
+ */
+class ModuleCache {
+ public:
+  /**
+   * @param directory where the modules are stored across runs (created if
+   * missing), "" to keep them in memory only
+   */
+  ModuleCache(std::string directory);
+
+  /**
+   * the module compiled from a file, taken from the cache if its sources are
+   * unchanged, otherwise compiled and stored (unless it has errors)
+   */
+  ModuleResult get(TokenStream::Resolver resolve, const FileName &file,
+                   unsigned int threads = 1,
+                   const CompileBudget *budget = NULL);
+
+  /* the number of modules get() had to compile */
+  int compilations();
+
+ private:
+  std::string directory;
+  std::map<FileName, Module> modules;
+  int compiled;
+
+  // where the files of a module are stored
+  std::string path(const FileName &file);
+};
+
+};  // namespace Theo
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __LIBTHEO_C_PARALLEL_HPP_
+#define __LIBTHEO_C_PARALLEL_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Theo {
+
+/**
+ * calls f(0) ... f(count - 1) on the given number of threads (including the
+ * calling one); the threads take the next index as soon as they are done
+ * with the last one, so calls of different cost still balance out
+ */
+template <typename F>
+void parallel_for(std::size_t count, unsigned int threads, F f) {
+  std::atomic<std::size_t> next = 0;
+  auto work = [&]() {
+    for (std::size_t k = next++; k < count; k = next++) f(k);
+  };
+  std::vector<std::thread> workers = {};
+  for (unsigned int t = 1; t < threads && t < count; t++)
+    workers.emplace_back(work);
+  work();
+  for (auto &w : workers) w.join();
+}
+
+};  // namespace Theo
+
+#endif
@@ -4,7 +4,10 @@
 #include <map>
 
 #include "Compiler/include/ast.hpp"
+#include "Compiler/include/budget.hpp"
+#include "Compiler/include/macro.hpp"
 #include "Compiler/include/scan.hpp"
+#include "Compiler/include/stats.hpp"
 
 #define THEO_MACRO_PASSES 1024
 
@@ -13,12 +16,46 @@ namespace Theo {
 struct ParseResult {
   std::vector<std::string> missing_files;
   AST a;
+  /* the macros defined by the files (including the standard macros) */
+  std::vector<MacroDefinition> macros;
 };
 
 /**
  * parse a number of strings;
+ * @param threads number of threads for the stages of the macro pipeline (0:
+ * one per hardware thread, see MacroPipeline)
+ * @param budget  bounds on the work, see CompileBudget; a parse that ends
+ * early reports why as its last error
+ * @param stats   if given, the work of scanning, macro expansion and parsing
+ * is added to it
  */
-ParseResult parse(std::map<FileName, FileContent> files, FileName main);
+ParseResult parse(std::map<FileName, FileContent> files, FileName main,
+                  unsigned int threads = 1,
+                  const CompileBudget *budget = NULL,
+                  CompileStats *stats = NULL);
+
+/**
+ * parse files that are read as they are scanned;
+ * @param resolve  opens the files by name, see file_sources
+ * @param main     name of the main file
+ * @param threads  see above
+ * @param imported macros defined before the files, e.g. by modules
+ * @param budget   see above
+ * @param stats    see above
+ */
+ParseResult parse(TokenStream::Resolver resolve, FileName main,
+                  unsigned int threads = 1,
+                  const std::vector<MacroDefinition> &imported = {},
+                  const CompileBudget *budget = NULL,
+                  CompileStats *stats = NULL);
+
+/**
+ * parse the files of a module (see module.hpp), whose root script may be
+ * empty if it defines PROGRAMs
+ */
+ParseResult parse_module(TokenStream::Resolver resolve, FileName file,
+                         unsigned int threads = 1,
+                         const CompileBudget *budget = NULL);
 
 };  // namespace Theo
 
@@ -1,11 +1,14 @@
 #ifndef __LIBTHEO_C_SCAN_HPP_
 #define __LIBTHEO_C_SCAN_HPP_
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Compiler/include/parse_error.hpp"
+#include "Compiler/include/source.hpp"
 #include "Compiler/include/token.hpp"
 
 namespace Theo {
@@ -22,6 +25,66 @@ struct ScanResult {
  */
 std::string token_string(Theo::Token::Type t);
 
+/**
+ * tokens of multiple files, scanned one at a time as they are requested:
+ * include directives are replaced by the tokens of the included file, which
+ * is only opened when the directive is reached; at any time only the
+ * buffers of the files in the current chain of includes are held in memory
+ */
+class TokenStream {
+ public:
+  /* opens a file by name, nullptr if there is no such file */
+  typedef std::function<std::unique_ptr<Source>(const FileName &)> Resolver;
+
+  TokenStream(Resolver resolve, FileName main);
+  ~TokenStream();
+  TokenStream(const TokenStream &) = delete;
+  TokenStream &operator=(const TokenStream &) = delete;
+
+  /**
+   * get the next token; the last one is of type T_EOF
+   * @return false once the T_EOF token was returned
+   */
+  bool next(Token &t);
+
+  /**
+   * continue with the tokens of a file, as if the current file included it
+   * at this point
+   */
+  void include(const FileName &name);
+
+  /* errors encountered so far */
+  const std::vector<ParseError> &getErrors();
+
+ private:
+  struct Scanner;
+
+  Resolver resolve;
+  FileName main;
+  std::vector<Scanner> scanners;
+  std::vector<ParseError> errors;
+  // the last token returned
+  Token last;
+  bool ended;
+
+  // false if the file doesn't exist
+  bool open(const FileName &name);
+  // include a file from a directive in file from
+  void includeAt(FileName name, FileName from, int line);
+};
+
+/**
+ * resolve files from memory, the map has to outlive the resolver
+ */
+TokenStream::Resolver string_sources(
+    const std::map<FileName, FileContent> &files);
+
+/**
+ * resolve files from disk, relative to a directory ("" for the working
+ * directory)
+ */
+TokenStream::Resolver file_sources(const std::string &directory);
+
 /**
  * convert multiple files to one token stream;
  * @param files input files
@@ -3,9 +3,13 @@
 
 #include <string>
 
+#include "Compiler/include/source.hpp"
+
 namespace Theo {
 struct ScannerInfo {
   std::string filename;
+  // where the scanner reads the file from
+  Source *source;
 };
 };  // namespace Theo
 
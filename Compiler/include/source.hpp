@@ -0,0 +1,59 @@
+#ifndef __LIBTHEO_C_SOURCE_HPP_
+#define __LIBTHEO_C_SOURCE_HPP_
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+namespace Theo {
+
+/**
+ * provider of the content of one file; the scanner reads it in chunks as it
+ * needs them, so a file doesn't have to be held in memory as a whole
+ */
+class Source {
+ public:
+  virtual ~Source() = default;
+
+  /**
+   * copy the next characters of the file to buf
+   * @return the number of characters copied (at most max_size), 0 at the
+   * end of the file
+   */
+  virtual std::size_t read(char *buf, std::size_t max_size) = 0;
+};
+
+/**
+ * content already in memory, which isn't copied and has to outlive the
+ * source
+ */
+class StringSource : public Source {
+ public:
+  StringSource(std::string_view content);
+
+  std::size_t read(char *buf, std::size_t max_size) override;
+
+ private:
+  std::string_view content;
+  std::size_t pos;
+};
+
+/**
+ * a file on disk, read in chunks
+ */
+class FileSource : public Source {
+ public:
+  FileSource(const std::string &path);
+
+  bool isOpen();
+
+  std::size_t read(char *buf, std::size_t max_size) override;
+
+ private:
+  std::ifstream f;
+};
+
+};  // namespace Theo
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __LIBTHEO_C_STATS_HPP_
+#define __LIBTHEO_C_STATS_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Compiler/include/scan.hpp"
+
+namespace Theo {
+
+/**
+ * where the time of a compilation goes, see compile(); times are in
+ * nanoseconds of wall clock time, except where they are summed over threads
+ */
+struct CompileStats {
+  struct Times {
+    /* getting the included modules, see ModuleCache */
+    long long modules = 0;
+    /* scanning and macro extraction, which read the files together */
+    long long scan = 0;
+    /* generating the parse tables of the macro detectors */
+    long long detectors = 0;
+    /* macro expansion, summed over the regions (and the threads) */
+    long long expansion = 0;
+    /* recursive descent, without waiting for the expansion */
+    long long parse = 0;
+    long long gen = 0;
+    /* linking the modules */
+    long long link = 0;
+    long long total = 0;
+  };
+
+  /* the macro detector of a macro definition */
+  struct Detector {
+    /* the tokens to match, separated by spaces */
+    std::string rule;
+    FileName file;
+    int line;
+    /* size of the LR(1) parse tables */
+    std::size_t states;
+    std::size_t table_entries;
+    /* time to generate the tables */
+    long long ns;
+    /* number of times the macro was applied */
+    std::size_t matches;
+  };
+
+  struct Program {
+    std::string name;
+    std::size_t instructions;
+    int registers;
+  };
+
+  Times ns = {};
+  /* tokens scanned per file */
+  std::map<FileName, std::size_t> tokens = {};
+  /* number of macros extracted from the files (without imported ones) */
+  std::size_t macros = 0;
+  /* detectors of the extracted and imported macros, in order */
+  std::vector<Detector> detectors = {};
+  /* macro expansion passes executed, summed over the regions */
+  std::size_t passes = 0;
+  /* macro matches replaced */
+  std::size_t matches = 0;
+  std::size_t nodes = 0;
+  /* instructions emitted, without those of linked modules */
+  std::size_t instructions = 0;
+  /* the PROGRAMs defined by the main file, in order, then the root script */
+  std::vector<Program> programs = {};
+};
+
+/* nanoseconds since start, for CompileStats */
+inline long long elapsed_ns(std::chrono::steady_clock::time_point start) {
+  auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+};  // namespace Theo
+
+#endif
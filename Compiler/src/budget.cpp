@@ -0,0 +1,18 @@
+#include "Compiler/include/budget.hpp"
+
+using namespace Theo;
+
+CompileBudget::CompileBudget(std::size_t max_errors) {
+  this->stopped = false;
+  this->max_errors = max_errors;
+}
+
+void CompileBudget::cancel() {
+  this->stopped.store(true, std::memory_order_relaxed);
+}
+
+bool CompileBudget::cancelled() const {
+  return this->stopped.load(std::memory_order_relaxed);
+}
+
+std::size_t CompileBudget::maxErrors() const { return this->max_errors; }
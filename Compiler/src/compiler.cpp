@@ -1,15 +1,127 @@
 #include "Compiler/include/compiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
 #include "Compiler/include/gen.hpp"
 
 using namespace Theo;
 
+typedef std::chrono::steady_clock Clock;
+
+// gen(), adding its time and the size of the code to stats if given
+static CodegenResult counted_gen(AST &a, unsigned int threads,
+                                 const std::vector<Symbol> &imports,
+                                 CompileStats *stats) {
+  Clock::time_point start = Clock::now();
+  CodegenResult cr = Theo::gen(a, threads, imports);
+  if (stats == NULL) return cr;
+  stats->ns.gen += elapsed_ns(start);
+
+  const std::vector<Instruction> &code = cr.code.code;
+  stats->instructions += code.size();
+  if (!cr.generated_correctly) return cr;
+  // every PROGRAM is preceded by a jump to its end, the rest is the root
+  // script
+  std::size_t root = code.size();
+  for (auto &s : cr.symbols) {
+    const Instruction &skip = code[s.entry - 1];
+    std::size_t size = 0;
+    if (skip.op == OpCode::JMP) size = skip.parameters.jmp.offset - 1;
+    stats->programs.push_back({s.name, size, s.stack_size});
+    root -= size + 1;
+  }
+  stats->programs.push_back(
+      {"#root", root, code[0].parameters.prepare.count});
+  return cr;
+}
+
 CodegenResult Theo::compile(std::map<FileName, FileContent> files,
-                            FileName main) {
-  ParseResult intermediate = parse(files, main);
-  CodegenResult result = gen(intermediate.a);
+                            FileName main, unsigned int threads,
+                            const CompileBudget *budget, CompileStats *stats) {
+  return compile(string_sources(files), main, threads, budget, stats);
+}
+
+CodegenResult Theo::compile(TokenStream::Resolver resolve, FileName main,
+                            unsigned int threads, const CompileBudget *budget,
+                            CompileStats *stats) {
+  Clock::time_point start = Clock::now();
+  ParseResult intermediate = parse(resolve, main, threads, {}, budget, stats);
+  CodegenResult result = counted_gen(intermediate.a, threads, {}, stats);
+
+  intermediate.a.clear();
+  result.file_requests = intermediate.missing_files;
+
+  if (stats != NULL) stats->ns.total += elapsed_ns(start);
+  return result;
+}
+
+CodegenResult Theo::compile(TokenStream::Resolver resolve, FileName main,
+                            ModuleCache &modules, unsigned int threads,
+                            const CompileBudget *budget, CompileStats *stats) {
+  Clock::time_point start = Clock::now();
+  // the modules are the files the main file includes
+  std::vector<FileName> included = {};
+  auto is_module = [&included](const FileName &name) {
+    return std::find(included.begin(), included.end(), name) !=
+           included.end();
+  };
+  TokenStream includes(
+      [&](const FileName &name) -> std::unique_ptr<Source> {
+        if (name == main) return resolve(name);
+        if (!is_module(name)) included.push_back(name);
+        return std::make_unique<StringSource>("");
+      },
+      main);
+  for (Token t; includes.next(t);) {
+  }
+
+  CodegenResult failed = {.generated_correctly = false,
+                          .errors = {},
+                          .code = {},
+                          .file_requests = {},
+                          .symbols = {},
+                          .externals = {}};
+  std::vector<Module> linked = {};
+  std::vector<Symbol> symbols = {};
+  std::vector<MacroDefinition> macros = {};
+  for (auto &name : included) {
+    ModuleResult mr = modules.get(resolve, name, threads, budget);
+    failed.errors.insert(failed.errors.end(), mr.errors.begin(),
+                         mr.errors.end());
+    failed.file_requests.insert(failed.file_requests.end(),
+                                mr.file_requests.begin(),
+                                mr.file_requests.end());
+    if (!mr.compiled_correctly) continue;
+    symbols.insert(symbols.end(), mr.module.symbols.begin(),
+                   mr.module.symbols.end());
+    macros.insert(macros.end(), mr.module.macros.begin(),
+                  mr.module.macros.end());
+    linked.push_back(std::move(mr.module));
+  }
+  if (stats != NULL) stats->ns.modules += elapsed_ns(start);
+  if (!failed.errors.empty() || !failed.file_requests.empty()) {
+    if (stats != NULL) stats->ns.total += elapsed_ns(start);
+    return failed;
+  }
+
+  // the files of the modules are left out of the main file
+  ParseResult intermediate = parse(
+      [&](const FileName &name) -> std::unique_ptr<Source> {
+        if (is_module(name)) return std::make_unique<StringSource>("");
+        return resolve(name);
+      },
+      main, threads, macros, budget, stats);
+  CodegenResult result = counted_gen(intermediate.a, threads, symbols, stats);
 
   intermediate.a.clear();
   result.file_requests = intermediate.missing_files;
+  Clock::time_point linking = Clock::now();
+  if (result.generated_correctly) link(result, linked);
 
+  if (stats != NULL) {
+    stats->ns.link += elapsed_ns(linking);
+    stats->ns.total += elapsed_ns(start);
+  }
   return result;
 }
@@ -7,8 +7,11 @@
 #include <cstdlib>
 #include <map>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 #include "Compiler/include/gen.hpp"
+#include "Compiler/include/parallel.hpp"
 #include "VM/include/instr.hpp"
 
 using namespace Theo;
@@ -58,6 +61,16 @@ struct FunctionGenState {
 struct FileState {
   std::string name;
   int line;
+
+  // move to the position of a node, true if that starts a new line
+  bool advance(int new_lineno, const std::string &file) {
+    if (file == "__standards__")
+      return false;  // standard macros for (id + int, id - int are not visible)
+    if (this->name == file && this->line == new_lineno) return false;
+    this->name = file;
+    this->line = new_lineno;
+    return true;
+  }
 };
 
 struct Prog {
@@ -65,6 +78,42 @@ struct Prog {
   StackMapIndex mi;
   int argnum;
   int stack_size;
+  int external = -1;  // index into the imports
+};
+
+/*
+  parallel code generation: every PROGRAM (and the root script) is generated
+  into a buffer of its own and the buffers are linked afterwards; a first
+  walk over the AST finds out what generating them one after another would
+  have known when entering and leaving each PROGRAM
+ */
+
+struct Unit {
+  Node *node;  // NULL for the root script
+  FileState entry, exit;
+  int loops_entry, loops_exit;
+  int argnum;
+};
+
+struct Plan {
+  std::vector<Unit> units;  // in the order the PROGRAMs are finished
+  std::unordered_map<Node *, int> unit_of;  // PROGRAM node -> unit
+  std::unordered_map<Node *, int> callee;  // CALL node -> unit, -1 if unknown
+  std::unordered_map<Node *, int> external;  // CALL node -> import
+};
+
+// a PROGRAM that is linked into a buffer in front of position at
+struct Splice {
+  ProgramIndex at;
+  int unit;
+  // errors and file names of the buffer up to the PROGRAM
+  std::size_t errors, files;
+};
+
+// a call whose callee is only known by unit until linking
+struct Call {
+  ProgramIndex prepare, exec;
+  int unit;
 };
 
 struct GenState {
@@ -85,6 +134,15 @@ struct GenState {
 
   FileState fs;
 
+  // set when generating a unit of the plan
+  const Plan *plan = NULL;
+  std::vector<Splice> splices = {};
+  std::vector<Call> calls = {};
+
+  const std::vector<Symbol> *imports = NULL;
+  std::vector<Symbol> defined = {};
+  std::vector<CodegenResult::External> externals = {};
+
   void err(CodegenResult::Error::Type t, std::string msg) {
     std::string in_file = "root";
     int on_line = 0;
@@ -101,18 +159,16 @@ struct GenState {
   ProgramIndex getNextPos() { return out.code.size(); }
 
   ProgramIndex getMarkPos() {
-    if (out.code.back().op == OpCode::POTENTIAL_BREAK) {
+    if (!out.code.empty() && out.code.back().op == OpCode::POTENTIAL_BREAK) {
       return this->getNextPos() - 1;
     }
     return this->getNextPos();
   }
 
   void removeTopPotBreak() {
-    if (out.code.back().op == OpCode::POTENTIAL_BREAK) {
-      BreakPoint bp = this->out.line_info[this->getNextPos() - 1];
-      this->out.line_info.erase(
-          this->out.line_info.find(this->getNextPos() - 1));
-      this->out.potential_breaks.erase(this->out.potential_breaks.find(bp));
+    if (!out.code.empty() && out.code.back().op == OpCode::POTENTIAL_BREAK) {
+      // line info is added in code order, so the entry is the last one
+      this->out.line_info.pop_back();
       out.code.pop_back();
     }
   }
@@ -120,9 +176,7 @@ struct GenState {
   void emit(Instruction i) { this->out.code.push_back(i); }
 
   void breakpoint() {
-    BreakPoint bp = {.file = fs.name, .line = fs.line};
-    this->out.line_info[this->getNextPos()] = bp;
-    this->out.potential_breaks[bp].push_back(this->getNextPos());
+    this->out.addLine(this->getNextPos(), fs.name, fs.line);
     this->emit(Instruction::PotentialBreak());
   }
 
@@ -133,7 +187,7 @@ struct GenState {
   FunctionGenState &getSymbols() { return this->symbols.back(); }
 
   // finish a function
-  void popSymbols(ProgramIndex addr) {
+  Prog popSymbols(ProgramIndex addr) {
     FunctionGenState fgs = this->getSymbols();
 
     for (auto e : fgs.marks) {
@@ -160,22 +214,45 @@ struct GenState {
               .stack_size = (int)fgs.register_state.size()};
 
     this->funcAddrs[fgs.name] = p;
+    if (this->symbols.size() > 1)  // not the root script
+      this->defined.push_back({fgs.name, addr, p.mi, p.argnum, p.stack_size});
 
     this->symbols.pop_back();
+    return p;
   }
 
-  void advanceLine(int new_lineno, std::string file) {
-    if (file == "__standards__")
-      return;  // standard macros for (id + int, id - int are not visible)
-    if (fs.name == file && new_lineno != fs.line) {
-      fs.line = new_lineno;
-      this->breakpoint();
+  // the program a call refers to, false if there is none
+  bool findProgram(Node *call, const std::string &name, Prog &p) {
+    if (this->plan == NULL) {
+      auto f = this->funcAddrs.find(name);
+      if (f == this->funcAddrs.end()) return false;
+      p = f->second;
+      return true;
     }
-    if (fs.name != file) {
-      fs.name = file;
-      fs.line = new_lineno;
-      this->breakpoint();
+    // where the callee is and how many registers it needs is only known
+    // once all units are generated
+    auto f = this->plan->callee.find(call);
+    if (f == this->plan->callee.end()) return false;
+    if (f->second == -1) {
+      auto e = this->plan->external.find(call);
+      if (e == this->plan->external.end()) return false;
+      const Symbol &s = (*this->imports)[e->second];
+      p = {.ind = -1,
+           .mi = -1,
+           .argnum = s.argnum,
+           .stack_size = -1,
+           .external = e->second};
+      return true;
     }
+    p = {.ind = -1,
+         .mi = f->second,
+         .argnum = this->plan->units[f->second].argnum,
+         .stack_size = -1};
+    return true;
+  }
+
+  void advanceLine(int new_lineno, std::string file) {
+    if (fs.advance(new_lineno, file)) this->breakpoint();
   }
 
   int createLabel() {
@@ -335,13 +412,25 @@ void dispatchArgs(GenState &gs, Node *c) {
   gs.getSymbols().fetchVariableRegister(std::string(c->tok));
 }
 
-// dispatch a function definition
-void dispatchProgram(GenState &gs, Node *c) {
-  // create code to jump over the function code
-  int after_label = gs.createLabel();
-  gs.emitBackpatched(Instruction::Jmp(after_label));
+// a call whose result is returned right away doesn't need to come back:
+// the callee takes over the frame and returns to the caller's caller
+// (the potential breakpoint of the END line and the RET stay for jumps to
+// the end of the program)
+void tailCall(GenState &gs, RegisterIndex ret_val) {
+  std::vector<Instruction> &code = gs.out.code;
+  ProgramIndex exec = code.size() - 1;
+  if (exec >= 0 && code[exec].op == OpCode::POTENTIAL_BREAK) exec--;
+  if (exec < 0 || code[exec].op != OpCode::EXEC) return;
+  ProgramIndex prep = exec - 1;
+  while (prep >= 0 && code[prep].op == OpCode::ARG) prep--;
+  if (prep < 0 || code[prep].op != OpCode::PREPARE_EXEC ||
+      code[prep].parameters.prepare.target != ret_val)
+    return;
+  code[exec] = Instruction::TailExec(code[exec].parameters.exec.entry);
+}
 
-  // generate program code
+// generate the code of a program, starting at the next position
+Prog genProgram(GenState &gs, Node *c) {
   Node *name_node = c->left->left, *args_node = c->left->right->left,
        *out_node = c->left->right->right, *body_node = c->right;
 
@@ -360,9 +449,28 @@ void dispatchProgram(GenState &gs, Node *c) {
 
   // generate return instruction
   RegisterIndex ret_val = gs.getSymbols().fetchVariableRegister(out_name);
+  tailCall(gs, ret_val);
   gs.emit(Instruction::Ret(ret_val));
 
-  gs.popSymbols(i);
+  return gs.popSymbols(i);
+}
+
+// dispatch a function definition
+void dispatchProgram(GenState &gs, Node *c) {
+  // create code to jump over the function code
+  int after_label = gs.createLabel();
+  gs.emitBackpatched(Instruction::Jmp(after_label));
+
+  if (gs.plan == NULL) {
+    genProgram(gs, c);
+  } else {
+    // generated into a buffer of its own, which is linked in here
+    int k = gs.plan->unit_of.at(c);
+    gs.splices.push_back(
+        {gs.getNextPos(), k, gs.errors.size(), gs.out.files.size()});
+    gs.fs = gs.plan->units[k].exit;
+    gs.loops = gs.plan->units[k].loops_exit;
+  }
   // set label addr
   gs.setLabel(after_label, gs.getNextPos());
 }
@@ -433,15 +541,13 @@ void dispatchValue(GenState &gs, Node *c, RegisterIndex tgt) {
         break;
       }
 
-      if (gs.funcAddrs.find(funcname) ==
-          gs.funcAddrs.end()) {  // is there such a function?
+      Prog p;
+      if (!gs.findProgram(c, funcname, p)) {  // is there such a function?
         gs.err(CodegenResult::Error::Type::UNKNOWN_PROGRAM_NAME,
                "unknown name " + funcname);
         return;
       }
 
-      Prog p = gs.funcAddrs[funcname];
-
       if (p.argnum != (int)arglocs.size()) {
         gs.err(CodegenResult::Error::Type::ARGSIZE_MISMATCH,
                "expected " + std::to_string(p.argnum) + " arguments but got " +
@@ -450,12 +556,17 @@ void dispatchValue(GenState &gs, Node *c, RegisterIndex tgt) {
       }
 
       // call sequence
+      ProgramIndex prepare = gs.getNextPos();
       gs.emit(Instruction::PrepareExec(p.stack_size, p.mi, tgt));
       for (size_t arg = 0; arg < arglocs.size(); arg++) {
         gs.emit(Instruction::Arg(arg, arglocs[arg]));
         gs.getSymbols().releaseTemporary(arglocs[arg]);
       }
       gs.emit(Instruction::Exec(p.ind));
+      if (p.external != -1)
+        gs.externals.push_back({prepare, gs.getNextPos() - 1, p.external});
+      else if (gs.plan != NULL)
+        gs.calls.push_back({prepare, gs.getNextPos() - 1, p.mi});
 
       break;
     }
@@ -539,7 +650,281 @@ void gen_ast(GenState &gs) {
   dispatchVoid(gs, gs.in.root);
 }
 
-CodegenResult Theo::gen(Theo::AST in) {
+/* parallel generation */
+
+struct Scout {
+  Plan plan;
+  FileState fs;
+  int loops;
+  std::map<std::string, int> programs;  // name -> last finished unit
+  std::map<std::string, int> imported;  // name -> last import
+};
+
+// the scout walks the AST in the order of the dispatch functions, but only
+// follows the positions, LOOPs and PROGRAMs
+void scoutVoid(Scout &s, Node *c);
+
+void scoutValue(Scout &s, Node *c);
+
+void scoutCallArgs(Scout &s, Node *c) {
+  if (c == NULL) return;
+
+  if (c->t == Node::Type::SPLIT) {
+    scoutCallArgs(s, c->left);
+    scoutCallArgs(s, c->right);
+    return;
+  }
+
+  scoutValue(s, c);
+}
+
+void scoutValue(Scout &s, Node *c) {
+  if (c == NULL) return;
+  s.fs.advance(c->line, c->file);
+  if (c->t != Node::Type::CALL) return;
+
+  scoutCallArgs(s, c->right);
+  auto f = s.programs.find(c->left->tok);
+  s.plan.callee[c] = f == s.programs.end() ? -1 : f->second;
+  auto i = s.imported.find(c->left->tok);
+  if (f == s.programs.end() && i != s.imported.end())
+    s.plan.external[c] = i->second;
+}
+
+int countArgs(Node *c) {
+  if (c == NULL) return 0;
+  if (c->t == Node::Type::SPLIT)
+    return countArgs(c->left) + countArgs(c->right);
+  return 1;
+}
+
+void scoutProgram(Scout &s, Node *c) {
+  Unit u = {.node = c,
+            .entry = s.fs,
+            .exit = {},
+            .loops_entry = s.loops,
+            .loops_exit = 0,
+            .argnum = countArgs(c->left->right->left)};
+  scoutVoid(s, c->right);
+  u.exit = s.fs;
+  u.loops_exit = s.loops;
+
+  int k = s.plan.units.size();
+  s.plan.units.push_back(u);
+  s.plan.unit_of[c] = k;
+  s.programs[c->left->left->tok] = k;
+}
+
+void scoutVoid(Scout &s, Node *c) {
+  if (c == NULL) return;
+  s.fs.advance(c->line, c->file);
+
+  switch (c->t) {
+    case Node::Type::SPLIT: {
+      scoutVoid(s, c->left);
+      scoutVoid(s, c->right);
+      break;
+    }
+    case Node::Type::PROGRAM: {
+      scoutProgram(s, c);
+      break;
+    }
+    case Node::Type::ASSIGN: {
+      scoutValue(s, c->right);
+      break;
+    }
+    case Node::Type::LOOP: {
+      s.loops++;
+      scoutValue(s, c->left);
+      scoutVoid(s, c->right);
+      break;
+    }
+    case Node::Type::WHILE: {
+      scoutValue(s, c->left);
+      scoutVoid(s, c->right);
+      break;
+    }
+    case Node::Type::IF: {
+      scoutValue(s, c->left->left);
+      scoutValue(s, c->left->right);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// generate unit k of the plan into a buffer of its own
+Prog gen_unit(GenState &gs, const Plan &plan, int k, Node *root,
+              const std::vector<Symbol> &imports) {
+  const Unit &u = plan.units[k];
+  gs.plan = &plan;
+  gs.imports = &imports;
+  gs.fs = u.entry;
+  gs.loops = u.loops_entry;
+  if (u.node != NULL) return genProgram(gs, u.node);
+
+  // the root script, which is called like in gen()
+  gs.emit(Instruction::PrepareExec(-1, -1, 0));
+  gs.pushSymbols("#root");
+  dispatchVoid(gs, root);
+  Prog p = gs.popSymbols(0);
+  gs.emit(Instruction::Halt());
+  return p;
+}
+
+struct Linker {
+  std::vector<GenState> &units;
+  GenState &gs;  // the linked program
+
+  // unit -> position in its buffer -> position in the linked program
+  std::vector<std::vector<ProgramIndex>> pos;
+  // unit -> index into its files -> index into the files of the program
+  std::vector<std::vector<int>> file_index;
+  std::vector<std::size_t> errors_done;  // unit -> errors passed on
+  std::vector<int> label_base;           // unit -> index of its first label
+
+  // pass on the errors and file names of unit k in the order they came up
+  void flush(int k, std::size_t errors, std::size_t files) {
+    GenState &u = this->units[k];
+    for (; this->errors_done[k] < errors; this->errors_done[k]++)
+      this->gs.errors.push_back(u.errors[this->errors_done[k]]);
+
+    while (this->file_index[k].size() < files) {
+      const std::string &name = u.out.files[this->file_index[k].size()];
+      int f = this->gs.out.fileIndex(name);
+      if (f == -1) {
+        this->gs.out.files.push_back(name);
+        f = this->gs.out.files.size() - 1;
+      }
+      this->file_index[k].push_back(f);
+    }
+  }
+
+  // append the code of unit k, with the PROGRAMs defined in it
+  void place(int k) {
+    GenState &u = this->units[k];
+    std::vector<Instruction> &code = u.out.code;
+    auto splice = u.splices.begin();
+    auto jump = u.backpatching_todo.begin();
+    auto line = u.out.line_info.begin();
+
+    this->pos[k].resize(code.size() + 1);
+    for (ProgramIndex x = 0; x <= (ProgramIndex)code.size(); x++) {
+      for (; splice != u.splices.end() && splice->at == x; splice++) {
+        this->flush(k, splice->errors, splice->files);
+        this->place(splice->unit);
+      }
+      this->pos[k][x] = this->gs.getNextPos();
+      if (x == (ProgramIndex)code.size()) break;
+
+      for (; line != u.out.line_info.end() && line->index == x; line++) {
+        this->flush(k, this->errors_done[k], line->file + 1);
+        this->gs.out.line_info.push_back(
+            {.index = this->gs.getNextPos(),
+             .file = this->file_index[k][line->file],
+             .line = line->line});
+      }
+
+      // jumps refer to the labels of the unit until backpatching
+      Instruction i = code[x];
+      if (jump != u.backpatching_todo.end() && *jump == x) {
+        if (i.op == OpCode::JMP)
+          i.parameters.jmp.offset += this->label_base[k];
+        else if (i.op == OpCode::JMPC)
+          i.parameters.jmpc.offset += this->label_base[k];
+        this->gs.backpatching_todo.push_back(this->gs.getNextPos());
+        jump++;
+      }
+      this->gs.emit(i);
+    }
+    this->flush(k, u.errors.size(), u.out.files.size());
+  }
+};
+
+// link the buffers of the units into gs, the root script is the last unit
+void link(GenState &gs, std::vector<GenState> &units,
+          std::vector<Prog> &progs) {
+  int root = units.size() - 1;
+  Linker l = {.units = units,
+              .gs = gs,
+              .pos = std::vector<std::vector<ProgramIndex>>(units.size()),
+              .file_index = std::vector<std::vector<int>>(units.size()),
+              .errors_done = std::vector<std::size_t>(units.size(), 0),
+              .label_base = {}};
+  for (auto &u : units) {
+    l.label_base.push_back(gs.labels.size());
+    gs.labels.resize(gs.labels.size() + u.labels.size());
+  }
+  l.place(root);
+
+  for (std::size_t k = 0; k < units.size(); k++) {
+    for (std::size_t label = 0; label < units[k].labels.size(); label++) {
+      int tgt = units[k].labels[label];
+      gs.labels[l.label_base[k] + label] = tgt == -1 ? -1 : l.pos[k][tgt];
+    }
+    for (auto &c : units[k].calls) {
+      // the stack map index is the callee's unit already
+      gs.out.code[l.pos[k][c.prepare]].parameters.prepare.count =
+          progs[c.unit].stack_size;
+      gs.out.code[l.pos[k][c.exec]].parameters.exec.entry = l.pos[c.unit][0];
+    }
+    for (auto &e : units[k].externals)
+      gs.externals.push_back(
+          {l.pos[k][e.prepare], l.pos[k][e.exec], e.symbol});
+    gs.out.stack_maps.push_back(units[k].out.stack_maps.back());
+    if (k != (std::size_t)root)
+      gs.defined.push_back({units[k].out.stack_maps.back().func_name,
+                            l.pos[k][0], (StackMapIndex)k, progs[k].argnum,
+                            progs[k].stack_size});
+  }
+
+  gs.out.code[0].parameters.prepare.count = progs[root].stack_size;
+  gs.out.code[0].parameters.prepare.index = root;
+  // backpatching reports errors at the end of the root script
+  gs.fs = units[root].fs;
+}
+
+CodegenResult gen_parallel(Node *root, unsigned int threads,
+                           const std::vector<Symbol> &imports) {
+  FileState start = {.name = "#root_file_context", .line = 0};
+  Scout s = {
+      .plan = {}, .fs = start, .loops = 0, .programs = {}, .imported = {}};
+  for (std::size_t i = 0; i < imports.size(); i++)
+    s.imported[imports[i].name] = i;
+  scoutVoid(s, root);
+  s.plan.units.push_back({.node = NULL,
+                          .entry = start,
+                          .exit = s.fs,
+                          .loops_entry = 0,
+                          .loops_exit = s.loops,
+                          .argnum = 0});
+
+  std::vector<GenState> units(s.plan.units.size());
+  std::vector<Prog> progs(units.size());
+  parallel_for(units.size(), threads, [&](std::size_t k) {
+    progs[k] = gen_unit(units[k], s.plan, k, root, imports);
+  });
+
+  GenState gs = {};
+  link(gs, units, progs);
+  gs.backpatch();
+  gs.out.sortLineTables();
+
+  return {.generated_correctly = gs.errors.size() == 0,
+          .errors = gs.errors,
+          .code = gs.out,
+          .file_requests = {},
+          .symbols = gs.defined,
+          .externals = gs.externals};
+}
+
+CodegenResult Theo::gen(Theo::AST in, unsigned int threads,
+                        const std::vector<Symbol> &imports) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads > 1 && in.parsed_correctly)
+    return gen_parallel(in.root, threads, imports);
+
   GenState gs = {
       .in = in,
       .out =
@@ -559,8 +944,18 @@ CodegenResult Theo::gen(Theo::AST in) {
               .name = "#root_file_context",
               .line = 0,
           },
+      .imports = &imports,
   };
 
+  // imported programs are defined before the code
+  for (std::size_t i = 0; i < imports.size(); i++) {
+    gs.funcAddrs[imports[i].name] = {.ind = -1,
+                                     .mi = -1,
+                                     .argnum = imports[i].argnum,
+                                     .stack_size = -1,
+                                     .external = (int)i};
+  }
+
   // first prep instruction, args determined later
   gs.emit(Instruction::PrepareExec(-1, -1, 0));
 
@@ -574,9 +969,12 @@ CodegenResult Theo::gen(Theo::AST in) {
 
   gs.emit(Instruction::Halt());
   gs.backpatch();
+  gs.out.sortLineTables();
 
   return {.generated_correctly = gs.errors.size() == 0,
           .errors = gs.errors,
           .code = gs.out,
-          .file_requests = {}};
+          .file_requests = {},
+          .symbols = gs.defined,
+          .externals = gs.externals};
 }
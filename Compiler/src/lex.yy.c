@@ -621,6 +621,7 @@ static const flex_int32_t yy_rule_can_match_eol[41] =
 #define YY_RESTORE_YY_MORE_OFFSET
 #define YY_DECL int yylex(Theo::Token *ret, yyscan_t yyscanner)
 #define TOK(t) {*ret = Theo::Token(t, std::string(yytext), yyextra->filename, yylineno); return 1;}
+#define YY_INPUT(buf, result, max_size) result = yyextra->source->read(buf, max_size);
 #include "Compiler/include/token.hpp"
 #include "Compiler/include/scanner_info.hpp"
 #define YY_NO_UNISTD_H 1
@@ -1,14 +1,19 @@
 #include <limits.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <ranges>
 #include <string>
+#include <thread>
 
+#include "Compiler/include/bounded_queue.hpp"
 #include "Compiler/include/macro.hpp"
+#include "Compiler/include/parallel.hpp"
 #include "Compiler/include/scan.hpp"
 
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
-
 /**
  * extract macros using a minimal recursive-descent parser
  */
@@ -18,18 +23,21 @@ using namespace Theo;
 struct ExtractionState {
   std::vector<MacroDefinition> incomplete_macros;
   std::vector<ParseError> encountered_errors;
-  unsigned int tok_pos;
-  std::vector<Theo::Token> &tokens;
+  // tokens are pulled one at a time, false once there are no more
+  std::function<bool(Theo::Token &)> pull;
+  // the token at the current position, or the last one once at_end
+  Theo::Token current;
+  Theo::Token previous;
+  bool at_end;
   std::vector<Theo::Token> output;
 };
 
 int strToInt(ExtractionState &es, std::string tok) {
   long v = std::strtol(tok.c_str(), NULL, 10);
-  int tp = MIN(es.tok_pos, es.tokens.size() - 1);
   if (v >= INT_MAX)
     es.encountered_errors.push_back({Theo::ParseError::Type::RANGE,
                                      "value '" + tok + "' is out of range",
-                                     es.tokens[tp].file, es.tokens[tp].line});
+                                     es.current.file, es.current.line});
 
   return v;
 }
@@ -40,29 +48,36 @@ int strToIntSilent(std::string tok) {
 }
 
 Theo::Token::Type lookahead(ExtractionState &es) {
-  if (es.tok_pos >= es.tokens.size()) return Theo::Token::T_EOF;
-  return es.tokens[es.tok_pos].t;
+  if (es.at_end) return Theo::Token::T_EOF;
+  return es.current.t;
+}
+
+void step(ExtractionState &es) {
+  if (es.at_end) return;
+  es.previous = es.current;
+  Theo::Token next;
+  if (es.pull(next))
+    es.current = next;
+  else
+    es.at_end = true;
 }
 
 bool match(ExtractionState &es, Theo::Token::Type expect) {
   if (lookahead(es) != expect) {
-    int tp = MIN(es.tok_pos, es.tokens.size() - 1);
     es.encountered_errors.push_back(
         {Theo::ParseError::Type::MACRO_EXTRACT_EXPECT,
          "expected token type '" + Theo::token_string(expect) +
              "' but got token of type '" + Theo::token_string(lookahead(es)) +
-             "' with content '" + es.tokens[tp].text + "'",
-         es.tokens[tp].file, es.tokens[tp].line});
-    es.tok_pos++;
+             "' with content '" + es.current.text + "'",
+         es.current.file, es.current.line});
+    step(es);
     return false;
   }
-  es.tok_pos++;
+  step(es);
   return true;
 }
 
-void copy(ExtractionState &es) {
-  es.output.push_back(es.tokens[MIN(es.tok_pos, es.tokens.size() - 1)]);
-}
+void copy(ExtractionState &es) { es.output.push_back(es.current); }
 
 void advance(ExtractionState &es) { match(es, lookahead(es)); }
 
@@ -76,15 +91,14 @@ void push_macro(ExtractionState &es) {
 }
 
 void error(ExtractionState &es, Theo::ParseError::Type t, std::string msg) {
-  es.encountered_errors.push_back(
-      {.t = t,
-       .msg = msg,
-       .file = es.tokens[MIN(es.tok_pos, es.tokens.size() - 1)].file,
-       .line = es.tokens[MIN(es.tok_pos, es.tokens.size() - 1)].line});
+  es.encountered_errors.push_back({.t = t,
+                                   .msg = msg,
+                                   .file = es.current.file,
+                                   .line = es.current.line});
 }
 
 void push_rule(ExtractionState &es) {
-  Token l = es.tokens[es.tok_pos];
+  Token l = es.current;
   MacroDefinition &md = es.incomplete_macros.back();
   md.rule.push_back(l);
 
@@ -109,44 +123,44 @@ void push_rule(ExtractionState &es) {
 }
 
 void push_replacement(ExtractionState &es) {
-  Token l = es.tokens[es.tok_pos];
+  Token l = es.current;
   MacroDefinition &md = es.incomplete_macros.back();
   md.replacement.push_back(l);
 }
 
-/* grammar */
+/* grammar, the tail recursions of the rules are loops */
 void D(ExtractionState &es);  // grammar rule for macros
 void MD(ExtractionState &es);
 void A(ExtractionState &es);
 
 void S(ExtractionState &es) {
-  switch (lookahead(es)) {
-    case Theo::Token::T_EOF: {  // S -> EOF
-      copy(es);
-      advance(es);
-      return;
-    }
-    case Theo::Token::DEFINE: {  // S -> "DEFINE" ["PRIORITY" INT] D S
-      advance(es);
-      push_macro(es);
-
-      if (lookahead(es) == Theo::Token::PRIORITY) {
+  for (;;) {
+    switch (lookahead(es)) {
+      case Theo::Token::T_EOF: {  // S -> EOF
+        copy(es);
         advance(es);
-        if (match(es, Theo::Token::INT)) {
-          es.incomplete_macros.back().priority =
-              strToInt(es, es.tokens[es.tok_pos - 1].text);
-        }
+        return;
       }
+      case Theo::Token::DEFINE: {  // S -> "DEFINE" ["PRIORITY" INT] D S
+        advance(es);
+        push_macro(es);
+
+        if (lookahead(es) == Theo::Token::PRIORITY) {
+          advance(es);
+          if (match(es, Theo::Token::INT)) {
+            es.incomplete_macros.back().priority =
+                strToInt(es, es.previous.text);
+          }
+        }
 
-      D(es);
-      S(es);
-      return;
-    }
-    default: {  // S -> ... S
-      copy(es);
-      advance(es);
-      S(es);
-      return;
+        D(es);
+        break;
+      }
+      default: {  // S -> ... S
+        copy(es);
+        advance(es);
+        break;
+      }
     }
   }
 }
@@ -184,74 +198,75 @@ void D(ExtractionState &es) {
 }
 
 void MD(ExtractionState &es) {
-  switch (lookahead(es)) {
-    case Theo::Token::T_EOF: {
-      match(es, Theo::Token::Type::AS);
-      A(es);
-      es.incomplete_macros.pop_back();
-      return;
-    }
-    case Theo::Token::Type::AS: {  // MD -> "AS" A
-      advance(es);
-      A(es);
-      return;
-    }
-    case Theo::Token::Type::DEFINE: {
-      error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
-            "second 'define' inside macro is invalid, ignoring this token");
-      advance(es);
-      MD(es);
-      return;
-    }
-    default: {
-      push_rule(es);
-      advance(es);
-      MD(es);
-      return;
+  for (;;) {
+    switch (lookahead(es)) {
+      case Theo::Token::T_EOF: {
+        match(es, Theo::Token::Type::AS);
+        A(es);
+        es.incomplete_macros.pop_back();
+        return;
+      }
+      case Theo::Token::Type::AS: {  // MD -> "AS" A
+        advance(es);
+        A(es);
+        return;
+      }
+      case Theo::Token::Type::DEFINE: {
+        error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
+              "second 'define' inside macro is invalid, ignoring this token");
+        advance(es);
+        break;
+      }
+      default: {
+        push_rule(es);
+        advance(es);
+        break;
+      }
     }
   }
 }
 
 void A(ExtractionState &es) {
-  switch (lookahead(es)) {
-    case Theo::Token::T_EOF: {
-      match(es, Theo::Token::Type::END_DEFINE);
-      return;
-    }
-    case Theo::Token::END_DEFINE: {  // A -> END_DEFINE
-      advance(es);
-      return;
-    }
-    case Theo::Token::Type::DEFINE: {
-      error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
-            "second 'define' inside macro is invalid, ignoring this token");
-      advance(es);
-      A(es);
-      return;
-    }
-    case Theo::Token::Type::AS: {
-      error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
-            "second 'as' inside macro is invalid, ignoring this token");
-      advance(es);
-      A(es);
-      return;
-    }
-    default: {
-      push_replacement(es);
-      advance(es);
-      A(es);
-      return;
+  for (;;) {
+    switch (lookahead(es)) {
+      case Theo::Token::T_EOF: {
+        match(es, Theo::Token::Type::END_DEFINE);
+        return;
+      }
+      case Theo::Token::END_DEFINE: {  // A -> END_DEFINE
+        advance(es);
+        return;
+      }
+      case Theo::Token::Type::DEFINE: {
+        error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
+              "second 'define' inside macro is invalid, ignoring this token");
+        advance(es);
+        break;
+      }
+      case Theo::Token::Type::AS: {
+        error(es, Theo::ParseError::MACRO_EXTRACT_NESTED,
+              "second 'as' inside macro is invalid, ignoring this token");
+        advance(es);
+        break;
+      }
+      default: {
+        push_replacement(es);
+        advance(es);
+        break;
+      }
     }
   }
 }
 
-Theo::MacroExtractionResult Theo::extract_macros(
-    std::vector<Theo::Token> tokens) {
+Theo::MacroExtractionResult extract(std::function<bool(Theo::Token &)> pull) {
   ExtractionState es = {.incomplete_macros = {},
                         .encountered_errors = {},
-                        .tok_pos = 0,
-                        .tokens = tokens,
+                        .pull = pull,
+                        .current = {Token::T_EOF, "EOF", "-", -1},
+                        .previous = {},
+                        .at_end = false,
                         .output = {}};
+  es.at_end = !es.pull(es.current);
   S(es);
   // test that insertion points actually exist
   for (auto &m : es.incomplete_macros) {
@@ -273,8 +288,25 @@ Theo::MacroExtractionResult Theo::extract_macros(
           .macros = es.incomplete_macros};
 }
 
+Theo::MacroExtractionResult Theo::extract_macros(
+    std::vector<Theo::Token> tokens) {
+  std::size_t pos = 0;
+  return extract([&](Theo::Token &t) {
+    if (pos >= tokens.size()) return false;
+    t = tokens[pos++];
+    return true;
+  });
+}
+
+Theo::MacroExtractionResult Theo::extract_macros(Theo::TokenStream &tokens) {
+  return extract([&](Theo::Token &t) { return tokens.next(t); });
+}
+
 /* macro application */
 
+// whether an expansion has to end early, see CompileBudget
+typedef std::function<bool()> Interruption;
+
 struct MacroDetector {
   struct Response {
     // index of first token that was matched
@@ -286,9 +318,12 @@ struct MacroDetector {
   };
 
   MacroDefinition md;
+  // position of the macro in the definitions
+  std::size_t index;
 
-  MacroDetector(MacroDefinition md) {
+  MacroDetector(MacroDefinition md, std::size_t index) {
     this->md = md;
+    this->index = index;
     /* the standard grammar symbols for macro detectors */
     SemanticGrammar<Accumulation> G = SemanticGrammar<Accumulation>();
 
@@ -410,8 +445,10 @@ struct MacroDetector {
     return true;
   }
 
-  std::optional<Response> detect(std::vector<Token> &in) {
+  std::optional<Response> detect(std::vector<Token> &in,
+                                 const Interruption &interrupted) {
     for (std::vector<Token>::size_type i = 0; i < in.size(); i++) {
+      if (interrupted()) return std::nullopt;
       auto p = parser.parse(std::ranges::subrange(in.begin() + i, in.end()));
       if (p.t == p.ACCEPT && check_constraint(p.st.split_sequence)) {
         return std::optional<Response>{
@@ -421,6 +458,10 @@ struct MacroDetector {
     return std::nullopt;
   }
 
+  std::size_t states() const { return this->parser.states(); }
+
+  std::size_t tableEntries() const { return this->parser.tableEntries(); }
+
  private:
   struct Accumulation {
     std::vector<Token> total_sequence;
@@ -433,24 +474,37 @@ struct MacroDetector {
 std::vector<MacroDetector> get_detectors(
     std::vector<Theo::MacroDefinition> &defs) {
   std::vector<MacroDetector> res = {};
-  for (auto &def : defs) {
-    auto det = MacroDetector(def);
-    res.push_back(MacroDetector(def));
-  }
+  for (std::size_t k = 0; k < defs.size(); k++)
+    res.push_back(MacroDetector(defs[k], k));
   return res;
 }
 
-std::vector<Token> get_replacement(
-    std::pair<MacroDetector, MacroDetector::Response> in, int pass) {
-  auto resp = in.second;
-  auto def = in.first.md;
+// usable detectors by priority
+typedef std::map<int, std::vector<MacroDetector>> PriorityBins;
+
+PriorityBins get_bins(std::vector<MacroDetector> &detectors,
+                      std::vector<ParseError> &errors) {
+  PriorityBins prios = {};
+  for (auto &detector : detectors) {
+    auto lerrs = detector.getErrors();
+    errors.insert(errors.end(), lerrs.begin(), lerrs.end());
+    if (lerrs.size() == 0)
+      prios[detector.md.priority].push_back(std::move(detector));
+  }
+  return prios;
+}
+
+std::vector<Token> get_replacement(const MacroDetector &detector,
+                                   const MacroDetector::Response &resp,
+                                   int pass) {
+  const MacroDefinition &def = detector.md;
 
   std::vector<Token> result = {};
   for (const Token &cand : def.replacement) {
     switch (cand.t) {
       case Theo::Token::INSERTION: {
         int ind = strToIntSilent(cand.text.substr(1, cand.text.size() - 1));
-        std::vector<Token> &to_insert =
+        const std::vector<Token> &to_insert =
             resp.matched[def.template_token_indices[ind]];
         result.insert(result.end(), to_insert.begin(), to_insert.end());
         break;
@@ -473,43 +527,35 @@ std::vector<Token> get_replacement(
   return result;
 }
 
-Theo::MacroApplicationResult Theo::apply_macros(
-    std::vector<Theo::Token> input,
-    std::vector<Theo::MacroDefinition> &definitions, unsigned int passes) {
-  std::vector<MacroDetector> detectors = get_detectors(definitions);
-  std::vector<MacroDetector> usable = {};
-  Theo::MacroApplicationResult res = {{}, {}};
-  // check for errs
-  for (auto &detector : detectors) {
-    auto lerrs = detector.getErrors();
-    res.errors.insert(res.errors.end(), lerrs.begin(), lerrs.end());
-    if (lerrs.size() == 0) usable.push_back(detector);
-  }
-  // detectors into priority bins
-  std::map<int, std::vector<MacroDetector>> prios = {};
-  std::for_each(
-      usable.begin(), usable.end(), [&prios](const MacroDetector &md) -> void {
-        if (!prios.contains(md.md.priority)) {
-          prios.insert(
-              std::make_pair(md.md.priority, std::vector<MacroDetector>{md}));
-        } else {
-          prios[md.md.priority].push_back(md);
-        }
-      });
+// the work of an expansion
+struct ExpansionCounts {
+  std::size_t passes;
+  // replaced matches by the index of the detector
+  std::map<std::size_t, std::size_t> matches;
+};
 
-  // replace p macros
+/**
+ * replace macros in input, one per pass
+ * @return whether the last pass still changed the input, false if the
+ * expansion was interrupted
+ */
+bool expand(std::vector<Token> &input, PriorityBins &prios,
+            unsigned int passes, const Interruption &interrupted,
+            ExpansionCounts &counts) {
   bool changed = false;
   for (unsigned int pass = 0; pass < passes; pass++) {
     changed = false;
+    if (interrupted()) return false;
+    counts.passes++;
 
     for (auto p = prios.rbegin(); p != prios.rend(); p++) {
-      auto detectors = p->second;
-      std::vector<std::pair<MacroDetector, MacroDetector::Response>>
+      std::vector<std::pair<MacroDetector *, MacroDetector::Response>>
           detected_macros = {};
-      for (auto &d : detectors)
-        if (auto ir = d.detect(input)) {
-          detected_macros.push_back(std::make_pair(d, *ir));
+      for (auto &d : p->second)
+        if (auto ir = d.detect(input, interrupted)) {
+          detected_macros.push_back(std::make_pair(&d, *ir));
         }
+      if (interrupted()) return false;
       // get the leftest, longest match
       auto it = std::min_element(detected_macros.begin(), detected_macros.end(),
                                  [](auto &p1, auto &p2) -> bool {
@@ -523,7 +569,9 @@ Theo::MacroApplicationResult Theo::apply_macros(
                                  });
       if (it != detected_macros.end()) {
         changed = true;
-        std::vector<Token> replacement = get_replacement(*it, pass);
+        counts.matches[it->first->index]++;
+        std::vector<Token> replacement =
+            get_replacement(*it->first, it->second, pass);
         input.erase(input.begin() + it->second.location,
                     input.begin() + it->second.location + it->second.length);
         input.insert(input.begin() + it->second.location, replacement.begin(),
@@ -534,17 +582,264 @@ Theo::MacroApplicationResult Theo::apply_macros(
     }
     if (!changed) break;
   }
+  return changed;
+}
+
+ParseError max_passes_error(unsigned int passes) {
+  return ParseError{
+      ParseError::MACRO_APPLY_REACHED_MAX_PASSES,
+      "Error: After " + std::to_string(passes) +
+          " passes, the input still changed, too many macro substitutions",
+      "-", -1};
+}
 
-  if (changed)
-    res.errors.push_back(ParseError{
-        ParseError::MACRO_APPLY_REACHED_MAX_PASSES,
-        "Error: After " + std::to_string(passes) +
-            " passes, the input still changed, too many macro substitutions",
-        "-", -1});
+Theo::MacroApplicationResult Theo::apply_macros(
+    std::vector<Theo::Token> input,
+    std::vector<Theo::MacroDefinition> &definitions, unsigned int passes,
+    const CompileBudget *budget) {
+  std::vector<MacroDetector> detectors = get_detectors(definitions);
+  Theo::MacroApplicationResult res = {{}, {}};
+  // check for errs, detectors into priority bins
+  PriorityBins prios = get_bins(detectors, res.errors);
+
+  // replace p macros
+  auto cancelled = [budget]() { return budget != NULL && budget->cancelled(); };
+  ExpansionCounts counts = {0, {}};
+  if (expand(input, prios, passes, cancelled, counts))
+    res.errors.push_back(max_passes_error(passes));
   res.transformed_sequence = input;
   return res;
 }
 
+/* pipeline */
+
+// tokens the scanner may be ahead of the extraction
+static const std::size_t scan_ahead = 4096;
+
+struct MacroPipeline::Stages {
+  struct Region {
+    // while expanding, followed by the first token of the next region, as
+    // the detectors look ahead
+    std::vector<Token> tokens;
+    bool reached_max;
+    std::atomic<bool> done;
+    ExpansionCounts counts;
+    long long ns;
+  };
+
+  std::vector<ParseError> errors;
+  std::vector<MacroDefinition> macros;
+  // see report()
+  std::map<FileName, std::size_t> tokens;
+  std::vector<CompileStats::Detector> detectors;
+  long long scan_ns, detectors_ns;
+  PriorityBins prios;
+  unsigned int passes;
+  std::deque<Region> regions;
+  // the region next() returns next
+  std::size_t next;
+  // the region the next free worker expands
+  std::atomic<std::size_t> next_expanded;
+  std::vector<std::thread> workers;
+  const CompileBudget *budget;
+  std::atomic<bool> abandoned;
+
+  bool interrupted() const {
+    return this->abandoned.load(std::memory_order_relaxed) ||
+           (this->budget != NULL && this->budget->cancelled());
+  }
+
+  void expand(std::size_t k) {
+    Region &r = this->regions[k];
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    r.reached_max = ::expand(r.tokens, this->prios, this->passes,
+                             [this]() { return this->interrupted(); },
+                             r.counts);
+    r.ns = elapsed_ns(start);
+    if (k + 1 < this->regions.size()) r.tokens.pop_back();
+    r.done.store(true, std::memory_order_release);
+    r.done.notify_all();
+  }
+
+  // get region k, expanding it if there are no workers
+  Region &await(std::size_t k) {
+    Region &r = this->regions[k];
+    if (this->workers.empty()) {
+      if (!r.done.load(std::memory_order_relaxed)) this->expand(k);
+    } else {
+      r.done.wait(false, std::memory_order_acquire);
+    }
+    return r;
+  }
+};
+
+MacroPipeline::MacroPipeline(TokenStream &tokens, unsigned int passes,
+                             unsigned int threads,
+                             const std::vector<MacroDefinition> &imported,
+                             const CompileBudget *budget) {
+  this->stages = std::make_unique<Stages>();
+  Stages &s = *this->stages;
+  s.passes = passes;
+  s.next = 0;
+  s.next_expanded = 0;
+  s.budget = budget;
+  s.abandoned = false;
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  threads = std::max(threads, 1u);
+
+  // the stream always ends with exactly one T_EOF token, a cancelled one
+  // with one of its own
+  bool scanned = false;
+  auto counted = s.tokens.end();
+  auto scan = [&](Token &t) {
+    if (scanned) return false;
+    if (s.interrupted()) {
+      t = {Token::T_EOF, "EOF", "-", -1};
+    } else {
+      if (!tokens.next(t)) return false;
+      if (counted == s.tokens.end() || counted->first != t.file)
+        counted = s.tokens.try_emplace(t.file, 0).first;
+      counted->second++;
+    }
+    scanned = t.t == Token::T_EOF;
+    return true;
+  };
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  MacroExtractionResult mer;
+  if (threads == 1) {
+    mer = extract(scan);
+  } else {
+    BoundedQueue<Token> queue(scan_ahead);
+    std::thread scanner([&]() {
+      Token t;
+      while (scan(t)) queue.push(std::move(t));
+    });
+    bool ended = false;
+    mer = extract([&](Token &t) {
+      if (ended) return false;
+      t = queue.pop();
+      ended = t.t == Token::T_EOF;
+      return true;
+    });
+    scanner.join();
+  }
+  s.scan_ns = elapsed_ns(start);
+  s.errors = mer.errors;
+  s.macros = mer.macros;
+  mer.macros.insert(mer.macros.begin(), imported.begin(), imported.end());
+
+  start = std::chrono::steady_clock::now();
+  std::vector<std::optional<MacroDetector>> built(mer.macros.size());
+  std::vector<long long> built_ns(built.size(), 0);
+  parallel_for(built.size(), threads, [&](std::size_t k) {
+    std::chrono::steady_clock::time_point built_start =
+        std::chrono::steady_clock::now();
+    if (!s.interrupted()) built[k].emplace(mer.macros[k], k);
+    built_ns[k] = elapsed_ns(built_start);
+  });
+  s.detectors_ns = elapsed_ns(start);
+
+  std::vector<MacroDetector> detectors = {};
+  for (std::size_t k = 0; k < built.size(); k++) {
+    const std::vector<Token> &rule = mer.macros[k].rule;
+    CompileStats::Detector stats = {
+        .rule = "",
+        .file = rule.empty() ? "-" : rule[0].file,
+        .line = rule.empty() ? -1 : rule[0].line,
+        .states = built[k] ? built[k]->states() : 0,
+        .table_entries = built[k] ? built[k]->tableEntries() : 0,
+        .ns = built_ns[k],
+        .matches = 0};
+    for (auto &t : rule) stats.rule += (stats.rule.empty() ? "" : " ") + t.text;
+    s.detectors.push_back(stats);
+    if (built[k]) detectors.push_back(std::move(*built[k]));
+  }
+  s.prios = get_bins(detectors, s.errors);
+
+  // macros containing PROGRAM tokens could match across regions or create
+  // new ones
+  bool separable = true;
+  for (auto &m : mer.macros) {
+    for (auto *seq : {&m.rule, &m.replacement}) {
+      for (auto &t : *seq) separable &= t.t != Token::PROGRAM;
+    }
+  }
+  for (Token &t : mer.tokens) {
+    if (s.regions.empty() || (separable && t.t == Token::PROGRAM)) {
+      if (!s.regions.empty()) s.regions.back().tokens.push_back(t);
+      Stages::Region &r = s.regions.emplace_back();
+      r.reached_max = false;
+      r.done = false;
+      r.counts = {0, {}};
+      r.ns = 0;
+    }
+    s.regions.back().tokens.push_back(std::move(t));
+  }
+
+  if (threads == 1) return;
+  std::size_t count = std::min<std::size_t>(threads, s.regions.size());
+  for (std::size_t w = 0; w < count; w++) {
+    s.workers.emplace_back([&s]() {
+      for (std::size_t k = s.next_expanded++; k < s.regions.size();
+           k = s.next_expanded++)
+        s.expand(k);
+    });
+  }
+}
+
+MacroPipeline::~MacroPipeline() {
+  for (auto &w : this->stages->workers) w.join();
+}
+
+bool MacroPipeline::next(std::vector<Token> &region) {
+  Stages &s = *this->stages;
+  if (s.next >= s.regions.size()) return false;
+  region = std::move(s.await(s.next++).tokens);
+  return true;
+}
+
+void MacroPipeline::abandon() {
+  this->stages->abandoned.store(true, std::memory_order_relaxed);
+}
+
+const std::vector<MacroDefinition> &MacroPipeline::getMacros() {
+  return this->stages->macros;
+}
+
+std::vector<ParseError> MacroPipeline::getErrors() {
+  Stages &s = *this->stages;
+  std::vector<ParseError> res = s.errors;
+  bool reached_max = false;
+  for (std::size_t k = 0; k < s.regions.size(); k++)
+    reached_max |= s.await(k).reached_max;
+  if (reached_max) res.push_back(max_passes_error(s.passes));
+  return res;
+}
+
+void MacroPipeline::report(CompileStats &stats) {
+  Stages &s = *this->stages;
+  for (auto &[file, n] : s.tokens) stats.tokens[file] += n;
+  stats.macros += s.macros.size();
+  stats.ns.scan += s.scan_ns;
+  stats.ns.detectors += s.detectors_ns;
+
+  std::vector<CompileStats::Detector> detectors = s.detectors;
+  for (std::size_t k = 0; k < s.regions.size(); k++) {
+    Stages::Region &r = s.await(k);
+    stats.ns.expansion += r.ns;
+    stats.passes += r.counts.passes;
+    for (auto &[d, n] : r.counts.matches) {
+      detectors[d].matches += n;
+      stats.matches += n;
+    }
+  }
+  stats.detectors.insert(stats.detectors.end(), detectors.begin(),
+                         detectors.end());
+}
+
 std::string Theo::recover_from_tokens(const std::vector<Token> &tok) {
   std::string out = "";
 
@@ -0,0 +1,371 @@
+#include "Compiler/include/module.hpp"
+
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+#include "Compiler/include/parse.hpp"
+
+/**
+ * Module files, stored by a ModuleCache for the module of file f as
+ *   <hash of f>.bc   the code, see Program::save
+ *   <hash of f>.mod  everything else, as text: "THEOMOD <version>", the file
+ *                    name, the sources (name, hash), the symbols (name,
+ *                    entry, map, argnum, stack_size) and the macros
+ *                    (priority, rule, content constraint indices, template
+ *                    indices, replacement)
+ * numbers are written in decimal, strings as their length and their bytes,
+ * lists as their length and their elements, tokens as type, text, file and
+ * line; the version changes whenever the compiler generates different code
+ */
+
+using namespace Theo;
+
+static const std::string module_magic = "THEOMOD";
+static const long long module_version = 1;
+
+// FNV-1a
+static const std::uint64_t hash_basis = 14695981039346656037ull;
+static const std::uint64_t hash_prime = 1099511628211ull;
+
+static std::uint64_t hash(std::uint64_t h, const char *buf, std::size_t n) {
+  for (std::size_t i = 0; i < n; i++) {
+    h ^= (unsigned char)buf[i];
+    h *= hash_prime;
+  }
+  return h;
+}
+
+// hashes a file while the scanner reads it
+class HashingSource : public Source {
+ public:
+  HashingSource(std::unique_ptr<Source> source, std::uint64_t *h) {
+    this->source = std::move(source);
+    this->h = h;
+    *this->h = hash_basis;
+  }
+
+  std::size_t read(char *buf, std::size_t max_size) override {
+    std::size_t n = this->source->read(buf, max_size);
+    *this->h = hash(*this->h, buf, n);
+    return n;
+  }
+
+ private:
+  std::unique_ptr<Source> source;
+  std::uint64_t *h;
+};
+
+// the first node of the root script that isn't a PROGRAM, NULL if none
+static Node *instruction(Node *c) {
+  if (c == NULL || c->t == Node::Type::PROGRAM) return NULL;
+  if (c->t != Node::Type::SPLIT) return c;
+  Node *left = instruction(c->left);
+  return left != NULL ? left : instruction(c->right);
+}
+
+ModuleResult Theo::compile_module(TokenStream::Resolver resolve, FileName file,
+                                  unsigned int threads,
+                                  const CompileBudget *budget) {
+  // references to the hashes stay valid while the deque grows
+  std::deque<std::pair<FileName, std::uint64_t>> read = {};
+  auto hashing = [&](const FileName &name) -> std::unique_ptr<Source> {
+    std::unique_ptr<Source> source = resolve(name);
+    if (!source) return source;
+    read.push_back({name, 0});
+    return std::make_unique<HashingSource>(std::move(source),
+                                           &read.back().second);
+  };
+
+  ParseResult pr = parse_module(hashing, file, threads, budget);
+  Node *outside = pr.a.parsed_correctly ? instruction(pr.a.root) : NULL;
+  CodegenResult cr = gen(pr.a, threads);
+  pr.a.clear();
+
+  ModuleResult res = {.compiled_correctly = false,
+                      .errors = cr.errors,
+                      .file_requests = pr.missing_files,
+                      .module = {}};
+  if (outside != NULL) {
+    res.errors.push_back({CodegenResult::Error::Type::NOT_A_MODULE,
+                          "module '" + file +
+                              "' may only define PROGRAMs and macros",
+                          outside->file, outside->line});
+  }
+  res.compiled_correctly = res.errors.empty();
+  if (!res.compiled_correctly) return res;
+
+  Module &m = res.module;
+  m.file = file;
+  m.code = cr.code;
+
+  // a later definition replaces an earlier one of the same name
+  std::map<std::string, std::size_t> last = {};
+  for (std::size_t k = 0; k < cr.symbols.size(); k++)
+    last[cr.symbols[k].name] = k;
+  for (std::size_t k = 0; k < cr.symbols.size(); k++) {
+    if (last[cr.symbols[k].name] == k) m.symbols.push_back(cr.symbols[k]);
+  }
+
+  // the standard macros are defined by every program anyway
+  for (auto &md : pr.macros) {
+    if (md.rule.empty() || md.rule[0].file != "__standards__")
+      m.macros.push_back(md);
+  }
+
+  for (auto &source : read) {
+    bool known = false;
+    for (auto &s : m.sources) known |= s.first == source.first;
+    if (!known) m.sources.push_back(source);
+  }
+  return res;
+}
+
+void Theo::link(CodegenResult &unit, const std::vector<Module> &modules) {
+  Program &p = unit.code;
+  std::vector<Symbol> imports = {};
+
+  for (const Module &m : modules) {
+    // the root script of the module is left out, its first instruction
+    // would be at position 0
+    ProgramIndex base = p.code.size() - 1;
+    StackMapIndex map_base = p.stack_maps.size();
+
+    std::span<const Instruction> code = m.code.instructions();
+    for (std::size_t x = 1; x < code.size(); x++) {
+      Instruction i = code[x];
+      if (i.op == OpCode::EXEC || i.op == OpCode::TAIL_EXEC)
+        i.parameters.exec.entry += base;
+      else if (i.op == OpCode::PREPARE_EXEC)
+        i.parameters.prepare.index += map_base;
+      p.code.push_back(i);
+    }
+    // the stack map of the root script is the last one
+    p.stack_maps.insert(p.stack_maps.end(), m.code.stack_maps.begin(),
+                        m.code.stack_maps.end() - 1);
+    for (auto &e : m.code.line_info)
+      p.addLine(e.index + base, m.code.files[e.file], e.line);
+
+    for (Symbol s : m.symbols) {
+      s.entry += base;
+      s.map += map_base;
+      imports.push_back(s);
+    }
+  }
+
+  for (auto &e : unit.externals) {
+    const Symbol &s = imports[e.symbol];
+    p.code[e.prepare].parameters.prepare.count = s.stack_size;
+    p.code[e.prepare].parameters.prepare.index = s.map;
+    p.code[e.exec].parameters.exec.entry = s.entry;
+  }
+  unit.externals.clear();
+  p.sortLineTables();
+}
+
+/* module files */
+
+static void put(std::ostream &o, long long v) { o << v << '\n'; }
+
+static void put(std::ostream &o, const std::string &s) {
+  o << s.size() << ' ' << s << '\n';
+}
+
+static void put(std::ostream &o, const std::vector<Token> &toks) {
+  put(o, toks.size());
+  for (auto &t : toks) {
+    put(o, (long long)t.t);
+    put(o, t.text);
+    put(o, t.file);
+    put(o, t.line);
+  }
+}
+
+static void put(std::ostream &o, const std::vector<unsigned int> &indices) {
+  put(o, indices.size());
+  for (auto i : indices) put(o, i);
+}
+
+static bool save(const Module &m, const std::string &path) {
+  std::ofstream o(path + ".mod", std::ios::out | std::ios::binary);
+  if (!o.is_open()) return false;
+  o << module_magic << ' ';
+  put(o, module_version);
+  put(o, m.file);
+  put(o, m.sources.size());
+  for (auto &s : m.sources) {
+    put(o, s.first);
+    o << s.second << '\n';
+  }
+  put(o, m.symbols.size());
+  for (auto &s : m.symbols) {
+    put(o, s.name);
+    for (long long v : {s.entry, s.map, s.argnum, s.stack_size}) put(o, v);
+  }
+  put(o, m.macros.size());
+  for (auto &md : m.macros) {
+    put(o, md.priority);
+    put(o, md.rule);
+    put(o, md.content_constraint_token_indices);
+    put(o, md.template_token_indices);
+    put(o, md.replacement);
+  }
+  Program code = m.code;
+  return o.good() && code.save(path + ".bc");
+}
+
+struct ModuleReader {
+  std::istream &i;
+  bool ok = true;
+
+  long long num() {
+    long long v = 0;
+    if (!(this->i >> v)) this->ok = false;
+    return v;
+  }
+
+  std::string str() {
+    long long n = this->num();
+    if (!this->ok || n < 0 || n > (1 << 24) || this->i.get() != ' ') {
+      this->ok = false;
+      return "";
+    }
+    std::string s(n, '\0');
+    this->i.read(s.data(), n);
+    this->ok &= this->i.gcount() == n;
+    return s;
+  }
+
+  // the length of a list, false if it can't be one
+  bool count(long long &n) {
+    n = this->num();
+    this->ok &= n >= 0;
+    return this->ok;
+  }
+
+  std::vector<Token> tokens() {
+    std::vector<Token> res = {};
+    long long n;
+    for (this->count(n); this->ok && n > 0; n--) {
+      Token t;
+      t.t = (Token::Type)this->num();
+      t.text = this->str();
+      t.file = this->str();
+      t.line = this->num();
+      res.push_back(t);
+    }
+    return res;
+  }
+
+  std::vector<unsigned int> indices() {
+    std::vector<unsigned int> res = {};
+    long long n;
+    for (this->count(n); this->ok && n > 0; n--) res.push_back(this->num());
+    return res;
+  }
+};
+
+static std::optional<Module> load(const std::string &path) {
+  std::ifstream f(path + ".mod", std::ios::in | std::ios::binary);
+  if (!f.is_open()) return std::nullopt;
+  std::string magic;
+  f >> magic;
+  ModuleReader r = {.i = f};
+  if (magic != module_magic || r.num() != module_version) return std::nullopt;
+
+  Module m = {};
+  m.file = r.str();
+  long long n;
+  for (r.count(n); r.ok && n > 0; n--) {
+    std::string name = r.str();
+    std::uint64_t h = 0;
+    r.ok &= (bool)(f >> h);
+    m.sources.push_back({name, h});
+  }
+  for (r.count(n); r.ok && n > 0; n--) {
+    Symbol s;
+    s.name = r.str();
+    s.entry = r.num();
+    s.map = r.num();
+    s.argnum = r.num();
+    s.stack_size = r.num();
+    m.symbols.push_back(s);
+  }
+  for (r.count(n); r.ok && n > 0; n--) {
+    MacroDefinition md;
+    md.priority = r.num();
+    md.rule = r.tokens();
+    md.content_constraint_token_indices = r.indices();
+    md.template_token_indices = r.indices();
+    md.replacement = r.tokens();
+    m.macros.push_back(md);
+  }
+  if (!r.ok) return std::nullopt;
+
+  BytecodeLoadResult lr = Program::load(path + ".bc");
+  if (!lr.loaded_correctly) return std::nullopt;
+  m.code = lr.program;
+  return m;
+}
+
+// whether the sources of a module still have the content it was compiled from
+static bool unchanged(const Module &m, TokenStream::Resolver &resolve) {
+  std::vector<char> buf(1 << 16);
+  for (auto &[name, h] : m.sources) {
+    std::unique_ptr<Source> source = resolve(name);
+    if (!source) return false;
+    std::uint64_t current = hash_basis;
+    for (std::size_t n; (n = source->read(buf.data(), buf.size())) > 0;)
+      current = hash(current, buf.data(), n);
+    if (current != h) return false;
+  }
+  return !m.sources.empty();
+}
+
+/* cache */
+
+ModuleCache::ModuleCache(std::string directory) {
+  this->directory = directory;
+  this->modules = {};
+  this->compiled = 0;
+  std::error_code ec;
+  if (directory != "") std::filesystem::create_directories(directory, ec);
+}
+
+std::string ModuleCache::path(const FileName &file) {
+  std::stringstream s;
+  s << std::hex << hash(hash_basis, file.data(), file.size());
+  return (std::filesystem::path(this->directory) / s.str()).string();
+}
+
+ModuleResult ModuleCache::get(TokenStream::Resolver resolve,
+                              const FileName &file, unsigned int threads,
+                              const CompileBudget *budget) {
+  auto cached = this->modules.find(file);
+  if (cached == this->modules.end() && this->directory != "") {
+    std::optional<Module> stored = load(this->path(file));
+    if (stored && stored->file == file)
+      cached = this->modules.emplace(file, *stored).first;
+  }
+  if (cached != this->modules.end() && unchanged(cached->second, resolve)) {
+    return {.compiled_correctly = true,
+            .errors = {},
+            .file_requests = {},
+            .module = cached->second};
+  }
+
+  ModuleResult res = compile_module(resolve, file, threads, budget);
+  this->compiled++;
+  if (!res.compiled_correctly) {
+    this->modules.erase(file);
+    return res;
+  }
+  this->modules[file] = res.module;
+  if (this->directory != "") save(res.module, this->path(file));
+  return res;
+}
+
+int ModuleCache::compilations() { return this->compiled; }
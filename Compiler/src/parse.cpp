@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <chrono>
 
 #include "Compiler/include/lexer.hpp"
 #include "Compiler/include/macro.hpp"
@@ -7,11 +8,64 @@
 
 using namespace Theo;
 
+// position in the expanded tokens, which are received region by region
+// (the parser never moves beyond the T_EOF token at their end)
+struct TokenCursor {
+  MacroPipeline &pipeline;
+  std::vector<Token> region;
+  std::size_t i;
+  bool stopped;
+  // time spent waiting for the regions
+  long long waited;
+
+  const Token *operator->() const { return &this->region[this->i]; }
+
+  // skip to the next region at the end of the current one
+  void fill() {
+    if (this->stopped || this->i < this->region.size()) return;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    while (this->i >= this->region.size() && this->pipeline.next(this->region))
+      this->i = 0;
+    this->waited += elapsed_ns(start);
+  }
+
+  // end the tokens at the current position, the rest isn't expanded
+  void stop() {
+    Token eof = {Token::T_EOF, "EOF", this->region[this->i].file,
+                 this->region[this->i].line};
+    this->region = {eof};
+    this->i = 0;
+    this->stopped = true;
+    this->pipeline.abandon();
+  }
+
+  void operator++(int) {
+    this->i++;
+    this->fill();
+  }
+};
+
 struct ParseState {
   AST &a;
-  std::vector<Token>::iterator &pos;
-
-  Theo::Token::Type lookahead() { return pos->t; }
+  TokenCursor &pos;
+  const CompileBudget *budget;
+  // the number of errors before the parse was stopped
+  std::size_t reported;
+  // whether the root script may be empty, see parse_module
+  bool module;
+
+  // once the budget is used up, the input seems to end here
+  Theo::Token::Type lookahead() {
+    if (!pos.stopped && budget != NULL) {
+      std::size_t max = budget->maxErrors();
+      if (budget->cancelled() || (max > 0 && a.errors.size() >= max)) {
+        reported = max > 0 ? std::min(a.errors.size(), max) : a.errors.size();
+        pos.stop();
+      }
+    }
+    return pos->t;
+  }
 
   void match(Theo::Token::Type t) {
     if (lookahead() != t) {
@@ -38,6 +92,7 @@ struct ParseState {
  * according to the following LL(1) grammar:
  * S -> PROGRAM id PORTS do P end S
  * S -> P
+ * S ->                  (modules only, after a PROGRAM)
  * PORTS -> in ARGS OPORTS
  * PORTS ->
  * OPORTS -> out id
@@ -82,7 +137,8 @@ Theo::Node *S(ParseState &ps) {
       ps.match(Token::DO);
       Node *body = P(ps);
       Node *end = ps.matchmk(Token::END, Node::Type::NAME, NULL, NULL);
-      Node *more = S(ps);
+      Node *more =
+          ps.module && ps.lookahead() == Token::T_EOF ? NULL : S(ps);
 
       return ps.a.mk(
           Node::Type::SPLIT, name->line, name->file, "",
@@ -325,18 +381,31 @@ Theo::Node *MVARGS(ParseState &ps) {
   return ps.a.mk(Node::Type::SPLIT, v->line, v->file, "", v, m);
 }
 
-ParseResult Theo::parse(std::map<FileName, FileContent> files, FileName main) {
-  std::string standard_macros =
-      "\
+static const std::string standard_macros =
+    "\
 DEFINE PRIO 1000000 <ID> + <INT> AS RUN __INC__ WITH $0, $1 END END DEFINE\n\
 DEFINE PRIO 1000000 <ID> - <INT> AS RUN __DEC__ WITH $0, $1 END END DEFINE\n\
   ";
 
-  files.insert(std::make_pair("__standards__", standard_macros));
-  std::string incl_phrase = "include \"__standards__\"";
-  if (files.contains(main))
-    files[main].insert(files[main].begin(), incl_phrase.begin(),
-                       incl_phrase.end());
+ParseResult Theo::parse(std::map<FileName, FileContent> files, FileName main,
+                        unsigned int threads, const CompileBudget *budget,
+                        CompileStats *stats) {
+  return parse(string_sources(files), main, threads, {}, budget, stats);
+}
+
+// parse(), optionally of a module
+static ParseResult parse_files(TokenStream::Resolver resolve, FileName main,
+                               unsigned int threads,
+                               const std::vector<MacroDefinition> &imported,
+                               const CompileBudget *budget,
+                               CompileStats *stats, bool module) {
+  // the standard macros are included first, unless the files define them
+  auto with_standards = [resolve](const FileName &name) {
+    std::unique_ptr<Source> source = resolve(name);
+    if (!source && name == "__standards__")
+      source = std::make_unique<StringSource>(standard_macros);
+    return source;
+  };
 
   AST a;
   a.parsed_correctly = false;
@@ -344,29 +413,32 @@ DEFINE PRIO 1000000 <ID> - <INT> AS RUN __DEC__ WITH $0, $1 END END DEFINE\n\
   a.all_allocated_nodes = {};
   a.errors = {};
 
-  Theo::ScanResult sr = Theo::scan(files, main);
+  // the macros are extracted and applied by the stages of a pipeline, the
+  // parser works on the regions it has expanded while it expands the next
+  Theo::TokenStream ts(with_standards, main);
+  if (ts.getErrors().empty()) ts.include("__standards__");
+  Theo::MacroPipeline pipeline(ts, THEO_MACRO_PASSES, threads, imported,
+                               budget);
+  std::vector<ParseError> scan_errors = ts.getErrors();
 
   std::vector<std::string> file_requests;
 
-  std::for_each(sr.errors.begin(), sr.errors.end(),
+  std::for_each(scan_errors.begin(), scan_errors.end(),
                 [&file_requests](const ParseError &pe) -> void {
                   if (pe.t == ParseError::FILE_NOT_FOUND ||
                       pe.t == ParseError::MAIN_FILE_NOT_FOUND)
                     file_requests.push_back(pe.file_request);
                 });
 
-  Theo::MacroExtractionResult mer = Theo::extract_macros(sr.toks);
-
-  Theo::MacroApplicationResult mar =
-      Theo::apply_macros(mer.tokens, mer.macros, THEO_MACRO_PASSES);
-
-  std::vector<Token>::iterator it = mar.transformed_sequence.begin();
-  ParseState ps = {a, it};
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  TokenCursor it = {pipeline, {}, 0, false, 0};
+  it.fill();
+  ParseState ps = {a, it, budget, 0, module};
 
   a.root = S(ps);
 
-  while (ps.pos < mar.transformed_sequence.end() &&
-         ps.lookahead() != Token::T_EOF) {
+  while (ps.lookahead() != Token::T_EOF) {
     ps.a.errors.push_back(
         {ps.pos->line, ps.pos->file,
          "expected EOF, but got excess input: '" + ps.pos->text + "'"});
@@ -375,14 +447,42 @@ DEFINE PRIO 1000000 <ID> - <INT> AS RUN __DEC__ WITH $0, $1 END END DEFINE\n\
     S(ps);
   }
 
-  std::vector<std::vector<ParseError>> errs = {sr.errors, mer.errors,
-                                               mar.errors};
+  // the errors of unwinding the parse after it was stopped are left out
+  if (it.stopped) a.errors.resize(ps.reported);
+  if (stats != NULL) {
+    stats->ns.parse += elapsed_ns(start) - it.waited;
+    stats->nodes += a.all_allocated_nodes.size();
+    pipeline.report(*stats);
+  }
+
+  std::vector<std::vector<ParseError>> errs = {scan_errors,
+                                               pipeline.getErrors()};
 
   for (auto &err : errs)
     for (auto &e : err) {
       a.errors.push_back({e.line, e.file, e.msg});
     }
+  if (it.stopped) {
+    a.errors.push_back({it->line, it->file,
+                        budget->cancelled()
+                            ? "compilation was cancelled"
+                            : "too many errors, the rest of the input "
+                              "wasn't parsed"});
+  }
   if (a.errors.size() == 0) a.parsed_correctly = true;
 
-  return {file_requests, a};
+  return {file_requests, a, pipeline.getMacros()};
+}
+
+ParseResult Theo::parse(TokenStream::Resolver resolve, FileName main,
+                        unsigned int threads,
+                        const std::vector<MacroDefinition> &imported,
+                        const CompileBudget *budget, CompileStats *stats) {
+  return parse_files(resolve, main, threads, imported, budget, stats, false);
+}
+
+ParseResult Theo::parse_module(TokenStream::Resolver resolve, FileName file,
+                               unsigned int threads,
+                               const CompileBudget *budget) {
+  return parse_files(resolve, file, threads, {}, budget, NULL, true);
 }
@@ -1,103 +1,155 @@
 #include "Compiler/include/lexer.hpp"
 #include "Compiler/include/scan.hpp"
 
+#include <filesystem>
+
 using namespace Theo;
 
-struct Scanner {
+struct TokenStream::Scanner {
   yyscan_t s;
   YY_BUFFER_STATE buf;
   FileName f;
   ScannerInfo *si;
+  std::unique_ptr<Source> source;
+
+  void cleanup() {
+    yy_delete_buffer(this->buf, this->s);
+    yylex_destroy(this->s);
+    delete this->si;
+  }
 };
 
-#include <iostream>
-Scanner create_scanner(FileContent &in, FileName key) {
+TokenStream::TokenStream(Resolver resolve, FileName main) {
+  this->resolve = resolve;
+  this->main = main;
+  this->errors = {};
+  this->last = Token(Token::T_EOF, "EOF", main, -1);
+  this->ended = false;
+
+  if (!this->open(main)) {
+    this->errors.push_back({ParseError::Type::MAIN_FILE_NOT_FOUND,
+                            "main file '" + main + "' not found", "-", -1,
+                            main});
+  }
+}
+
+TokenStream::~TokenStream() {
+  for (Scanner &s : this->scanners) s.cleanup();
+}
+
+bool TokenStream::open(const FileName &name) {
+  std::unique_ptr<Source> source = this->resolve(name);
+  if (!source) return false;
+
+  // the buffer is filled from the source through YY_INPUT (see lexer.l)
   Scanner s;
-  s.si = new ScannerInfo{key};
+  s.source = std::move(source);
+  s.si = new ScannerInfo{name, s.source.get()};
   yylex_init(&s.s);
-  const char *str = in.c_str();
-  s.buf = yy_scan_string(str, s.s);
-  yyset_lineno(1, s.s);
   yyset_extra(s.si, s.s);
-  s.f = key;
-  return s;
-}
-
-void cleanup_scanner(Scanner &s) {
-  yy_delete_buffer(s.buf, s.s);
-  yylex_destroy(s.s);
-  delete s.si;
+  s.buf = yy_create_buffer(NULL, YY_BUF_SIZE, s.s);
+  yy_switch_to_buffer(s.buf, s.s);
+  yyset_lineno(1, s.s);
+  s.f = name;
+  this->scanners.push_back(std::move(s));
+  return true;
 }
 
-bool exists_scanner(std::vector<Scanner> &ss, FileName key) {
-  for (Scanner &s : ss) {
-    if (s.f == key) return true;
+void TokenStream::includeAt(FileName name, FileName from, int line) {
+  for (Scanner &s : this->scanners) {
+    if (s.f == name) {
+      this->errors.push_back({ParseError::Type::RECURSIVE_INCLUDE,
+                              "file '" + name + "' is included recursively",
+                              from, line});
+      return;
+    }
+  }
+  if (!this->open(name)) {
+    this->errors.push_back({ParseError::Type::FILE_NOT_FOUND,
+                            "file '" + name + "' not found", from, line,
+                            name});
   }
-  return false;
 }
 
-ScanResult Theo::scan(std::map<FileName, FileContent> files, FileName main) {
-  std::vector<ParseError> errors = {};
-  std::vector<Token> res = {};
+void TokenStream::include(const FileName &name) {
+  FileName from =
+      this->scanners.empty() ? this->last.file : this->scanners.back().f;
+  this->includeAt(name, from, this->last.line);
+}
 
-  std::vector<Scanner> lex_stack = {};
+bool TokenStream::next(Token &t) {
+  if (this->ended) return false;
 
-  if (files.contains(main))
-    lex_stack.push_back(create_scanner(files[main], main));
-  else {
-    errors.push_back({ParseError::Type::MAIN_FILE_NOT_FOUND,
-                      "main file '" + main + "' not found", "-", -1, main});
-  }
-  while (!lex_stack.empty()) {
-    Scanner &s = lex_stack.back();
+  while (!this->scanners.empty()) {
+    Scanner &s = this->scanners.back();
 
-    Token t;
     int d = yylex(&t, s.s);
 
     // EOF for this file
     if (d == 0) {
-      cleanup_scanner(s);
-      lex_stack.pop_back();
+      s.cleanup();
+      this->scanners.pop_back();
       continue;
     }
 
     if (t.t == Token::Type::UNKNOWN) {
-      errors.push_back({ParseError::Type::UNKNOWN_TOKEN,
-                        "unkown token '" + t.text + "'", s.f, t.line});
+      this->errors.push_back({ParseError::Type::UNKNOWN_TOKEN,
+                              "unkown token '" + t.text + "'", s.f, t.line});
     }
 
     if (t.t == Token::Type::INCLUDE) {
       d = yylex(&t, s.s);
       if (d == 0 || t.t != Token::Type::FNAME) {
-        errors.push_back({ParseError::Type::EXPECTED_FILENAME,
-                          "expected filename after include", s.f, t.line});
+        this->errors.push_back({ParseError::Type::EXPECTED_FILENAME,
+                                "expected filename after include", s.f,
+                                t.line});
         continue;
       }
 
       FileName nfn = t.text;
       nfn = nfn.substr(1, nfn.size() - 2);
-
-      if (!files.contains(nfn)) {
-        errors.push_back({ParseError::Type::FILE_NOT_FOUND,
-                          "file '" + nfn + "' not found", s.f, t.line, nfn});
-        continue;
-      }
-
-      if (exists_scanner(lex_stack, nfn)) {
-        errors.push_back({ParseError::Type::RECURSIVE_INCLUDE,
-                          "file '" + nfn + "' is included recursively", s.f,
-                          t.line});
-        continue;
-      }
-
-      lex_stack.push_back(create_scanner(files[nfn], nfn));
+      this->includeAt(nfn, s.f, t.line);
       continue;
     }
-    res.push_back(t);
+
+    this->last = t;
+    return true;
   }
-  res.push_back(
-      Theo::Token{Theo::Token::T_EOF, "EOF", res.back().file, res.back().line});
-  return {res, errors};
+
+  t = Token(Token::T_EOF, "EOF", this->last.file, this->last.line);
+  this->ended = true;
+  return true;
+}
+
+const std::vector<ParseError> &TokenStream::getErrors() {
+  return this->errors;
+}
+
+TokenStream::Resolver Theo::string_sources(
+    const std::map<FileName, FileContent> &files) {
+  return [&files](const FileName &name) -> std::unique_ptr<Source> {
+    auto it = files.find(name);
+    if (it == files.end()) return nullptr;
+    return std::make_unique<StringSource>(it->second);
+  };
+}
+
+TokenStream::Resolver Theo::file_sources(const std::string &directory) {
+  return [directory](const FileName &name) -> std::unique_ptr<Source> {
+    std::filesystem::path p(name);
+    if (p.is_relative() && directory != "") p = directory / p;
+    auto f = std::make_unique<FileSource>(p.string());
+    if (!f->isOpen()) return nullptr;
+    return f;
+  };
+}
+
+ScanResult Theo::scan(std::map<FileName, FileContent> files, FileName main) {
+  TokenStream ts(string_sources(files), main);
+  std::vector<Token> res = {};
+  Token t;
+  while (ts.next(t)) res.push_back(t);
+  return {res, ts.getErrors()};
 }
 
 std::string token_map[] = {"end of file",
@@ -0,0 +1,29 @@
+#include "Compiler/include/source.hpp"
+
+#include <algorithm>
+
+using namespace Theo;
+
+StringSource::StringSource(std::string_view content) {
+  this->content = content;
+  this->pos = 0;
+}
+
+std::size_t StringSource::read(char *buf, std::size_t max_size) {
+  std::size_t n = std::min(max_size, this->content.size() - this->pos);
+  this->content.copy(buf, n, this->pos);
+  this->pos += n;
+  return n;
+}
+
+FileSource::FileSource(const std::string &path) {
+  this->f.open(path, std::ios::in | std::ios::binary);
+}
+
+bool FileSource::isOpen() { return this->f.is_open(); }
+
+std::size_t FileSource::read(char *buf, std::size_t max_size) {
+  if (!this->f.is_open()) return 0;
+  this->f.read(buf, max_size);
+  return this->f.gcount();
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "Compiler/include/compiler.hpp"
+
+int main() {
+  bool err = false;
+
+  // the errors after the maximum aren't searched for
+  std::string broken = "";
+  for (int k = 0; k < 10; k++) broken += "x := ;\nLOOP DO y := 1 END;\n";
+  std::map<Theo::FileName, Theo::FileContent> files = {{"main.theo", broken}};
+  Theo::CodegenResult all = Theo::compile(files, "main.theo");
+  Theo::CompileBudget three(3);
+  Theo::CodegenResult first = Theo::compile(files, "main.theo", 1, &three);
+  if (all.errors.size() <= 4 || first.errors.size() != 4 ||
+      first.errors.back().message.find("too many errors") ==
+          std::string::npos) {
+    std::cerr << "errors weren't cut off after the maximum" << std::endl;
+    err = true;
+  }
+  for (int k = 0; k < 3 && first.errors.size() == 4; k++) {
+    if (first.errors[k].message != all.errors[k].message ||
+        first.errors[k].line != all.errors[k].line) {
+      std::cerr << "the first errors differ" << std::endl;
+      err = true;
+    }
+  }
+
+  // a budget that isn't used up doesn't change the result
+  Theo::CompileBudget unused(3);
+  std::string valid =
+      "PROGRAM p IN x1 DO x0 := x1 + 1 END\n"
+      "y := RUN p WITH 1 END";
+  Theo::CodegenResult bounded =
+      Theo::compile({{"main.theo", valid}}, "main.theo", 4, &unused);
+  if (!bounded.generated_correctly) {
+    std::cerr << "unused budget stopped the compilation" << std::endl;
+    err = true;
+  }
+
+  // a cancelled compilation doesn't even read its input
+  for (unsigned int threads : {1u, 4u}) {
+    Theo::CompileBudget cancelled;
+    cancelled.cancel();
+    Theo::CodegenResult none =
+        Theo::compile(files, "main.theo", threads, &cancelled);
+    if (none.generated_correctly || none.errors.size() != 1 ||
+        none.errors[0].message != "compilation was cancelled") {
+      std::cerr << "cancelled compilation did work" << std::endl;
+      err = true;
+    }
+  }
+
+  // a macro that never stops expanding is abandoned on cancellation; it
+  // would take seconds to reach the maximum number of passes, which
+  // reports an error of its own
+  std::map<Theo::FileName, Theo::FileContent> endless = {
+      {"main.theo",
+       "DEFINE step <ID> AS $0 := 1; step $0 END DEFINE\n"
+       "step x\n"}};
+  for (unsigned int threads : {1u, 4u}) {
+    Theo::CompileBudget stale;
+    Theo::CodegenResult res;
+    std::thread compiler([&]() {
+      res = Theo::compile(endless, "main.theo", threads, &stale);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stale.cancel();
+    compiler.join();
+    if (res.errors.size() != 1 ||
+        res.errors.back().message != "compilation was cancelled") {
+      std::cerr << "macro expansion wasn't cancelled" << std::endl;
+      err = true;
+    }
+  }
+
+  // ... also when applied on its own
+  Theo::ScanResult sr = Theo::scan(endless, "main.theo");
+  Theo::MacroExtractionResult mer = Theo::extract_macros(sr.toks);
+  Theo::CompileBudget cancelled;
+  cancelled.cancel();
+  Theo::MacroApplicationResult mar = Theo::apply_macros(
+      mer.tokens, mer.macros, THEO_MACRO_PASSES, &cancelled);
+  if (!mar.errors.empty()) {
+    std::cerr << "cancelled expansion reported errors" << std::endl;
+    err = true;
+  }
+
+  return err ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <sstream>
+
+#include "Compiler/include/compiler.hpp"
+
+// everything gen() produces, including the tables for the debugger
+std::string described(Theo::CodegenResult &cr) {
+  std::stringstream s;
+  cr.code.disassemble(s);
+  for (auto &e : cr.code.line_info)
+    s << e.index << " " << e.file << " " << e.line << std::endl;
+  for (auto &f : cr.code.files) s << f << std::endl;
+  for (auto &sm : cr.code.stack_maps) {
+    s << sm.func_name;
+    for (auto &r : sm.map) s << " " << r.first << ":" << r.second;
+    s << std::endl;
+  }
+  for (auto &e : cr.errors)
+    s << (int)e.t << " " << e.message << " " << e.file << ":" << e.line
+      << std::endl;
+  return s.str();
+}
+
+bool same(std::map<Theo::FileName, Theo::FileContent> files, std::string what,
+          bool correct = true) {
+  Theo::ParseResult pr = Theo::parse(files, "main.theo");
+  Theo::CodegenResult serial = Theo::gen(pr.a, 1);
+  Theo::CodegenResult parallel = Theo::gen(pr.a, 4);
+  pr.a.clear();
+  if (serial.generated_correctly != correct ||
+      described(serial) != described(parallel)) {
+    std::cerr << what << ": parallel code generation differs" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  bool err = false;
+
+  // calls, LOOPs, marks and tail calls across PROGRAMs in several files
+  err |= !same({{"main.theo",
+                 "INCLUDE \"lib.theo\"\n"
+                 "PROGRAM twice IN x1 DO\n"
+                 "  x0 := RUN add WITH x1, x1 END\n"
+                 "END\n"
+                 "a := 3;\n"
+                 "LOOP a DO a := RUN twice WITH a END END;\n"
+                 "b := RUN mul WITH a, 4 END"},
+                {"lib.theo",
+                 "PROGRAM add IN x0, x1 OUT x0 DO\n"
+                 "  WHILE x1 != 0 DO\n"
+                 "    x0 := x0 + 1;\n"
+                 "    x1 := x1 - 1\n"
+                 "  END\n"
+                 "END\n"
+                 "PROGRAM mul IN x1, x2 DO\n"
+                 "  start:\n"
+                 "  IF x2 = 0 THEN GOTO finish;\n"
+                 "  LOOP x1 DO x0 := x0 + 1 END;\n"
+                 "  x2 := x2 - 1;\n"
+                 "  GOTO start;\n"
+                 "  finish: x0 := RUN add WITH x0, 0 END\n"
+                 "END\n"}},
+               "library");
+
+  // redefinitions and recursion: calls refer to what is defined at the call
+  err |= !same({{"main.theo",
+                 "PROGRAM f IN x1 DO x0 := x1 + 1 END\n"
+                 "PROGRAM f IN x1, x2 DO x0 := RUN f WITH x2 END END\n"
+                 "PROGRAM h IN x1 DO x0 := RUN g WITH x1 END END\n"
+                 "PROGRAM g IN x1 DO x0 := RUN g WITH x1 END END\n"
+                 "b := RUN f WITH 1, 2 END;\n"
+                 "c := RUN g WITH 1 END\n"}},
+               "redefinitions", false);
+
+  // errors are reported in the order of the source
+  err |= !same({{"main.theo",
+                 "PROGRAM p IN x1 DO\n"
+                 "  GOTO nowhere;\n"
+                 "  x0 := RUN nothing WITH 1 END\n"
+                 "END\n"
+                 "PROGRAM q IN x1 DO x0 := RUN p WITH 1, 2 END END\n"
+                 "y := RUN p WITH 1, 2 END;\n"
+                 "GOTO elsewhere\n"}},
+               "errors", false);
+
+  // many PROGRAMs, as in a large library
+  std::string many = "";
+  for (int k = 0; k < 300; k++) {
+    std::string p = "p" + std::to_string(k);
+    many += "PROGRAM " + p + " IN x1, x2 DO\n  x0 := x1;\n";
+    if (k > 0)
+      many += "  x0 := RUN p" + std::to_string(k - 1) + " WITH x0, x2 END;\n";
+    many += "  LOOP x2 DO x0 := x0 + 1 END\nEND\n";
+  }
+  many += "r := RUN p299 WITH 1, 2 END\n";
+  err |= !same({{"main.theo", many}}, "many programs");
+
+  // the linked program runs like the serial one
+  Theo::CodegenResult linked =
+      Theo::compile({{"main.theo", many}}, "main.theo", 4);
+  if (!linked.generated_correctly || !linked.code.verify().verified) {
+    std::cerr << "linked program is invalid" << std::endl;
+    err = true;
+  }
+
+  return err ? 1 : 0;
+}
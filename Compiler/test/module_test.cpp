@@ -0,0 +1,108 @@
+#include <filesystem>
+#include <iostream>
+
+#include "Compiler/include/compiler.hpp"
+#include "Compiler/include/module.hpp"
+#include "VM/include/vm.hpp"
+
+// the variables of the root script after running the program
+Theo::VM::Activation::Data run(Theo::CodegenResult &cr) {
+  Theo::VM v(cr.code);
+  v.execute();
+  return v.getActivations().back().getActivationVariables();
+}
+
+int main() {
+  bool err = false;
+  std::map<Theo::FileName, Theo::FileContent> files = {
+      {"main.theo",
+       "INCLUDE \"math.theo\"\n"
+       "INCLUDE \"count.theo\"\n"
+       "PROGRAM square IN x1 DO x0 := RUN mul WITH x1, x1 END END\n"
+       "a := RUN square WITH 7 END;\n"
+       "b := RUN fact WITH 5 END;\n"
+       "c := 3;\n"
+       "twice c"},
+      {"math.theo",
+       "DEFINE twice <ID> AS $0 := RUN add WITH $0, $0 END END DEFINE\n"
+       "PROGRAM add IN x0, x1 OUT x0 DO\n"
+       "  LOOP x1 DO x0 := x0 + 1 END\n"
+       "END\n"
+       "PROGRAM mul IN x1, x2 DO\n"
+       "  LOOP x2 DO x0 := RUN add WITH x0, x1 END END\n"
+       "END\n"
+       "PROGRAM fact IN x1 DO\n"
+       "  x0 := 1;\n"
+       "  WHILE x1 != 0 DO\n"
+       "    x0 := RUN mul WITH x0, x1 END;\n"
+       "    x1 := x1 - 1\n"
+       "  END\n"
+       "END\n"},
+      {"count.theo", "PROGRAM zero IN x1 DO x0 := 0 END\n"}};
+
+  // linked modules compute what the whole source does
+  Theo::CodegenResult whole = Theo::compile(files, "main.theo");
+  Theo::ModuleCache memory("");
+  Theo::CodegenResult linked =
+      Theo::compile(Theo::string_sources(files), "main.theo", memory);
+  if (!whole.generated_correctly || !linked.generated_correctly ||
+      !linked.code.verify().verified || run(whole) != run(linked) ||
+      run(linked)["b"] != 120) {
+    std::cerr << "linked program computes something else" << std::endl;
+    err = true;
+  }
+
+  // only modules may do without a root script
+  if (Theo::compile(files, "count.theo").generated_correctly) {
+    std::cerr << "program without a root script was accepted" << std::endl;
+    err = true;
+  }
+
+  // modules are only compiled again when their sources change
+  Theo::compile(Theo::string_sources(files), "main.theo", memory);
+  files["count.theo"] = "PROGRAM zero IN x1 DO x0 := 0; x1 := 0 END\n";
+  Theo::compile(Theo::string_sources(files), "main.theo", memory);
+  if (memory.compilations() != 3) {
+    std::cerr << "expected 3 module compilations, got "
+              << memory.compilations() << std::endl;
+    err = true;
+  }
+
+  // ... also across caches sharing a directory
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "theo_module_test";
+  std::filesystem::remove_all(dir);
+  Theo::ModuleCache first(dir.string());
+  Theo::compile(Theo::string_sources(files), "main.theo", first);
+  Theo::ModuleCache second(dir.string());
+  Theo::CodegenResult stored =
+      Theo::compile(Theo::string_sources(files), "main.theo", second);
+  if (first.compilations() != 2 || second.compilations() != 0 ||
+      !stored.generated_correctly || run(stored) != run(whole)) {
+    std::cerr << "modules weren't taken from the directory" << std::endl;
+    err = true;
+  }
+  std::filesystem::remove_all(dir);
+
+  // modules can't have a root script
+  files["count.theo"] += "x := 1\n";
+  Theo::CodegenResult script =
+      Theo::compile(Theo::string_sources(files), "main.theo", memory);
+  if (script.generated_correctly || script.errors.size() != 1 ||
+      script.errors[0].t != Theo::CodegenResult::Error::Type::NOT_A_MODULE) {
+    std::cerr << "module with a root script was accepted" << std::endl;
+    err = true;
+  }
+
+  // missing modules are requested
+  files.erase("count.theo");
+  Theo::CodegenResult missing =
+      Theo::compile(Theo::string_sources(files), "main.theo", memory);
+  if (missing.generated_correctly || missing.file_requests.size() != 1 ||
+      missing.file_requests[0] != "count.theo") {
+    std::cerr << "missing module wasn't reported" << std::endl;
+    err = true;
+  }
+
+  return err ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "Compiler/include/bounded_queue.hpp"
+#include "Compiler/include/compiler.hpp"
+#include "Compiler/include/macro.hpp"
+
+std::string disassembled(Theo::CodegenResult &cr) {
+  std::stringstream s;
+  cr.code.disassemble(s);
+  return s.str();
+}
+
+std::vector<Theo::Token> expanded(const Theo::FileContent &code,
+                                  unsigned int threads) {
+  std::map<Theo::FileName, Theo::FileContent> files = {{"main.theo", code}};
+  Theo::TokenStream ts(Theo::string_sources(files), "main.theo");
+  Theo::MacroPipeline pipeline(ts, THEO_MACRO_PASSES, threads);
+  std::vector<Theo::Token> res = {}, region = {};
+  while (pipeline.next(region))
+    res.insert(res.end(), region.begin(), region.end());
+  return res;
+}
+
+bool same(const std::vector<Theo::Token> &a,
+          const std::vector<Theo::Token> &b) {
+  if (a.size() != b.size()) return false;
+  for (std::size_t i = 0; i < a.size(); i++) {
+    if (a[i].t != b[i].t || a[i].text != b[i].text || a[i].line != b[i].line)
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  bool err = false;
+
+  // the queue hands over every value once, in order
+  Theo::BoundedQueue<int> queue(3);
+  std::thread producer([&queue]() {
+    for (int k = 0; k < 10000; k++) queue.push(k);
+  });
+  for (int k = 0; k < 10000; k++) {
+    if (queue.pop() != k) {
+      std::cerr << "queue lost the order of its values" << std::endl;
+      err = true;
+      break;
+    }
+  }
+  producer.join();
+
+  // PROGRAMs using macros, one of which is defined after its uses
+  std::string code = "";
+  for (int k = 0; k < 12; k++) {
+    std::string p = "p" + std::to_string(k);
+    code += "PROGRAM " + p + " IN x1 DO\n  x0 := x1 + " +
+            std::to_string(k) + ";\n  bump x0\nEND\n";
+  }
+  code += "r := RUN p11 WITH 2 END\n";
+  code += "DEFINE bump <ID> AS $0 := $0 + 2 END DEFINE\n";
+
+  // regions are expanded like the whole sequence
+  std::map<Theo::FileName, Theo::FileContent> files = {{"main.theo", code}};
+  Theo::ScanResult sr = Theo::scan(files, "main.theo");
+  Theo::MacroExtractionResult mer = Theo::extract_macros(sr.toks);
+  Theo::MacroApplicationResult mar =
+      Theo::apply_macros(mer.tokens, mer.macros, THEO_MACRO_PASSES);
+  if (!same(expanded(code, 1), mar.transformed_sequence) ||
+      !same(expanded(code, 4), mar.transformed_sequence)) {
+    std::cerr << "regions were expanded differently" << std::endl;
+    err = true;
+  }
+
+  // the result doesn't depend on the number of threads
+  Theo::CodegenResult serial = Theo::compile(files, "main.theo", 1);
+  Theo::CodegenResult pipelined = Theo::compile(files, "main.theo", 4);
+  if (!serial.generated_correctly || !pipelined.generated_correctly ||
+      disassembled(serial) != disassembled(pipelined)) {
+    std::cerr << "pipelined compilation differs" << std::endl;
+    err = true;
+  }
+
+  // the maximum number of passes applies to every region, the whole
+  // sequence needs more of them
+  std::string many = "";
+  for (int k = 0; k < 3; k++) {
+    many += "PROGRAM q" + std::to_string(k) + " IN x1 DO\n";
+    for (int i = 0; i < 10; i++) many += "  twice x1;\n";
+    many += "  x0 := x1\nEND\n";
+  }
+  many += "r := RUN q2 WITH 0 END\n";
+  many += "DEFINE twice <ID> AS $0 := $0 * 2 END DEFINE\n";
+  std::map<Theo::FileName, Theo::FileContent> many_files = {
+      {"main.theo", many}};
+  Theo::MacroExtractionResult many_mer =
+      Theo::extract_macros(Theo::scan(many_files, "main.theo").toks);
+  Theo::TokenStream many_ts(Theo::string_sources(many_files), "main.theo");
+  Theo::MacroPipeline limited(many_ts, 16, 4);
+  std::vector<Theo::Token> region = {};
+  while (limited.next(region)) {
+  }
+  if (Theo::apply_macros(many_mer.tokens, many_mer.macros, 16)
+          .errors.empty() ||
+      !limited.getErrors().empty()) {
+    std::cerr << "the passes of all regions were counted together"
+              << std::endl;
+    err = true;
+  }
+
+  // a macro creating PROGRAMs keeps the sequence in one region
+  std::string generating =
+      "DEFINE id <ID> AS PROGRAM $0 IN x1 DO x0 := x1 END END DEFINE\n"
+      "id f\n"
+      "PROGRAM g IN x1 DO x0 := x1 END\n"
+      "r := RUN f WITH 1 END";
+  Theo::ScanResult gsr =
+      Theo::scan({{"main.theo", generating}}, "main.theo");
+  Theo::MacroExtractionResult gmer = Theo::extract_macros(gsr.toks);
+  Theo::MacroApplicationResult gmar =
+      Theo::apply_macros(gmer.tokens, gmer.macros, THEO_MACRO_PASSES);
+  if (!same(expanded(generating, 4), gmar.transformed_sequence)) {
+    std::cerr << "macro with PROGRAM was expanded differently" << std::endl;
+    err = true;
+  }
+
+  return err ? 1 : 0;
+}
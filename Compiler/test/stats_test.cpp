@@ -0,0 +1,80 @@
+#include <iostream>
+
+#include "Compiler/include/compiler.hpp"
+
+int main() {
+  bool err = false;
+  std::map<Theo::FileName, Theo::FileContent> files = {
+      {"main.theo",
+       "INCLUDE \"lib.theo\"\n"
+       "DEFINE twice <ID> AS $0 := RUN add WITH $0, $0 END END DEFINE\n"
+       "PROGRAM square IN x1 DO x0 := RUN mul WITH x1, x1 END END\n"
+       "a := RUN square WITH 7 END;\n"
+       "b := a + 3;\n"
+       "twice b;\n"
+       "twice a"},
+      {"lib.theo",
+       "PROGRAM add IN x0, x1 OUT x0 DO\n"
+       "  LOOP x1 DO x0 := x0 + 1 END\n"
+       "END\n"
+       "PROGRAM mul IN x1, x2 DO\n"
+       "  LOOP x2 DO x0 := RUN add WITH x0, x1 END END\n"
+       "END\n"}};
+
+  for (unsigned int threads : {1u, 4u}) {
+    Theo::CompileStats stats;
+    Theo::CodegenResult cr =
+        Theo::compile(files, "main.theo", threads, NULL, &stats);
+    if (!cr.generated_correctly) {
+      std::cerr << "compilation with statistics failed" << std::endl;
+      return 1;
+    }
+
+    // the standard macros and "twice"
+    if (stats.tokens.size() != 3 || stats.tokens["main.theo"] == 0 ||
+        stats.tokens["lib.theo"] == 0 || stats.macros != 3 ||
+        stats.detectors.size() != 3) {
+      std::cerr << "tokens or macros weren't counted" << std::endl;
+      err = true;
+    }
+    std::size_t matches = 0;
+    for (auto &d : stats.detectors) {
+      matches += d.matches;
+      if (d.states == 0 || d.table_entries == 0) {
+        std::cerr << "detector without parse tables: " << d.rule << std::endl;
+        err = true;
+      }
+    }
+    if (stats.detectors.size() == 3 &&
+        (stats.detectors[2].rule != "twice <ID>" ||
+         stats.detectors[2].matches != 2 || stats.detectors[0].matches != 2)) {
+      std::cerr << "matches weren't counted per macro" << std::endl;
+      err = true;
+    }
+    if (stats.matches != 4 || matches != stats.matches ||
+        stats.passes < stats.matches) {
+      std::cerr << "expansion wasn't counted" << std::endl;
+      err = true;
+    }
+
+    // the PROGRAMs and the root script, with a jump around every PROGRAM
+    std::size_t instructions = 0;
+    for (auto &p : stats.programs) instructions += p.instructions + 1;
+    if (stats.programs.size() != 4 || stats.programs[0].name != "add" ||
+        stats.programs[3].name != "#root" ||
+        stats.programs[0].registers != 5 ||
+        instructions - 1 != stats.instructions ||
+        stats.instructions != cr.code.code.size() || stats.nodes == 0) {
+      std::cerr << "code wasn't counted per PROGRAM" << std::endl;
+      err = true;
+    }
+
+    if (stats.ns.total <= 0 || stats.ns.parse <= 0 || stats.ns.gen <= 0 ||
+        stats.ns.total < stats.ns.gen + stats.ns.scan) {
+      std::cerr << "phases weren't timed" << std::endl;
+      err = true;
+    }
+  }
+
+  return err ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "Compiler/include/compiler.hpp"
+#include "Compiler/include/macro.hpp"
+#include "Compiler/include/scan.hpp"
+
+// hands out one character per read, so that every token crosses a refill of
+// the scanner's buffer
+class TrickleSource : public Theo::Source {
+ public:
+  TrickleSource(std::string content) : content(content), pos(0) {}
+
+  std::size_t read(char *buf, std::size_t max_size) override {
+    if (pos >= content.size() || max_size == 0) return 0;
+    buf[0] = content[pos++];
+    return 1;
+  }
+
+ private:
+  std::string content;
+  std::size_t pos;
+};
+
+bool same(const std::vector<Theo::Token> &a, const std::vector<Theo::Token> &b,
+          std::string what) {
+  bool equal = a.size() == b.size();
+  for (std::size_t i = 0; equal && i < a.size(); i++) {
+    equal = a[i].t == b[i].t && a[i].text == b[i].text &&
+            a[i].file == b[i].file && a[i].line == b[i].line;
+  }
+  if (!equal) std::cerr << what << ": tokens differ" << std::endl;
+  return equal;
+}
+
+std::vector<Theo::Token> drain(Theo::TokenStream &ts) {
+  std::vector<Theo::Token> res = {};
+  Theo::Token t;
+  while (ts.next(t)) res.push_back(t);
+  return res;
+}
+
+int main() {
+  bool err = false;
+  std::map<Theo::FileName, Theo::FileContent> files = {
+      {"main.theo", "INCLUDE \"side.theo\"\nx := y;\nINCLUDE \"nothing\"\n"},
+      {"side.theo",
+       "DEFINE <ID> ++ AS <ID> := <ID> + 1 END DEFINE\nLOOP x DO y++ END\n"}};
+
+  // the stream yields what scan() collects, including the errors
+  Theo::ScanResult sr = Theo::scan(files, "main.theo");
+  Theo::TokenStream strings(Theo::string_sources(files), "main.theo");
+  err |= !same(drain(strings), sr.toks, "string sources");
+  if (strings.getErrors().size() != 1 ||
+      strings.getErrors()[0].t != Theo::ParseError::FILE_NOT_FOUND ||
+      strings.getErrors()[0].file_request != "nothing") {
+    std::cerr << "missing file wasn't reported" << std::endl;
+    err = true;
+  }
+
+  // regardless of how the sources are chunked
+  Theo::TokenStream trickle(
+      [&files](const Theo::FileName &name) -> std::unique_ptr<Theo::Source> {
+        if (!files.contains(name)) return nullptr;
+        return std::make_unique<TrickleSource>(files[name]);
+      },
+      "main.theo");
+  err |= !same(drain(trickle), sr.toks, "chunked sources");
+
+  // macros are extracted while the tokens are pulled
+  Theo::MacroExtractionResult from_vector = Theo::extract_macros(sr.toks);
+  Theo::TokenStream pulled(Theo::string_sources(files), "main.theo");
+  Theo::MacroExtractionResult from_stream = Theo::extract_macros(pulled);
+  err |= !same(from_stream.tokens, from_vector.tokens, "macro extraction");
+  if (from_stream.macros.size() != 1 ||
+      from_stream.errors.size() != from_vector.errors.size()) {
+    std::cerr << "macro extraction differs" << std::endl;
+    err = true;
+  }
+
+  // a file on disk larger than the scanner's buffer compiles like its
+  // content in memory; long lines rather than many statements, which would
+  // nest too deeply for the parser
+  std::string name(200, 'x');
+  std::string big = "";
+  for (int i = 0; i < 300; i++) big += name + " := y;\n";
+  big += "y := " + name;
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "theo_stream_test";
+  std::filesystem::create_directories(dir);
+  std::ofstream((dir / "big.theo").string()) << big;
+
+  Theo::CodegenResult from_disk =
+      Theo::compile(Theo::file_sources(dir.string()), "big.theo");
+  Theo::CodegenResult from_memory =
+      Theo::compile({{"big.theo", big}}, "big.theo");
+  if (!from_disk.generated_correctly || !from_memory.generated_correctly ||
+      from_disk.code.instructions().size() !=
+          from_memory.code.instructions().size()) {
+    std::cerr << "streamed file compiled differently" << std::endl;
+    err = true;
+  }
+  Theo::CodegenResult missing =
+      Theo::compile(Theo::file_sources(dir.string()), "missing.theo");
+  if (missing.generated_correctly || missing.file_requests.size() != 1) {
+    std::cerr << "missing main file wasn't reported" << std::endl;
+    err = true;
+  }
+  std::filesystem::remove_all(dir);
+
+  return err ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "Debug/include/server.hpp"
+
+/*
+  serves the debugger protocol (see Debug/include/server.hpp) on a unix
+  domain socket, or on stdin/stdout if the path is "-"
+ */
+
+using namespace Theo;
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    std::cout << "usage: " << argv[0] << " <socket path | -> [threads]"
+              << std::endl;
+    return 1;
+  }
+
+  // clients that disconnect are noticed when reading
+  signal(SIGPIPE, SIG_IGN);
+
+  Server server(argc == 3 ? std::atoi(argv[2]) : 2);
+  std::string path = argv[1];
+  if (path == "-") {
+    server.addConnection(STDIN_FILENO, STDOUT_FILENO);
+  } else if (!server.listen(path)) {
+    std::cout << "Couldn't listen on '" << path << "'" << std::endl;
+    return 1;
+  }
+  server.run();
+  return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef _LIBTHEO_DEBUG_JSON_HPP_
+#define _LIBTHEO_DEBUG_JSON_HPP_
+
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Theo {
+
+/**
+ * minimal JSON value for the messages of the debug server;
+ * numbers are restricted to integers, which is all the protocol needs
+ */
+class Json {
+ public:
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  Json() : type(NUL), boolean(false), number(0) {}
+  Json(bool b) : type(BOOL), boolean(b), number(0) {}
+  Json(int n) : type(NUMBER), boolean(false), number(n) {}
+  Json(long long n) : type(NUMBER), boolean(false), number(n) {}
+  Json(unsigned long long n) : type(NUMBER), boolean(false), number(n) {}
+  Json(const char *s) : type(STRING), boolean(false), number(0), string(s) {}
+  Json(std::string s)
+      : type(STRING), boolean(false), number(0), string(std::move(s)) {}
+
+  static Json array();
+  static Json object();
+
+  Type getType() const { return type; }
+  bool isNull() const { return type == NUL; }
+
+  // the value, or a default if the type doesn't match
+  bool asBool(bool def = false) const;
+  long long asInt(long long def = 0) const;
+  std::string asString(std::string def = "") const;
+
+  // array access
+  const std::vector<Json> &items() const { return elements; }
+  void push(Json v);
+
+  // object access; missing members read as null
+  const Json &operator[](const std::string &key) const;
+  Json &operator[](const std::string &key);
+  bool contains(const std::string &key) const;
+  const std::map<std::string, Json> &entries() const { return members; }
+
+  /**
+   * serialize on a single line
+   */
+  std::string dump() const;
+
+  /**
+   * @return std::nullopt if text isn't a single, valid JSON value
+   */
+  static std::optional<Json> parse(std::string_view text);
+
+ private:
+  Type type;
+  bool boolean;
+  long long number;
+  std::string string;
+  std::vector<Json> elements;
+  std::map<std::string, Json> members;
+};
+
+}  // namespace Theo
+
+#endif
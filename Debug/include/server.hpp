@@ -0,0 +1,140 @@
+#ifndef _LIBTHEO_DEBUG_SERVER_HPP_
+#define _LIBTHEO_DEBUG_SERVER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Debug/include/json.hpp"
+#include "VM/include/vm.hpp"
+
+namespace Theo {
+
+/**
+ * debugger server: an event loop that serves any number of clients (over a
+ * local socket or a pair of file descriptors, e.g. stdio), each of which may
+ * debug any number of VM sessions at the same time;
+ *
+ * messages are JSON objects, one per line; requests look like
+ *   {"id": 1, "command": "launch", "arguments": {...}}
+ * and are answered by
+ *   {"type": "response", "id": 1, "success": true, "body": {...}}
+ * (or "success": false and a "message"); a session that stops or exits is
+ * reported asynchronously by
+ *   {"type": "event", "event": "stopped", "body": {"session": 1, ...}}
+ * ("exited" carries a "fault" if execution stopped at an invalid instruction
+ * of unverified bytecode, see VM::getFault)
+ *
+ * commands:
+ *   launch          {"files": {name: source}, "main": name} or
+ *                   {"bytecode": path} -> {"session": id}
+ *   setBreakpoints  {"session", "file", "lines": [...]}, replaces the
+ *                   breakpoints of the file, also while the session runs
+ *                   -> {"breakpoints": [{"line", "verified"}]}
+ *   continue        {"session"}, execute until a breakpoint or the end
+ *   next            {"session"}, execute until the next line
+ *   pause           {"session"}, interrupt a running session
+ *   variables       {"session", "frames": [...]}, the variables of the given
+ *                   activations (all if omitted, negative indices count from
+ *                   the innermost) -> {"frames": [{"function", "variables"}]}
+ *   terminate       {"session"}
+ *
+ * continue and next respond right away, execution happens on a pool of
+ * worker threads, so that the loop stays responsive; launch compiles on the
+ * workers as well and responds once the session exists
+ */
+class Server {
+  struct Connection;
+  struct Session;
+
+  // the socket clients connect to, -1 if not listening
+  int listen_fd;
+  std::string socket_path;
+  // written to wake the event loop up
+  int wakeup[2];
+
+  std::vector<std::shared_ptr<Connection>> connections;
+  std::map<long long, std::shared_ptr<Session>> sessions;
+  long long next_session;
+  std::atomic<bool> stopping;
+
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_cv;
+  std::deque<std::function<void()>> jobs;
+  bool quitting;
+  std::vector<std::thread> workers;
+
+  // work of the workers to be finished on the loop, e.g. registering a
+  // launched session
+  std::mutex completions_mutex;
+  std::vector<std::function<void()>> completions;
+
+  void work();
+  void schedule(std::function<void()> job);
+  void complete(std::function<void()> completion);
+  void wake();
+
+  void accept();
+  bool receive(const std::shared_ptr<Connection> &c);
+  void disconnect(const std::shared_ptr<Connection> &c);
+  void send(Connection &c, const Json &message);
+  void handle(const std::shared_ptr<Connection> &c, const Json &request);
+  void respond(Connection &c, const Json &request, const Json &body,
+               const std::string &error);
+  Json dispatch(const std::shared_ptr<Connection> &c, const std::string &cmd,
+                const Json &args, std::string &error);
+
+  std::shared_ptr<Session> session(const std::shared_ptr<Connection> &c,
+                                   const Json &args, std::string &error);
+  void resume(const std::shared_ptr<Session> &s, bool step);
+  void execute(std::shared_ptr<Session> s);
+  void terminate(const std::shared_ptr<Session> &s);
+
+  void launch(const std::shared_ptr<Connection> &c, const Json &request);
+  Json setBreakpoints(Session &s, const Json &args);
+  Json variables(Session &s, const Json &args, std::string &error);
+
+ public:
+  /**
+   * @param threads number of worker threads executing sessions
+   */
+  Server(unsigned int threads = 2);
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  /**
+   * accept clients on a unix domain socket (the file is replaced)
+   * @return false if the socket couldn't be created
+   */
+  bool listen(const std::string &path);
+
+  /**
+   * serve a client that is already connected, e.g. over stdin/stdout;
+   * the server takes ownership of the descriptors
+   */
+  void addConnection(int in_fd, int out_fd);
+
+  /**
+   * run the event loop until stop() is called, or until the last client
+   * disconnected if the server doesn't listen on a socket
+   */
+  void run();
+
+  /**
+   * make run() return; may be called from any thread
+   */
+  void stop();
+};
+
+}  // namespace Theo
+
+#endif
@@ -0,0 +1,299 @@
+#include "Debug/include/json.hpp"
+
+#include <cctype>
+
+using namespace Theo;
+
+Json Json::array() {
+  Json j;
+  j.type = ARRAY;
+  return j;
+}
+
+Json Json::object() {
+  Json j;
+  j.type = OBJECT;
+  return j;
+}
+
+bool Json::asBool(bool def) const {
+  return this->type == BOOL ? this->boolean : def;
+}
+
+long long Json::asInt(long long def) const {
+  return this->type == NUMBER ? this->number : def;
+}
+
+std::string Json::asString(std::string def) const {
+  return this->type == STRING ? this->string : def;
+}
+
+void Json::push(Json v) {
+  if (this->type != ARRAY) *this = array();
+  this->elements.push_back(std::move(v));
+}
+
+const Json &Json::operator[](const std::string &key) const {
+  static const Json null = Json();
+  auto itr = this->members.find(key);
+  return itr == this->members.end() ? null : itr->second;
+}
+
+Json &Json::operator[](const std::string &key) {
+  if (this->type != OBJECT) *this = object();
+  return this->members[key];
+}
+
+bool Json::contains(const std::string &key) const {
+  return this->members.contains(key);
+}
+
+static void dump_string(std::string &out, const std::string &s) {
+  const char *hex = "0123456789abcdef";
+  out += '"';
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (c < 0x20) {
+          out += "\\u00";
+          out += hex[c >> 4];
+          out += hex[c & 0xf];
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+static void dump_value(std::string &out, const Json &j) {
+  switch (j.getType()) {
+    case Json::NUL:
+      out += "null";
+      break;
+    case Json::BOOL:
+      out += j.asBool() ? "true" : "false";
+      break;
+    case Json::NUMBER:
+      out += std::to_string(j.asInt());
+      break;
+    case Json::STRING:
+      dump_string(out, j.asString());
+      break;
+    case Json::ARRAY: {
+      out += '[';
+      bool first = true;
+      for (auto &e : j.items()) {
+        if (!first) out += ',';
+        first = false;
+        dump_value(out, e);
+      }
+      out += ']';
+      break;
+    }
+    case Json::OBJECT: {
+      out += '{';
+      bool first = true;
+      for (auto &e : j.entries()) {
+        if (!first) out += ',';
+        first = false;
+        dump_string(out, e.first);
+        out += ':';
+        dump_value(out, e.second);
+      }
+      out += '}';
+      break;
+    }
+  }
+}
+
+std::string Json::dump() const {
+  std::string out = "";
+  dump_value(out, *this);
+  return out;
+}
+
+/* recursive descent parser over the input */
+struct JsonParser {
+  std::string_view in;
+  std::size_t pos;
+  int depth;
+
+  void ws() {
+    while (pos < in.size() && std::isspace((unsigned char)in[pos])) pos++;
+  }
+
+  bool literal(std::string_view word) {
+    if (in.substr(pos, word.size()) != word) return false;
+    pos += word.size();
+    return true;
+  }
+
+  std::optional<std::string> str() {
+    if (pos >= in.size() || in[pos] != '"') return std::nullopt;
+    pos++;
+    std::string res = "";
+    while (pos < in.size() && in[pos] != '"') {
+      char c = in[pos++];
+      if ((unsigned char)c < 0x20) return std::nullopt;
+      if (c != '\\') {
+        res += c;
+        continue;
+      }
+      if (pos >= in.size()) return std::nullopt;
+      switch (in[pos++]) {
+        case '"':
+          res += '"';
+          break;
+        case '\\':
+          res += '\\';
+          break;
+        case '/':
+          res += '/';
+          break;
+        case 'b':
+          res += '\b';
+          break;
+        case 'f':
+          res += '\f';
+          break;
+        case 'n':
+          res += '\n';
+          break;
+        case 'r':
+          res += '\r';
+          break;
+        case 't':
+          res += '\t';
+          break;
+        case 'u': {
+          if (pos + 4 > in.size()) return std::nullopt;
+          unsigned int cp = 0;
+          for (int k = 0; k < 4; k++) {
+            char h = in[pos++];
+            if (!std::isxdigit((unsigned char)h)) return std::nullopt;
+            cp = cp * 16 + (std::isdigit((unsigned char)h)
+                                ? h - '0'
+                                : std::tolower((unsigned char)h) - 'a' + 10);
+          }
+          // encode as UTF-8 (surrogate pairs aren't combined)
+          if (cp < 0x80) {
+            res += (char)cp;
+          } else if (cp < 0x800) {
+            res += (char)(0xc0 | (cp >> 6));
+            res += (char)(0x80 | (cp & 0x3f));
+          } else {
+            res += (char)(0xe0 | (cp >> 12));
+            res += (char)(0x80 | ((cp >> 6) & 0x3f));
+            res += (char)(0x80 | (cp & 0x3f));
+          }
+          break;
+        }
+        default:
+          return std::nullopt;
+      }
+    }
+    if (pos >= in.size()) return std::nullopt;
+    pos++;
+    return res;
+  }
+
+  std::optional<Json> value() {
+    if (++depth > 256) return std::nullopt;
+    ws();
+    if (pos >= in.size()) return std::nullopt;
+    std::optional<Json> res = std::nullopt;
+    char c = in[pos];
+    if (c == '{') {
+      pos++;
+      Json obj = Json::object();
+      ws();
+      if (pos < in.size() && in[pos] == '}') {
+        pos++;
+        res = obj;
+      }
+      while (!res) {
+        ws();
+        auto key = str();
+        ws();
+        if (!key || pos >= in.size() || in[pos] != ':') return std::nullopt;
+        pos++;
+        auto v = value();
+        if (!v) return std::nullopt;
+        obj[*key] = *v;
+        ws();
+        if (pos < in.size() && in[pos] == ',') {
+          pos++;
+        } else if (pos < in.size() && in[pos] == '}') {
+          pos++;
+          res = obj;
+        } else {
+          return std::nullopt;
+        }
+      }
+    } else if (c == '[') {
+      pos++;
+      Json arr = Json::array();
+      ws();
+      if (pos < in.size() && in[pos] == ']') {
+        pos++;
+        res = arr;
+      }
+      while (!res) {
+        auto v = value();
+        if (!v) return std::nullopt;
+        arr.push(*v);
+        ws();
+        if (pos < in.size() && in[pos] == ',') {
+          pos++;
+        } else if (pos < in.size() && in[pos] == ']') {
+          pos++;
+          res = arr;
+        } else {
+          return std::nullopt;
+        }
+      }
+    } else if (c == '"') {
+      auto s = str();
+      if (s) res = Json(*s);
+    } else if (literal("true")) {
+      res = Json(true);
+    } else if (literal("false")) {
+      res = Json(false);
+    } else if (literal("null")) {
+      res = Json();
+    } else if (c == '-' || std::isdigit((unsigned char)c)) {
+      std::size_t start = pos;
+      if (c == '-') pos++;
+      while (pos < in.size() && std::isdigit((unsigned char)in[pos])) pos++;
+      std::string digits(in.substr(start, pos - start));
+      if (digits == "-" || digits.size() > 19) return std::nullopt;
+      res = Json(std::stoll(digits));
+    }
+    depth--;
+    return res;
+  }
+};
+
+std::optional<Json> Json::parse(std::string_view text) {
+  JsonParser p = {.in = text, .pos = 0, .depth = 0};
+  auto v = p.value();
+  p.ws();
+  if (!v || p.pos != text.size()) return std::nullopt;
+  return v;
+}
@@ -0,0 +1,583 @@
+#include "Debug/include/server.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "Compiler/include/compiler.hpp"
+
+using namespace Theo;
+
+// a client sending longer lines is disconnected
+static const std::size_t max_message_size = 64 << 20;
+
+struct Server::Connection {
+  int in;
+  int out;
+  bool socket;
+  // received data that doesn't form a complete line yet
+  std::string buffer;
+
+  // responses and events are written from the loop and the workers
+  std::mutex write_mutex;
+  bool closed;
+};
+
+/*
+ * a VM and the state shared between the event loop and the worker executing
+ * it; while executing is set, only the worker may touch the VM, except for
+ * interrupt(); the loop hands changes to an executing session to the worker
+ * as pending commands and interrupts the VM, the worker applies them and
+ * resumes
+ */
+struct Server::Session {
+  long long id;
+  std::shared_ptr<Connection> connection;
+  // the program of the VM, to answer requests without touching the VM
+  Program program;
+  VM vm;
+
+  std::mutex m;
+  // running is set from resume() until the worker finishes, executing only
+  // while the worker has started
+  bool running;
+  bool executing;
+  std::vector<std::function<void(VM &)>> pending;
+  bool pause_requested;
+  bool terminated;
+
+  Session(long long id, std::shared_ptr<Connection> connection, Program p)
+      : id(id),
+        connection(connection),
+        program(p),
+        vm(p),
+        running(false),
+        executing(false),
+        pending({}),
+        pause_requested(false),
+        terminated(false) {}
+};
+
+Server::Server(unsigned int threads) {
+  this->listen_fd = -1;
+  this->socket_path = "";
+  this->connections = {};
+  this->sessions = {};
+  this->next_session = 1;
+  this->stopping = false;
+  this->jobs = {};
+  this->quitting = false;
+  this->completions = {};
+
+  if (pipe(this->wakeup) != 0) this->wakeup[0] = this->wakeup[1] = -1;
+  for (int k = 0; k < 2; k++) {
+    if (this->wakeup[k] >= 0) fcntl(this->wakeup[k], F_SETFL, O_NONBLOCK);
+  }
+
+  if (threads == 0) threads = 1;
+  for (unsigned int k = 0; k < threads; k++)
+    this->workers.emplace_back([this] { this->work(); });
+}
+
+Server::~Server() {
+  for (auto &s : this->sessions) this->terminate(s.second);
+  this->sessions.clear();
+  for (auto &c : this->connections) this->disconnect(c);
+  this->connections.clear();
+
+  {
+    std::lock_guard<std::mutex> l(this->jobs_mutex);
+    this->quitting = true;
+  }
+  this->jobs_cv.notify_all();
+  for (auto &w : this->workers) w.join();
+
+  if (this->listen_fd >= 0) {
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+  }
+  for (int k = 0; k < 2; k++) {
+    if (this->wakeup[k] >= 0) close(this->wakeup[k]);
+  }
+}
+
+void Server::work() {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> l(this->jobs_mutex);
+      this->jobs_cv.wait(
+          l, [this] { return this->quitting || !this->jobs.empty(); });
+      if (this->jobs.empty()) return;
+      job = std::move(this->jobs.front());
+      this->jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void Server::schedule(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> l(this->jobs_mutex);
+    this->jobs.push_back(std::move(job));
+  }
+  this->jobs_cv.notify_one();
+}
+
+void Server::complete(std::function<void()> completion) {
+  {
+    std::lock_guard<std::mutex> l(this->completions_mutex);
+    this->completions.push_back(std::move(completion));
+  }
+  this->wake();
+}
+
+bool Server::listen(const std::string &path) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) return false;
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  unlink(path.c_str());
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      ::listen(fd, 16) != 0) {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  if (this->listen_fd >= 0) {
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+  }
+  this->listen_fd = fd;
+  this->socket_path = path;
+  return true;
+}
+
+void Server::addConnection(int in_fd, int out_fd) {
+  auto c = std::make_shared<Connection>();
+  c->in = in_fd;
+  c->out = out_fd;
+  struct stat st;
+  c->socket = fstat(out_fd, &st) == 0 && S_ISSOCK(st.st_mode);
+  c->buffer = "";
+  c->closed = false;
+  this->connections.push_back(c);
+}
+
+void Server::accept() {
+  for (;;) {
+    int fd = ::accept(this->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    this->addConnection(fd, fd);
+  }
+}
+
+void Server::stop() {
+  this->stopping = true;
+  this->wake();
+}
+
+void Server::wake() {
+  if (this->wakeup[1] >= 0) {
+    char b = 0;
+    if (write(this->wakeup[1], &b, 1) < 0) {
+      // the pipe is full, the loop wakes up anyway
+    }
+  }
+}
+
+void Server::run() {
+  while (!this->stopping) {
+    if (this->listen_fd < 0 && this->connections.empty()) break;
+
+    std::vector<pollfd> fds = {};
+    fds.push_back({.fd = this->wakeup[0], .events = POLLIN, .revents = 0});
+    if (this->listen_fd >= 0)
+      fds.push_back({.fd = this->listen_fd, .events = POLLIN, .revents = 0});
+    std::size_t first_connection = fds.size();
+    for (auto &c : this->connections)
+      fds.push_back({.fd = c->in, .events = POLLIN, .revents = 0});
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (read(this->wakeup[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    std::vector<std::function<void()>> finished = {};
+    {
+      std::lock_guard<std::mutex> l(this->completions_mutex);
+      finished.swap(this->completions);
+    }
+    for (auto &f : finished) f();
+    if (this->listen_fd >= 0 && (fds[1].revents & POLLIN)) this->accept();
+
+    // connections accepted above aren't polled yet
+    std::vector<std::shared_ptr<Connection>> ready = {};
+    for (std::size_t k = first_connection; k < fds.size(); k++) {
+      if (fds[k].revents & (POLLIN | POLLHUP | POLLERR))
+        ready.push_back(this->connections[k - first_connection]);
+    }
+    for (auto &c : ready) {
+      if (this->receive(c)) continue;
+      this->disconnect(c);
+      std::erase(this->connections, c);
+    }
+  }
+}
+
+bool Server::receive(const std::shared_ptr<Connection> &c) {
+  char data[1 << 16];
+  ssize_t n = read(c->in, data, sizeof(data));
+  if (n < 0) return errno == EINTR || errno == EAGAIN;
+  if (n == 0) return false;
+
+  std::size_t start = c->buffer.size();
+  c->buffer.append(data, n);
+  std::size_t line = 0, end;
+  while ((end = c->buffer.find('\n', start)) != std::string::npos) {
+    std::string_view text(c->buffer.data() + line, end - line);
+    if (text.find_first_not_of(" \t\r") != std::string_view::npos) {
+      auto request = Json::parse(text);
+      if (request) {
+        this->handle(c, *request);
+      } else {
+        Json response = Json::object();
+        response["type"] = "response";
+        response["success"] = false;
+        response["message"] = "malformed message";
+        this->send(*c, response);
+      }
+    }
+    line = start = end + 1;
+  }
+  c->buffer.erase(0, line);
+  return c->buffer.size() <= max_message_size;
+}
+
+void Server::disconnect(const std::shared_ptr<Connection> &c) {
+  for (auto itr = this->sessions.begin(); itr != this->sessions.end();) {
+    if (itr->second->connection == c) {
+      this->terminate(itr->second);
+      itr = this->sessions.erase(itr);
+    } else {
+      itr++;
+    }
+  }
+
+  std::lock_guard<std::mutex> l(c->write_mutex);
+  if (c->closed) return;
+  c->closed = true;
+  close(c->in);
+  if (c->out != c->in) close(c->out);
+}
+
+void Server::send(Connection &c, const Json &message) {
+  std::string text = message.dump() + "\n";
+  std::lock_guard<std::mutex> l(c.write_mutex);
+  if (c.closed) return;
+
+  std::size_t written = 0;
+  while (written < text.size()) {
+    ssize_t n = c.socket ? ::send(c.out, text.data() + written,
+                                  text.size() - written, MSG_NOSIGNAL)
+                         : write(c.out, text.data() + written,
+                                 text.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) {
+      pollfd p = {.fd = c.out, .events = POLLOUT, .revents = 0};
+      poll(&p, 1, -1);
+      continue;
+    }
+    // the client is gone, the loop notices when reading
+    if (n <= 0) return;
+    written += n;
+  }
+}
+
+void Server::handle(const std::shared_ptr<Connection> &c,
+                    const Json &request) {
+  std::string command = request["command"].asString();
+  // answered once the program is compiled
+  if (command == "launch") return this->launch(c, request);
+
+  std::string error = "";
+  Json body = this->dispatch(c, command, request["arguments"], error);
+  this->respond(*c, request, body, error);
+}
+
+void Server::respond(Connection &c, const Json &request, const Json &body,
+                     const std::string &error) {
+  Json response = Json::object();
+  response["type"] = "response";
+  response["id"] = request["id"];
+  response["command"] = request["command"].asString();
+  response["success"] = error == "";
+  if (error != "") {
+    response["message"] = error;
+  } else if (!body.isNull()) {
+    response["body"] = body;
+  }
+  this->send(c, response);
+}
+
+Json Server::dispatch(const std::shared_ptr<Connection> &c,
+                      const std::string &cmd, const Json &args,
+                      std::string &error) {
+  auto s = this->session(c, args, error);
+  if (s == nullptr) return Json();
+
+  if (cmd == "setBreakpoints") return this->setBreakpoints(*s, args);
+
+  if (cmd == "continue" || cmd == "next") {
+    std::lock_guard<std::mutex> l(s->m);
+    if (s->running) {
+      error = "session is running";
+    } else if (s->vm.isDone()) {
+      error = "session has exited";
+    } else {
+      this->resume(s, cmd == "next");
+    }
+    return Json();
+  }
+
+  if (cmd == "pause") {
+    std::lock_guard<std::mutex> l(s->m);
+    if (s->running) {
+      s->pause_requested = true;
+      s->vm.interrupt();
+    }
+    return Json();
+  }
+
+  if (cmd == "variables") {
+    std::lock_guard<std::mutex> l(s->m);
+    if (s->running) {
+      error = "session is running";
+      return Json();
+    }
+    return this->variables(*s, args, error);
+  }
+
+  if (cmd == "terminate") {
+    this->terminate(s);
+    this->sessions.erase(s->id);
+    return Json();
+  }
+
+  error = "unknown command '" + cmd + "'";
+  return Json();
+}
+
+std::shared_ptr<Server::Session> Server::session(
+    const std::shared_ptr<Connection> &c, const Json &args,
+    std::string &error) {
+  auto itr = this->sessions.find(args["session"].asInt(-1));
+  // sessions are private to the client that launched them
+  if (itr == this->sessions.end() || itr->second->connection != c) {
+    error = "unknown session";
+    return nullptr;
+  }
+  return itr->second;
+}
+
+// the program to launch, compiled or loaded from a bytecode file
+static Program build(const Json &args, std::string &error) {
+  if (args.contains("bytecode")) {
+    BytecodeLoadResult lr = Program::load(args["bytecode"].asString());
+    if (!lr.loaded_correctly) error = "couldn't load bytecode: " + lr.error;
+    return lr.program;
+  }
+
+  std::map<FileName, FileContent> files = {};
+  for (auto &f : args["files"].entries()) files[f.first] = f.second.asString();
+  std::string main = args["main"].asString();
+  if (!files.contains(main)) {
+    error = "main file '" + main + "' is missing";
+    return {};
+  }
+
+  CodegenResult cr = compile(files, main);
+  if (!cr.generated_correctly) {
+    error = "compilation failed:";
+    for (auto &e : cr.errors) {
+      error += " in '" + e.file + "', line " + std::to_string(e.line) + " '" +
+               e.message + "';";
+    }
+  }
+  return cr.code;
+}
+
+void Server::launch(const std::shared_ptr<Connection> &c,
+                    const Json &request) {
+  // compiling may take long, the loop only registers the session
+  this->schedule([this, c, request] {
+    std::string error = "";
+    Program program = build(request["arguments"], error);
+    this->complete([this, c, request, program, error] {
+      // the client is gone
+      if (c->closed) return;
+      Json body = Json();
+      if (error == "") {
+        long long id = this->next_session++;
+        this->sessions[id] = std::make_shared<Session>(id, c, program);
+        body = Json::object();
+        body["session"] = id;
+      }
+      this->respond(*c, request, body, error);
+    });
+  });
+}
+
+Json Server::setBreakpoints(Session &s, const Json &args) {
+  std::string file = args["file"].asString();
+  std::vector<int> lines = {};
+  Json verified = Json::array();
+  for (auto &item : args["lines"].items()) {
+    int line = item.asInt();
+    lines.push_back(line);
+    Json bp = Json::object();
+    bp["line"] = line;
+    // what VM::setBreakPoint returns
+    bp["verified"] = !s.program.breaksAt({file, line}).empty();
+    verified.push(bp);
+  }
+
+  auto update = [file, lines](VM &vm) {
+    std::vector<int> old = {};
+    for (auto &bp : vm.getEnabledBreakPoints()) {
+      if (bp.file == file) old.push_back(bp.line);
+    }
+    for (int line : old) vm.setBreakPoint(file, line, false);
+    for (int line : lines) vm.setBreakPoint(file, line, true);
+  };
+
+  // an executing session is interrupted, updated by its worker and resumed
+  // without the client noticing
+  std::lock_guard<std::mutex> l(s.m);
+  if (s.executing) {
+    s.pending.push_back(update);
+    s.vm.interrupt();
+  } else {
+    update(s.vm);
+  }
+
+  Json body = Json::object();
+  body["breakpoints"] = verified;
+  return body;
+}
+
+Json Server::variables(Session &s, const Json &args, std::string &error) {
+  auto &activations = s.vm.getActivations();
+  long long depth = activations.size();
+
+  std::vector<long long> frames = {};
+  if (args["frames"].getType() == Json::ARRAY) {
+    for (auto &f : args["frames"].items()) {
+      long long k = f.asInt();
+      if (k < 0) k += depth;
+      if (k < 0 || k >= depth) {
+        error = "no frame " + std::to_string(f.asInt());
+        return Json();
+      }
+      frames.push_back(k);
+    }
+  } else {
+    for (long long k = 0; k < depth; k++) frames.push_back(k);
+  }
+
+  Json result = Json::array();
+  for (long long k : frames) {
+    const VM::Activation &a = activations[k];
+    Json frame = Json::object();
+    frame["index"] = k;
+    frame["function"] = a.getFunctionName();
+    Json vars = Json::object();
+    for (auto v : a.getVariables()) vars[std::string(v.name)] = v.value;
+    frame["variables"] = vars;
+    result.push(frame);
+  }
+
+  Json body = Json::object();
+  body["frames"] = result;
+  return body;
+}
+
+void Server::resume(const std::shared_ptr<Session> &s, bool step) {
+  // called with s->m held
+  s->vm.setSteppingMode(step);
+  s->running = true;
+  s->pause_requested = false;
+  this->schedule([this, s] { this->execute(s); });
+}
+
+void Server::execute(std::shared_ptr<Session> s) {
+  std::unique_lock<std::mutex> l(s->m);
+  s->executing = true;
+  // a session terminated before it started isn't executed at all
+  while (!s->terminated) {
+    l.unlock();
+    s->vm.execute();
+    l.lock();
+    for (auto &command : s->pending) command(s->vm);
+    s->pending.clear();
+    // interrupts that weren't a pause are either breakpoint updates or
+    // left over from a pause that came too late
+    if (!s->vm.wasInterrupted() || s->pause_requested) break;
+  }
+
+  Json message = Json::object();
+  message["type"] = "event";
+  Json body = Json::object();
+  body["session"] = s->id;
+  if (s->vm.isDone()) {
+    message["event"] = "exited";
+    if (s->vm.getFault()) body["fault"] = *s->vm.getFault();
+  } else {
+    message["event"] = "stopped";
+    BreakPoint bp = s->vm.getCurrentBreak();
+    if (s->vm.wasInterrupted()) {
+      body["reason"] = "pause";
+    } else if (s->vm.getCurrentWatch()) {
+      body["reason"] = "watchpoint";
+    } else {
+      body["reason"] = s->vm.isSteppingModeEnabled() ? "step" : "breakpoint";
+    }
+    if (bp.line != -1) {
+      body["file"] = bp.file;
+      body["line"] = bp.line;
+    }
+  }
+  message["body"] = body;
+
+  s->running = false;
+  s->executing = false;
+  bool terminated = s->terminated;
+  l.unlock();
+
+  if (!terminated) this->send(*s->connection, message);
+}
+
+void Server::terminate(const std::shared_ptr<Session> &s) {
+  // the worker of a running session stops it and finishes without reporting
+  std::lock_guard<std::mutex> l(s->m);
+  s->terminated = true;
+  if (!s->running) return;
+  s->pause_requested = true;
+  s->vm.interrupt();
+}
@@ -0,0 +1,204 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Debug/include/server.hpp"
+
+/*
+  a scripted client debugging two sessions at once over a socket pair:
+  one stops on breakpoints (also one set while the session is running),
+  the other loops forever until it is paused
+ */
+
+using namespace Theo;
+
+struct Client {
+  int fd;
+  int id = 0;
+  std::string buffer = "";
+  // events received while waiting for a response
+  std::vector<Json> events = {};
+
+  Json receive() {
+    for (;;) {
+      std::size_t end = buffer.find('\n');
+      if (end != std::string::npos) {
+        auto message = Json::parse(std::string_view(buffer).substr(0, end));
+        buffer.erase(0, end + 1);
+        return message ? *message : Json();
+      }
+      char data[4096];
+      ssize_t n = read(fd, data, sizeof(data));
+      if (n <= 0) return Json();
+      buffer.append(data, n);
+    }
+  }
+
+  Json request(std::string command, Json arguments) {
+    Json r = Json::object();
+    r["id"] = ++id;
+    r["command"] = command;
+    r["arguments"] = arguments;
+    std::string text = r.dump() + "\n";
+    if (write(fd, text.data(), text.size()) != (ssize_t)text.size())
+      return Json();
+    for (;;) {
+      Json m = receive();
+      if (m.isNull() || m["type"].asString() == "response") return m;
+      events.push_back(m);
+    }
+  }
+
+  Json event() {
+    if (!events.empty()) {
+      Json e = events.front();
+      events.erase(events.begin());
+      return e;
+    }
+    return receive();
+  }
+};
+
+Json args(long long session) {
+  Json a = Json::object();
+  a["session"] = session;
+  return a;
+}
+
+int fail(std::string what) {
+  std::cout << what << std::endl;
+  return 1;
+}
+
+int script(Client &c) {
+  Json count = Json::object();
+  count["main"] = "count.theo";
+  count["files"]["count.theo"] =
+      "n := 100;\n"
+      "LOOP n DO\n"
+      "  x := x + 1\n"
+      "END;\n"
+      "y := x\n";
+  Json spin = Json::object();
+  spin["main"] = "spin.theo";
+  spin["files"]["spin.theo"] =
+      "x := 1;\n"
+      "WHILE x != 0 DO\n"
+      "  y := y + 1\n"
+      "END\n";
+
+  long long a = c.request("launch", count)["body"]["session"].asInt(-1);
+  long long b = c.request("launch", spin)["body"]["session"].asInt(-1);
+  if (a < 0 || b < 0 || a == b) return fail("launch failed");
+
+  Json bad = Json::object();
+  bad["main"] = "bad.theo";
+  bad["files"]["bad.theo"] = "x := := 1";
+  if (c.request("launch", bad)["success"].asBool(true))
+    return fail("broken program was launched");
+
+  // break on the body of the loop
+  Json bps = args(a);
+  bps["file"] = "count.theo";
+  bps["lines"].push(3);
+  bps["lines"].push(42);
+  auto verified = c.request("setBreakpoints", bps)["body"]["breakpoints"];
+  if (verified.items().size() != 2 || !verified.items()[0]["verified"].asBool() ||
+      verified.items()[1]["verified"].asBool())
+    return fail("breakpoints weren't verified correctly");
+
+  // spin forever in the background
+  if (!c.request("continue", args(b))["success"].asBool())
+    return fail("couldn't continue the spinning session");
+
+  for (int k = 0; k < 3; k++) {
+    if (!c.request("continue", args(a))["success"].asBool())
+      return fail("couldn't continue");
+    Json e = c.event();
+    if (e["event"].asString() != "stopped" || e["body"]["session"].asInt() != a ||
+        e["body"]["line"].asInt() != 3)
+      return fail("didn't stop on the breakpoint: " + e.dump());
+
+    Json q = args(a);
+    q["frames"].push(-1);
+    Json frames = c.request("variables", q)["body"]["frames"];
+    if (frames.items().size() != 1 ||
+        frames.items()[0]["function"].asString() != "#root" ||
+        frames.items()[0]["variables"]["x"].asInt(-1) != k)
+      return fail("unexpected variables " + frames.dump());
+  }
+
+  if (c.request("variables", args(b))["success"].asBool(true))
+    return fail("variables of a running session were returned");
+
+  // replace the breakpoints of the spinning session while it runs
+  Json spin_bps = args(b);
+  spin_bps["file"] = "spin.theo";
+  spin_bps["lines"].push(3);
+  c.request("setBreakpoints", spin_bps);
+  Json e = c.event();
+  if (e["event"].asString() != "stopped" || e["body"]["session"].asInt() != b ||
+      e["body"]["reason"].asString() != "breakpoint")
+    return fail("breakpoint set while running wasn't hit: " + e.dump());
+
+  // clear it again, and pause
+  spin_bps["lines"] = Json::array();
+  c.request("setBreakpoints", spin_bps);
+  c.request("continue", args(b));
+  c.request("pause", args(b));
+  e = c.event();
+  if (e["event"].asString() != "stopped" || e["body"]["session"].asInt() != b ||
+      e["body"]["reason"].asString() != "pause")
+    return fail("session wasn't paused: " + e.dump());
+  if (c.request("variables", args(b))["body"]["frames"].items()[0]["variables"]
+          ["y"]
+              .asInt() <= 0)
+    return fail("paused session didn't make progress");
+
+  // run the counting session to its end
+  bps["lines"] = Json::array();
+  c.request("setBreakpoints", bps);
+  c.request("continue", args(a));
+  e = c.event();
+  if (e["event"].asString() != "exited" || e["body"]["session"].asInt() != a)
+    return fail("session didn't exit: " + e.dump());
+  Json vars = c.request("variables", args(a))["body"]["frames"];
+  if (vars.items().back()["variables"]["y"].asInt() != 100)
+    return fail("unexpected result " + vars.dump());
+
+  c.request("continue", args(b));
+  if (!c.request("terminate", args(b))["success"].asBool())
+    return fail("couldn't terminate a running session");
+  if (c.request("continue", args(b))["success"].asBool(true))
+    return fail("terminated session still exists");
+
+  return 0;
+}
+
+int main() {
+  auto parsed = Json::parse(R"( {"a": [1, -2, "x\n\"y\""], "b": {}} )");
+  if (!parsed || (*parsed)["a"].items()[1].asInt() != -2 ||
+      Json::parse(parsed->dump())->dump() != parsed->dump() ||
+      Json::parse("[1,]"))
+    return fail("json round trip failed");
+
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    return fail("couldn't create socket pair");
+
+  Server server(2);
+  server.addConnection(sv[0], sv[0]);
+  std::thread loop([&server] { server.run(); });
+  Client c = {.fd = sv[1]};
+
+  int res = script(c);
+
+  server.stop();
+  loop.join();
+  close(sv[1]);
+  return res;
+}
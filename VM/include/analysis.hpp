@@ -0,0 +1,55 @@
+#ifndef _LIBTHEO_VM_ANALYSIS_HPP_
+#define _LIBTHEO_VM_ANALYSIS_HPP_
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "VM/include/layout.hpp"
+#include "VM/include/program.hpp"
+
+namespace Theo {
+
+/**
+ * static bounds of a program's execution, derived from its bytecode: the
+ * call graph, recursion, which functions are guaranteed to terminate and,
+ * if the program isn't recursive, the largest stack and memory it can use
+ */
+struct Analysis {
+  struct Function {
+    std::string name;  // from the stack map, "#root" for the root script
+    ProgramIndex entry;
+    // the largest frame the function is called with
+    RegisterCount frame_size;
+    // the functions it calls (indices into .functions, without duplicates)
+    std::vector<int> callees;
+    // the function is part of a cycle of calls
+    bool recursive;
+    // every loop of the function is a LOOP: a counter that nothing but the
+    // loop itself changes is tested at the top and decremented at the
+    // bottom (no WHILE, no backward GOTO)
+    bool loop_only;
+    // loop_only, not recursive and only calls functions that terminate;
+    // such functions are primitive recursive and terminate on every input
+    bool terminates;
+  };
+
+  // same order as the functions of the Layout, [0] is the root script
+  std::vector<Function> functions;
+  // maximum number of activations and of words of data while the program
+  // runs, std::nullopt if they aren't bounded (recursion, malformed calls)
+  std::optional<std::size_t> max_depth;
+  std::optional<std::size_t> max_data;
+
+  /**
+   * whether every run of the program ends (the root script terminates)
+   */
+  bool terminates() const;
+
+  static Analysis analyze(const Program &p);
+};
+
+}  // namespace Theo
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _LIBTHEO_VM_EXECUTION_HPP_
+#define _LIBTHEO_VM_EXECUTION_HPP_
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace Theo {
+
+/**
+ * a resumable execution of a VM (see VM::run), implemented as a coroutine
+ * that suspends after every slice of instructions and on every stop:
+ *   auto e = vm.run(4096);
+ *   while (e.resume()) {
+ *     if (e.stop() == Execution::BREAK) ...
+ *   }
+ * the execution must not outlive its VM
+ */
+class Execution {
+ public:
+  enum Stop {
+    SLICE,  // the slice of instructions ran out
+    BREAK,  // a breakpoint (or watchpoint) was hit
+    HALT,   // the program has ended
+  };
+
+  struct promise_type {
+    Stop stop = SLICE;
+
+    Execution get_return_object() {
+      return Execution(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(Stop s) noexcept {
+      this->stop = s;
+      return {};
+    }
+    void return_value(Stop s) noexcept { this->stop = s; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Execution(Execution &&o) noexcept
+      : handle(std::exchange(o.handle, nullptr)) {}
+  Execution &operator=(Execution &&o) noexcept {
+    if (this != &o) {
+      if (this->handle) this->handle.destroy();
+      this->handle = std::exchange(o.handle, nullptr);
+    }
+    return *this;
+  }
+  Execution(const Execution &) = delete;
+  Execution &operator=(const Execution &) = delete;
+  ~Execution() {
+    if (this->handle) this->handle.destroy();
+  }
+
+  /**
+   * execute until the slice runs out or the VM stops
+   * @return false once the program has ended (stop() is then HALT)
+   */
+  bool resume() {
+    if (this->done()) return false;
+    this->handle.resume();
+    return !this->handle.done();
+  }
+
+  /**
+   * why the last resume() returned
+   */
+  Stop stop() const { return this->handle.promise().stop; }
+
+  bool done() const { return !this->handle || this->handle.done(); }
+
+ private:
+  explicit Execution(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+}  // namespace Theo
+
+#endif
@@ -14,7 +14,11 @@ enum class OpCode {
   EXEC,
   RET,
   CONST,
-  TEST
+  TEST,
+  TAIL_EXEC,
+  // only used by the VM to instrument the writing instructions of watched
+  // variables (see VM::setWatchPoint); never part of a Program
+  WATCH
 };
 
 typedef int RegisterIndex, JumpOffset, Constant, ProgramIndex, RegisterCount,
@@ -118,6 +122,16 @@ struct Instruction {
    */
   static Instruction Exec(ProgramIndex entry);
 
+  /**
+   * EXEC in tail position (the call is immediately followed by RET):
+   * the frame created by the preceding PREPARE replaces the current one,
+   * the callee then returns directly to the caller of the current frame;
+   * PREPARE 3
+   * ARG 1 13
+   * TAIL_EXEC <entry>
+   */
+  static Instruction TailExec(ProgramIndex entry);
+
   /**
    * copies from register <source> of the current stack frame
    * to the return register specified for the second to last stack frame
@@ -0,0 +1,55 @@
+#ifndef _LIBTHEO_VM_LAYOUT_HPP_
+#define _LIBTHEO_VM_LAYOUT_HPP_
+
+#include <span>
+#include <vector>
+
+#include "VM/include/instr.hpp"
+
+namespace Theo {
+
+/**
+ * static structure of a program's bytecode: the functions (PROGRAMs and the
+ * root script), the instructions each of them owns and the call sites
+ * between them
+ */
+struct Layout {
+  struct Function {
+    ProgramIndex entry;
+    StackMapIndex stack_map;  // -1 if no PREPARE_EXEC belongs to the entry
+    RegisterCount frame_size;
+  };
+
+  struct CallSite {
+    ProgramIndex prepare;  // -1 if the EXEC isn't preceded by a PREPARE_EXEC
+    ProgramIndex exec;
+    int caller;  // indices into .functions
+    int callee;
+    // TAIL_EXEC: the callee replaces the caller's frame and returns to the
+    // caller's caller
+    bool tail;
+  };
+
+  // functions[0] is the root script, starting at bytecode position 0
+  std::vector<Function> functions;
+  // owning function per bytecode position, -1 for unreachable instructions;
+  // an instruction reachable from several functions belongs to the first
+  // one discovered
+  std::vector<int> owner;
+  std::vector<CallSite> calls;
+
+  /**
+   * follow the control flow from position 0 and from every EXEC target
+   */
+  static Layout analyze(std::span<const Instruction> code);
+
+  /**
+   * index of the function starting at entry
+   * @return -1 if there is none
+   */
+  int functionAt(ProgramIndex entry) const;
+};
+
+}  // namespace Theo
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef _LIBTHEO_VM_LOCKSTEP_HPP_
+#define _LIBTHEO_VM_LOCKSTEP_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+namespace Theo {
+
+/**
+ * executes one program on many inputs at once: the inputs are processed in
+ * chunks of `width` lanes, every register holds one word per lane and every
+ * instruction is executed for all lanes of a group together; lanes that
+ * take different branches of a JMPC are split into separate groups, which
+ * are merged again as soon as they reach the same position with the same
+ * calls; the group furthest behind in the program always runs first, so
+ * that the lanes of a branch or a loop wait for the others at its end;
+ * for programs that branch the same way on all inputs this multiplies the
+ * throughput of a single core by up to `width`
+ *
+ * run() may be called from several threads at once;
+ * only verified programs (see Program::verify) can be executed, there are
+ * no breakpoints, no profiling and no instruction budget, so the program
+ * should terminate on every input (see Analysis)
+ */
+class LockstepVM {
+ public:
+  static constexpr std::size_t width = 8;
+  typedef std::array<VM::Word, width> Lanes;
+
+  /* the values of root variables for one run */
+  typedef std::map<std::string, VM::Word> Inputs;
+
+  /* the outcome of one run, like that of a VM executing it alone */
+  struct Run {
+    VM::InstructionCount instructions;
+    // the root script's variables by register
+    std::vector<std::pair<std::string, VM::Word>> variables;
+  };
+
+  struct Result {
+    bool ran;
+    std::string error;
+    std::vector<Run> runs;  // in the order of the inputs
+  };
+
+  LockstepVM(Program code);
+
+  bool isVerified();
+
+  /**
+   * run the program once per input
+   * @return ran is false (and error describes why) if the program wasn't
+   * verified or an input isn't a variable of the root script
+   */
+  Result run(const std::vector<Inputs> &inputs) const;
+
+ private:
+  typedef std::uint32_t Mask;
+
+  struct Frame {
+    std::size_t base;
+    RegisterCount size;
+    RegisterIndex ret_target;
+    ProgramIndex ret_addr;
+    StackMapIndex debug_info;
+
+    bool operator==(const Frame &o) const = default;
+  };
+
+  // lanes at the same position with the same calls
+  struct Group {
+    ProgramIndex ip;
+    Mask mask;  // lanes of the chunk that belong to the group
+    VM::InstructionCount executed;
+    // instructions executed by each lane, relative to executed
+    std::array<long long, width> skew;
+    std::vector<Frame> stack;
+    std::vector<Lanes> data;
+  };
+
+  // an input, resolved to a register of the root frame
+  struct Binding {
+    std::size_t lane;
+    RegisterIndex reg;
+    VM::Word value;
+  };
+
+  enum class Stop { HALT, SPLIT, YIELD };
+
+  Program code;
+  bool verified;
+
+  void runChunk(const std::vector<Binding> &bindings, Run *runs,
+                Mask lanes) const;
+  // execute until the group halts, splits (the lanes that jump are moved to
+  // split) or reaches position stop or beyond
+  Stop step(Group &g, ProgramIndex stop, Group &split,
+            const std::vector<Binding> &bindings) const;
+  void merge(Group &into, const Group &from) const;
+  void finish(const Group &g, Run *runs) const;
+};
+
+}  // namespace Theo
+
+#endif
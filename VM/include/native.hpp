@@ -0,0 +1,55 @@
+#ifndef _LIBTHEO_VM_NATIVE_HPP_
+#define _LIBTHEO_VM_NATIVE_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "VM/include/instr.hpp"
+
+namespace Theo {
+
+struct NativeLoadResult;
+
+/**
+ * a program translated to C++ by Program::emitCpp and compiled into a
+ * shared object (see cmake/TheoNative.cmake); it runs without any
+ * debugging facilities, but computes exactly what the VM computes
+ */
+class NativeProgram {
+  void *handle;
+  int (*entry)(int *);
+  int frame_size;
+  std::map<std::string, RegisterIndex> variables;
+
+  NativeProgram();
+
+ public:
+  typedef std::map<std::string, int> Data;
+
+  ~NativeProgram();
+  NativeProgram(const NativeProgram &) = delete;
+  NativeProgram &operator=(const NativeProgram &) = delete;
+
+  /**
+   * execute the program from the start
+   * @return the variables of the root script after execution, as
+   * VM::Activation::getActivationVariables() returns them
+   */
+  Data run();
+
+  /**
+   * load a shared object built from the output of Program::emitCpp
+   */
+  static NativeLoadResult load(std::string path);
+};
+
+struct NativeLoadResult {
+  bool loaded_correctly;
+  std::string error;
+  std::shared_ptr<NativeProgram> program;
+};
+
+}  // namespace Theo
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _LIBTHEO_VM_PROFILE_HPP_
+#define _LIBTHEO_VM_PROFILE_HPP_
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "VM/include/instr.hpp"
+#include "VM/include/program.hpp"
+
+namespace Theo {
+
+/**
+ * instruction counts collected by a VM in profiling mode
+ * (see VM::setProfiling); the raw counts are kept per bytecode position and
+ * per call path, reports are aggregated from them using the debug
+ * information of the profiled program
+ */
+struct Profile {
+  typedef unsigned long long Count;
+
+  /* node of the call tree, one per distinct chain of calls */
+  struct CallPath {
+    StackMapIndex function;  // -1 until the root activation is created
+    std::size_t parent;      // the root is its own parent
+    Count calls;
+    Count exclusive;  // instructions executed in this activation itself
+    std::map<StackMapIndex, std::size_t> callees;
+  };
+
+  struct LineCount {
+    BreakPoint line;
+    Count instructions;
+  };
+
+  struct FunctionCount {
+    std::string name;
+    Count calls;
+    Count inclusive;  // including callees, recursive calls counted once
+    Count exclusive;
+  };
+
+  // executed instructions per bytecode position
+  std::vector<Count> instructions;
+  // call tree, paths[0] is the root activation
+  std::vector<CallPath> paths;
+
+  /**
+   * discard all counts
+   * @param code_size number of instructions of the profiled program
+   */
+  void clear(std::size_t code_size);
+
+  /**
+   * the call path reached by calling function from path (created if needed)
+   */
+  std::size_t callee(std::size_t path, StackMapIndex function);
+
+  Count total() const;
+
+  /**
+   * instructions executed per source line, most expensive first;
+   * an instruction is attributed to the closest preceding line
+   */
+  std::vector<LineCount> lines(const Program &p) const;
+
+  /**
+   * calls and instructions per PROGRAM, most expensive first
+   */
+  std::vector<FunctionCount> functions(const Program &p) const;
+
+  /**
+   * write the call tree in the collapsed stack format understood by
+   * flame graph tools ("root;f;g <exclusive instructions>" per line)
+   */
+  void writeCollapsed(std::ostream &o, const Program &p) const;
+};
+
+}  // namespace Theo
+
+#endif
@@ -1,8 +1,12 @@
 #ifndef _LIBTHEO_VM_PROGRAM_HPP_
 #define _LIBTHEO_VM_PROGRAM_HPP_
 
+#include <cstddef>
 #include <map>
+#include <memory>
+#include <ostream>
 #include <set>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -16,29 +20,133 @@ struct BreakPoint {
 
 bool operator<(const BreakPoint &bp1, const BreakPoint &bp2);
 
+/**
+ * storage for the instructions of a program that was loaded from a bytecode
+ * file without copying them (see Program::load)
+ */
+struct CodeImage {
+  const Instruction *instructions;
+  std::size_t size;
+
+  virtual ~CodeImage() = default;
+};
+
+struct BytecodeLoadResult;
+struct VerifyResult;
+
 struct Program {
   struct StackMap {
     std::string func_name;
     std::map<RegisterIndex, std::string> map;
   };
 
+  /* source position of a potential breakpoint */
+  struct LineEntry {
+    ProgramIndex index;  // bytecode position
+    int file;            // index into .files
+    int line;
+  };
+
   std::vector<Instruction> code;
   std::vector<StackMap> stack_maps;
 
-  // map from {filename, linenumber} to "bytecode position of potential
-  // breakpoint"
-  std::map<BreakPoint, std::vector<ProgramIndex>> potential_breaks;
-  // map from "bytecode position of potential breakpoint" to {filename,
-  // linenumber}
-  std::map<ProgramIndex, BreakPoint> line_info;
+  // potential breakpoints sorted by {file, line, bytecode position}
+  std::vector<LineEntry> potential_breaks;
+  // potential breakpoints sorted by bytecode position
+  std::vector<LineEntry> line_info;
+  // names of the files referenced by the line tables
+  std::vector<std::string> files = {};
+
+  // if set, the instructions live in this (read-only) image instead of .code
+  std::shared_ptr<const CodeImage> image = {};
+
+  /**
+   * the instructions of the program, regardless of where they are stored
+   */
+  std::span<const Instruction> instructions() const;
 
   /* disassemble the program into triplet code*/
   void disassemble(std::ostream &o);
 
+  /**
+   * translate the program into a standalone C++ source file, to be
+   * compiled into a shared object and run by NativeProgram; every PROGRAM
+   * becomes a C++ function and jumps become gotos
+   * @return false if the bytecode doesn't have the structure the compiler
+   * generates (e.g. calls without PREPARE_EXEC), nothing is written then
+   */
+  bool emitCpp(std::ostream &o);
+
+  /**
+   * check once that executing the program can't access memory outside of
+   * the VM's frames and instructions: jump and call targets, register
+   * indices against the frame sizes given by PREPARE_EXEC and the nesting
+   * of calls (see VM/src/verify.cpp)
+   */
+  VerifyResult verify() const;
+
   /**
    * get a list of available breakpoints
    */
   std::set<BreakPoint> getAvailableBreakpoints();
+
+  /**
+   * source position of the potential breakpoint at bytecode position ind
+   * @return NULL if there is no potential breakpoint at ind
+   */
+  const LineEntry *lineAt(ProgramIndex ind) const;
+
+  /**
+   * all potential breakpoints belonging to one source line
+   */
+  std::span<const LineEntry> breaksAt(const BreakPoint &bp) const;
+
+  BreakPoint toBreakPoint(const LineEntry &e) const;
+
+  /**
+   * index of a file name in .files
+   * @return -1 if the file isn't referenced by the program
+   */
+  int fileIndex(const std::string &file) const;
+
+  /**
+   * register a potential breakpoint;
+   * positions have to be added in increasing order,
+   * call sortLineTables() once all lines are added
+   */
+  void addLine(ProgramIndex ind, const std::string &file, int line);
+
+  /**
+   * rebuild .potential_breaks from .line_info
+   */
+  void sortLineTables();
+
+  /**
+   * write the program as a versioned, little-endian bytecode file;
+   * the format is documented in VM/src/bytecode.cpp
+   * @return false if the file couldn't be written
+   */
+  bool save(std::ostream &o);
+  bool save(std::string path);
+
+  /**
+   * load a bytecode file written by save();
+   * where the platform allows it, the file is mapped into memory and
+   * the instructions are executed directly from the mapping
+   */
+  static BytecodeLoadResult load(std::string path);
+};
+
+struct BytecodeLoadResult {
+  bool loaded_correctly;
+  std::string error;
+  Program program;
+};
+
+struct VerifyResult {
+  bool verified;
+  std::string error;
+  ProgramIndex position;  // of the offending instruction, -1 if none
 };
 
 }  // namespace Theo
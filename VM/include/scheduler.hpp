@@ -0,0 +1,66 @@
+#ifndef _LIBTHEO_VM_SCHEDULER_HPP_
+#define _LIBTHEO_VM_SCHEDULER_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "VM/include/execution.hpp"
+#include "VM/include/vm.hpp"
+
+namespace Theo {
+
+/**
+ * runs many VMs on one thread, round-robin: each VM executes one slice of
+ * instructions per round (or less, if it stops on a breakpoint), so that
+ * long running programs don't starve the others
+ */
+class Scheduler {
+  struct Task {
+    VM *vm;
+    Execution execution;
+  };
+
+  VM::InstructionCount slice;
+  std::vector<Task> tasks;
+
+ public:
+  /**
+   * called when a VM stops on a breakpoint;
+   * @return true to keep executing the VM, false to unschedule it
+   */
+  typedef std::function<bool(VM &)> BreakHandler;
+
+  /**
+   * @param slice number of instructions a VM executes per turn
+   */
+  Scheduler(VM::InstructionCount slice = 4096);
+
+  /**
+   * schedule a VM until its program ends; the VM must stay alive (and not
+   * be executed elsewhere) while it is scheduled
+   */
+  void add(VM &vm);
+
+  /**
+   * number of VMs still scheduled
+   */
+  std::size_t size();
+
+  /**
+   * give every scheduled VM one turn; VMs whose program ended are
+   * unscheduled
+   * @param on_break called on breakpoints, if empty VMs just continue
+   * @return number of VMs still scheduled
+   */
+  std::size_t round(const BreakHandler &on_break = nullptr);
+
+  /**
+   * execute rounds until no VM is scheduled anymore
+   */
+  void run(const BreakHandler &on_break = nullptr);
+};
+
+}  // namespace Theo
+
+#endif
@@ -1,20 +1,61 @@
 #ifndef _LIBTHEO_VM_VM_HPP_
 #define _LIBTHEO_VM_VM_HPP_
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "VM/include/analysis.hpp"
+#include "VM/include/execution.hpp"
 #include "VM/include/instr.hpp"
+#include "VM/include/layout.hpp"
+#include "VM/include/profile.hpp"
 #include "program.hpp"
 
 namespace Theo {
 
+/* a variable of a PROGRAM (or of the root script, "#root") to watch */
+struct WatchPoint {
+  std::string program;
+  std::string variable;
+  // if unset, stop whenever the variable changes, otherwise stop when it
+  // changes to this value
+  std::optional<int> value;
+};
+
+bool operator<(const WatchPoint& wp1, const WatchPoint& wp2);
+
+/**
+ * condition of a breakpoint, evaluated by the VM whenever the breakpoint is
+ * reached; execution only stops once the condition held more than
+ * ignore_count times
+ */
+struct BreakCondition {
+  enum Comparison { ALWAYS, EQ, NE, LT, LE, GT, GE };
+  Comparison cmp;
+  // variable of the program the breakpoint is in (unused for ALWAYS)
+  std::string variable;
+  // compared against this variable if not empty, against constant otherwise
+  std::string other;
+  int constant;
+  unsigned long long ignore_count;
+};
+
 class VM {
  public:
   typedef int Word, WordIndex;
+  typedef unsigned long long InstructionCount;
+
+  /* how execute() runs instructions, see setEngine() */
+  enum class Engine { SWITCH, CLOSURES };
 
   class Activation {
     VM* vm;
@@ -32,11 +73,110 @@ class VM {
    public:
     typedef std::map<std::string, Word> Data;
 
+    /**
+     * view of the variables of an activation that reads names from the
+     * stack map and values from the data segment without copying either;
+     * only valid until the VM executes further
+     */
+    class Variables {
+      const Program::StackMap* stack_map;
+      const Word* base;
+
+     public:
+      struct Variable {
+        std::string_view name;
+        RegisterIndex reg;
+        Word value;
+      };
+
+      class iterator {
+        std::map<RegisterIndex, std::string>::const_iterator entry;
+        const Word* base;
+
+        iterator(std::map<RegisterIndex, std::string>::const_iterator entry,
+                 const Word* base)
+            : entry(entry), base(base) {}
+
+       public:
+        Variable operator*() const {
+          return {entry->second, entry->first, base[entry->first]};
+        }
+        iterator& operator++() {
+          entry++;
+          return *this;
+        }
+        bool operator==(const iterator& o) const { return entry == o.entry; }
+        bool operator!=(const iterator& o) const { return entry != o.entry; }
+
+        friend class Variables;
+      };
+
+      Variables(const Program::StackMap* stack_map, const Word* base)
+          : stack_map(stack_map), base(base) {}
+
+      iterator begin() const { return {stack_map->map.begin(), base}; }
+      iterator end() const { return {stack_map->map.end(), base}; }
+      std::size_t size() const { return stack_map->map.size(); }
+
+      /**
+       * value of a variable by name
+       * @return std::nullopt if there is no such variable
+       */
+      std::optional<Word> get(std::string_view name) const;
+    };
+
+    /**
+     * get the variables of this activation without copying anything
+     */
+    Variables getVariables() const;
+
+    /**
+     * name of the PROGRAM this activation executes ("#root" for the script)
+     */
+    const std::string& getFunctionName() const;
+
     /**
      * get a list of variable names and corresponding current values
+     * (a copy, see getVariables() for a cheaper alternative)
      */
     VM::Activation::Data getActivationVariables();
 
+    friend class VM;
+    friend struct ClosureHandlers;
+  };
+
+  /* the change of a watched variable that stopped the VM */
+  struct WatchHit {
+    WatchPoint watch;
+    Word before;
+    Word after;
+  };
+
+  /* a variable that differs between a snapshot and the current state */
+  struct Change {
+    std::size_t frame;  // index into getActivations()
+    std::string_view name;
+    Word before;
+    Word after;
+  };
+
+  static const WordIndex page_size = 1024;
+  typedef std::array<Word, page_size> Page;
+
+  /**
+   * captured execution state of a VM (see snapshot());
+   * consecutive snapshots share all data pages that weren't written
+   * in between, so keeping many of them is cheap
+   */
+  class Snapshot {
+    ProgramIndex instruction_pointer;
+    InstructionCount executed;
+    std::vector<Activation> stack;
+    std::vector<std::shared_ptr<const Page>> pages;
+    WordIndex size;
+
+    Word at(WordIndex ind) const;
+
     friend class VM;
   };
 
@@ -44,10 +184,141 @@ class VM {
   bool stepping_mode_enabled;
   ProgramIndex instruction_pointer;
   Program code;
+  // instructions executed by the VM; they point either into the program's
+  // image or into patched_code once breakpoints had to be written
+  const Instruction* instructions;
+  std::shared_ptr<std::vector<Instruction>> patched_code;
   std::vector<Word> data;
   std::vector<Activation> stack;
   std::set<BreakPoint> enabled_breakpoints;
 
+  // conditional breakpoints: the condition of a line, resolved to registers
+  // for each of its BREAK instructions; hits are counted per line
+  struct BreakGuard {
+    BreakCondition::Comparison cmp;
+    RegisterIndex lhs;
+    RegisterIndex rhs;  // -1 to compare with .constant
+    Constant constant;
+    unsigned long long ignore_count;
+    // the line, its hits are kept in break_hits
+    BreakPoint bp;
+  };
+  std::map<BreakPoint, BreakCondition> break_conditions;
+  std::map<BreakPoint, unsigned long long> break_hits;
+  std::map<ProgramIndex, BreakGuard> break_guards;
+  // set while replaying for reverse execution, hits aren't counted then
+  bool replaying;
+
+  bool breakHolds(ProgramIndex ind);
+  const Layout& getLayout();
+
+  // watchpoints: the instructions writing watched variables are patched to
+  // WATCH, their original opcodes are kept in watched_ops; the registers
+  // are matched at runtime, since a frame's stack map is only known then
+  std::set<WatchPoint> enabled_watchpoints;
+  std::map<ProgramIndex, OpCode> watched_ops;
+  std::map<std::pair<StackMapIndex, RegisterIndex>, std::vector<WatchPoint>>
+      watched_registers;
+  std::optional<Layout> layout;
+  std::optional<WatchHit> last_watch;
+  InstructionCount last_watch_at;
+
+  void instrumentWatchPoints();
+  bool watched(Instruction i);
+
+  // data pages of the last snapshot taken or restored; data below
+  // dirty_from is unchanged since then (only RET writes below the top frame)
+  std::vector<std::shared_ptr<const Page>> last_pages;
+  WordIndex last_size;
+  WordIndex dirty_from;
+
+  // index of the first page that may differ from last_pages
+  WordIndex firstDirtyPage();
+  void markClean();
+
+  // number of instructions executed since the last reset
+  InstructionCount executed;
+
+  // reverse execution: checkpoints taken every checkpoint_interval
+  // instructions while recording; next_checkpoint is never reached
+  // if recording is disabled
+  struct Checkpoint {
+    Snapshot state;
+    std::size_t cost;  // approximate bytes not shared with the predecessor
+  };
+  std::vector<Checkpoint> checkpoints;
+  bool recording;
+  InstructionCount checkpoint_interval;
+  InstructionCount next_checkpoint;
+  std::size_t checkpoint_bytes;
+  std::size_t checkpoint_budget;
+
+  void checkpoint();
+  std::size_t checkpointCost(const Snapshot* prev, const Snapshot& s);
+  void thinCheckpoints();
+  void clearCheckpoints();
+  void restoreState(const Snapshot& s);
+  // replay from the latest checkpoint before the current position to find
+  // the last stop (a breakpoint, or any line if lines is true)
+  bool reverse(bool lines);
+
+  // set by interrupt() from any thread, polled by execute() every
+  // interrupt_slice instructions (accessed through std::atomic_ref, so that
+  // VMs stay copyable)
+  static const int interrupt_slice = 1024;
+  alignas(std::atomic_ref<bool>::required_alignment) bool interrupt_requested;
+  bool interrupted;
+
+  bool pollInterrupt();
+
+  // get a private, writable copy of the instructions (copy-on-write)
+  Instruction* writableCode();
+  std::size_t codeSize();
+
+  // closure engine (see VM/src/closure.cpp): every instruction translated
+  // into a handler with pre-resolved operands and absolute jump targets;
+  // cleared whenever the instructions are patched, rebuilt on demand
+  struct Closure;
+  typedef bool (*Handler)(VM& vm, const Closure* c, InstructionCount budget);
+  struct Closure {
+    Handler run;
+    int a, b, c;
+  };
+  Engine engine;
+  std::vector<Closure> closures;
+
+  void compileClosures();
+  bool closureSlice(InstructionCount n);
+
+  friend struct ClosureHandlers;
+
+  // profiling: the call path of the running activation is tracked in
+  // profile_path; execute() only takes the profiled loop when enabled
+  bool profiling;
+  Profile profile;
+  std::size_t profile_path;
+
+  void syncProfilePath();
+  bool step();
+  bool dispatch(Instruction i);
+  bool profiledStep();
+
+  // programs that passed Program::verify() are dispatched without checks,
+  // all others (and all if requested) take checkedStep(), which validates
+  // every instruction against the current frames first and stops with a
+  // fault instead of executing an invalid one
+  bool verified;
+  bool checked;
+  std::optional<std::string> fault;
+
+  bool checkedStep();
+  bool raiseFault(std::string what);
+
+  // values written into the root frame whenever it is created, by register
+  std::map<RegisterIndex, Word> inputs;
+
+  void applyInputs();
+
  public:
   VM(Program code);
 
@@ -81,6 +352,21 @@ class VM {
    */
   bool setBreakPoint(std::string file, int line, bool value);
 
+  /**
+   * enable a breakpoint that only stops execution if a condition holds;
+   * the condition is evaluated inside the VM, without returning to the host
+   * @return false if the line has no potential breakpoint or a variable of
+   * the condition doesn't exist where the line is
+   */
+  bool setConditionalBreakPoint(std::string file, int line,
+                                const BreakCondition& condition);
+
+  /**
+   * the condition of an enabled breakpoint
+   * @return std::nullopt for unconditional breakpoints
+   */
+  std::optional<BreakCondition> getBreakCondition(const BreakPoint& bp);
+
   /**
    * disable all breakpoints
    */
@@ -97,6 +383,133 @@ class VM {
    */
   void reset();
 
+  /**
+   * capture the execution state (instruction pointer, activations and
+   * memory); breakpoints and stepping mode are not part of the snapshot;
+   * only the pages written since the previous snapshot are copied
+   */
+  Snapshot snapshot();
+
+  /**
+   * return to a state captured by snapshot();
+   * the snapshot may stem from another VM executing the same program,
+   * which allows forking several continuations from a shared prefix;
+   * any references held to activations will become invalid after this call;
+   */
+  void restore(const Snapshot& s);
+
+  /**
+   * variables of the activations that were already on the stack when s
+   * was taken and changed since (e.g. since the last stop if the host takes
+   * a snapshot at every stop); activations are matched by position, the
+   * comparison stops at the first activation that was replaced
+   */
+  std::vector<Change> changedSince(const Snapshot& s);
+
+  /**
+   * number of instructions executed since construction or the last reset
+   */
+  InstructionCount getExecutedInstructions();
+
+  /**
+   * record the execution history so that it can be executed in reverse;
+   * the VM keeps checkpoints of its state at automatically spaced intervals
+   * and replays from the nearest one; execution can only be reversed up to
+   * the point where recording was enabled
+   * @param mode true enables recording
+   */
+  void setRecording(bool mode);
+
+  bool isRecordingEnabled();
+
+  /**
+   * upper bound of the memory used for checkpoints (default 64 MiB);
+   * when it is exceeded, every other checkpoint is dropped and the interval
+   * between checkpoints doubles
+   */
+  void setRecordingBudget(std::size_t bytes);
+
+  /**
+   * the reverse of a step in stepping mode: return to the previous
+   * line the VM could have stopped on
+   * @return false if there is no such line in the recorded history, the VM
+   * is then at the earliest recorded state
+   */
+  bool reverseStep();
+
+  /**
+   * the reverse of execute(): return to the last enabled breakpoint
+   * (whose condition held) or watchpoint that was hit
+   * @return false if no breakpoint was hit in the recorded history,
+   * the VM is then at the earliest recorded state
+   */
+  bool reverseContinue();
+
+  /**
+   * stop execution when a variable changes (or changes to a value);
+   * only the instructions writing the variable are instrumented, execution
+   * elsewhere isn't slowed down
+   * @return false if the program has no such variable
+   */
+  bool setWatchPoint(const WatchPoint& wp, bool value);
+
+  void clearWatchPoints();
+
+  std::set<WatchPoint>& getEnabledWatchPoints();
+
+  /**
+   * the watchpoint the VM is currently stopped on
+   * @return std::nullopt if the VM didn't stop because of a watchpoint
+   */
+  std::optional<WatchHit> getCurrentWatch();
+
+  /**
+   * set a variable of the root script (resolved through its stack map)
+   * before the script starts, so that one program can be run on many
+   * inputs without recompiling it; the value is written when the root frame
+   * is created, i.e. on the first execution after construction or reset()
+   * @return false if the root script has no such variable, or the value is
+   * negative
+   */
+  bool setInput(std::string_view name, Word value);
+
+  void clearInputs();
+
+  /**
+   * reserve the memory for the stack and data a program may use (if the
+   * analysis could bound it), so that calls never reallocate; the analysis
+   * of a program can be shared by all VMs executing it
+   */
+  void preallocate(const Analysis& a);
+
+  /**
+   * count the executed instructions per bytecode position and per call
+   * path; when disabled, execution isn't slowed down at all
+   * @param mode true enables profiling
+   */
+  void setProfiling(bool mode);
+
+  bool isProfilingEnabled();
+
+  /**
+   * the counts collected so far (see Profile for reports);
+   * they accumulate over resets until clearProfile() is called
+   */
+  const Profile& getProfile();
+
+  void clearProfile();
+
+  /**
+   * select how instructions are executed: SWITCH decodes each instruction
+   * as it is executed, CLOSURES translates the program into pre-bound
+   * handlers once (and again after breakpoints or watchpoints changed),
+   * which lowers the dispatch overhead; the results and all debugging
+   * facilities are the same, profiling always uses SWITCH
+   */
+  void setEngine(Engine e);
+
+  Engine getEngine();
+
   /**
    * executes code until it runs into BREAK or HALT;
    * upon reaching HALT, all subsequent calls to this method
@@ -104,6 +517,32 @@ class VM {
    */
   void execute();
 
+  /**
+   * execute at most n instructions, stopping early on BREAK or HALT
+   * (like execute(), but without polling for interrupts)
+   * @return true if a breakpoint or the end of the program was reached
+   */
+  bool executeSlice(InstructionCount n);
+
+  /**
+   * resumable execution that yields after every slice of instructions and
+   * on every breakpoint, ending with the program; lets a single thread
+   * interleave many VMs (see Scheduler) at no cost per instruction
+   */
+  Execution run(InstructionCount slice);
+
+  /**
+   * make a running execute() return soon (within a few thousand
+   * instructions); may be called from any thread, if the VM isn't
+   * executing, the next execute() returns early instead
+   */
+  void interrupt();
+
+  /**
+   * whether the last execute() returned because of interrupt()
+   */
+  bool wasInterrupted();
+
   /**
    * execute a single instruction and return;
    * use this method if you want to control the interpreter
@@ -120,9 +559,31 @@ class VM {
 
   /**
    * query if the VM has reached the end of the program
-   * @return true if the end has been reached
+   * @return true if the end has been reached, or execution stopped with a
+   * fault
    */
   bool isDone();
+
+  /**
+   * whether the program passed Program::verify() when the VM was created;
+   * unverified programs are executed with a check before every instruction
+   */
+  bool isVerified();
+
+  /**
+   * check every instruction before executing it, also if the program was
+   * verified (slower, see isVerified())
+   * @param value false returns to unchecked execution, unless the program
+   * wasn't verified
+   */
+  void setCheckedExecution(bool value);
+
+  /**
+   * the reason execution stopped before an invalid instruction of an
+   * unverified program (the instruction isn't executed)
+   * @return std::nullopt if there was none since the last reset
+   */
+  std::optional<std::string> getFault();
 };
 
 }  // namespace Theo
@@ -0,0 +1,258 @@
+#include "VM/include/analysis.hpp"
+
+#include <algorithm>
+#include <functional>
+
+/**
+ * termination: the control flow graph of a function is searched for cycles
+ * after removing the back edges of counted loops, as generated for LOOP:
+ *   s:     JMPC  j + 1, c      exit when the counter is 0
+ *          ...                 body, doesn't write c
+ *   j - 1: ADD_CONST c, c, -k
+ *   j:     JMP   s
+ * where control only enters the loop at s and only leaves it for j + 1 (or
+ * by RET, HALT or a tail call); counted loops are then properly nested, every
+ * remaining cycle goes through the back edge of the innermost loop
+ * containing it, whose counter it strictly decreases, so the function ends
+ * unless a function it calls doesn't
+ */
+
+using namespace Theo;
+
+namespace {
+
+// successors of an instruction within its function, false for an invalid
+// opcode
+bool successors(std::span<const Instruction> code, ProgramIndex ind,
+                std::vector<ProgramIndex> &next) {
+  const Instruction &i = code[ind];
+  next.clear();
+  switch (i.op) {
+    case OpCode::HALT:
+    case OpCode::RET:
+    case OpCode::TAIL_EXEC:
+      return true;
+    case OpCode::JMP:
+      next.push_back(ind + i.parameters.jmp.offset);
+      return true;
+    case OpCode::JMPC:
+      next.push_back(ind + 1);
+      next.push_back(ind + i.parameters.jmpc.offset);
+      return true;
+    case OpCode::POTENTIAL_BREAK:
+    case OpCode::BREAK:
+    case OpCode::ADD_CONST:
+    case OpCode::TEST:
+    case OpCode::CONST:
+    case OpCode::PREPARE_EXEC:
+    case OpCode::ARG:
+    // returns to the next instruction
+    case OpCode::EXEC:
+      next.push_back(ind + 1);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// the register of the current frame an instruction writes, -1 if none
+RegisterIndex written(const Instruction &i) {
+  switch (i.op) {
+    case OpCode::ADD_CONST:
+      return i.parameters.add.target;
+    case OpCode::TEST:
+      return i.parameters.test.target;
+    case OpCode::CONST:
+      return i.parameters.constant.target;
+    // written by the RET of the callee
+    case OpCode::PREPARE_EXEC:
+      return i.parameters.prepare.target;
+    default:
+      return -1;
+  }
+}
+
+// whether all loops of function f are counted loops
+bool loopOnly(std::span<const Instruction> code, const Layout &l, int f) {
+  const ProgramIndex size = code.size();
+  std::vector<ProgramIndex> owned = {};
+  for (ProgramIndex ind = 0; ind < size; ind++) {
+    if (l.owner[ind] == f) owned.push_back(ind);
+  }
+
+  // all edges of the function, control never leaves it except by calls
+  std::vector<std::pair<ProgramIndex, ProgramIndex>> edges = {};
+  std::vector<ProgramIndex> next = {};
+  for (ProgramIndex ind : owned) {
+    if (!successors(code, ind, next)) return false;
+    for (ProgramIndex n : next) {
+      if (n < 0 || n >= size || l.owner[n] != f) return false;
+      edges.push_back({ind, n});
+    }
+  }
+
+  auto counted = [&](ProgramIndex j) {
+    const Instruction &jmp = code[j];
+    if (jmp.op != OpCode::JMP || jmp.parameters.jmp.offset > -2) return false;
+    ProgramIndex s = j + jmp.parameters.jmp.offset;
+    const Instruction &test = code[s];
+    if (test.op != OpCode::JMPC || s + test.parameters.jmpc.offset != j + 1)
+      return false;
+    RegisterIndex c = test.parameters.jmpc.source;
+    const Instruction &dec = code[j - 1];
+    if (dec.op != OpCode::ADD_CONST || dec.parameters.add.target != c ||
+        dec.parameters.add.source != c || dec.parameters.add.constant >= 0)
+      return false;
+    for (ProgramIndex ind = s; ind <= j; ind++) {
+      if (l.owner[ind] != f) return false;
+      if (ind != j - 1 && written(code[ind]) == c) return false;
+    }
+    auto inside = [s, j](ProgramIndex ind) { return ind >= s && ind <= j; };
+    for (auto [from, to] : edges) {
+      // entered only at s, left only for j + 1
+      if (!inside(from) && inside(to) && to != s) return false;
+      if (inside(from) && !inside(to) && to != j + 1) return false;
+    }
+    return true;
+  };
+
+  // the remaining graph must be acyclic
+  std::vector<std::vector<ProgramIndex>> succ(size);
+  for (auto [from, to] : edges) {
+    if (from > to && code[from].op == OpCode::JMP && counted(from)) continue;
+    succ[from].push_back(to);
+  }
+  enum Color { WHITE, GREY, BLACK };
+  std::vector<Color> color(size, WHITE);
+  for (ProgramIndex root : owned) {
+    if (color[root] != WHITE) continue;
+    // positions with the index of the next successor to visit
+    std::vector<std::pair<ProgramIndex, std::size_t>> path = {{root, 0}};
+    color[root] = GREY;
+    while (!path.empty()) {
+      auto &[ind, k] = path.back();
+      if (k == succ[ind].size()) {
+        color[ind] = BLACK;
+        path.pop_back();
+        continue;
+      }
+      ProgramIndex n = succ[ind][k++];
+      if (color[n] == GREY) return false;
+      if (color[n] == WHITE) {
+        color[n] = GREY;
+        path.push_back({n, 0});
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool Analysis::terminates() const {
+  return !this->functions.empty() && this->functions[0].terminates;
+}
+
+Analysis Analysis::analyze(const Program &p) {
+  std::span<const Instruction> code = p.instructions();
+  Analysis a = {
+      .functions = {}, .max_depth = std::nullopt, .max_data = std::nullopt};
+  Layout l = Layout::analyze(code);
+  const int count = l.functions.size();
+
+  // calls that can't be followed, their callee is unknown
+  std::vector<bool> malformed(count, false);
+  for (int f = 0; f < count; f++) {
+    const Layout::Function &lf = l.functions[f];
+    std::string name = f == 0 ? "#root" : "";
+    StackMapIndex m = lf.stack_map;
+    if (m >= 0 && m < (StackMapIndex)p.stack_maps.size())
+      name = p.stack_maps[m].func_name;
+    a.functions.push_back({.name = name,
+                           .entry = lf.entry,
+                           .frame_size = lf.frame_size,
+                           .callees = {},
+                           .recursive = false,
+                           .loop_only = loopOnly(code, l, f),
+                           .terminates = false});
+  }
+  for (auto &c : l.calls) {
+    Function &caller = a.functions[c.caller];
+    if (c.prepare == -1 || c.callee == -1) {
+      malformed[c.caller] = true;
+      continue;
+    }
+    Function &callee = a.functions[c.callee];
+    callee.frame_size = std::max(callee.frame_size,
+                                 code[c.prepare].parameters.prepare.count);
+    auto &cs = caller.callees;
+    if (std::find(cs.begin(), cs.end(), c.callee) == cs.end())
+      cs.push_back(c.callee);
+  }
+
+  // recursion: a function reachable from one of its callees
+  for (int f = 0; f < count; f++) {
+    std::vector<bool> seen(count, false);
+    std::vector<int> todo = a.functions[f].callees;
+    while (!todo.empty() && !a.functions[f].recursive) {
+      int g = todo.back();
+      todo.pop_back();
+      if (seen[g]) continue;
+      seen[g] = true;
+      a.functions[f].recursive = g == f;
+      for (int h : a.functions[g].callees) todo.push_back(h);
+    }
+  }
+
+  // termination: without recursion, the call graph is acyclic and the
+  // fixpoint is reached after at most count rounds
+  for (int f = 0; f < count; f++) {
+    Function &fn = a.functions[f];
+    fn.terminates = fn.loop_only && !fn.recursive && !malformed[f];
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &fn : a.functions) {
+      if (!fn.terminates) continue;
+      for (int g : fn.callees) fn.terminates &= a.functions[g].terminates;
+      changed |= !fn.terminates;
+    }
+  }
+
+  // bounds: only without recursion
+  for (int f = 0; f < count; f++) {
+    if (a.functions[f].recursive || malformed[f]) return a;
+  }
+  if (count == 0) return a;
+  // words and activations from the start of a function's frame on, while
+  // it (or what replaces its frame by tail calls) runs
+  std::vector<std::optional<std::pair<std::size_t, std::size_t>>> memo(count);
+  std::function<std::pair<std::size_t, std::size_t>(int)> need =
+      [&](int f) -> std::pair<std::size_t, std::size_t> {
+    if (memo[f]) return *memo[f];
+    std::size_t frame = std::max(a.functions[f].frame_size, 0);
+    std::size_t data = frame, depth = 1;
+    for (auto &c : l.calls) {
+      if (c.caller != f) continue;
+      auto [callee_data, callee_depth] = need(c.callee);
+      std::size_t prepared = code[c.prepare].parameters.prepare.count;
+      if (c.prepare == 0) {
+        // called on the root frame
+        data = std::max(data, callee_data);
+        depth = std::max(depth, callee_depth);
+      } else if (c.tail) {
+        data = std::max({data, frame + prepared, callee_data});
+        depth = std::max({depth, (std::size_t)2, callee_depth});
+      } else {
+        data = std::max(data, frame + callee_data);
+        depth = std::max(depth, 1 + callee_depth);
+      }
+    }
+    memo[f] = {data, depth};
+    return *memo[f];
+  };
+  auto [data, depth] = need(0);
+  a.max_data = data;
+  a.max_depth = depth;
+  return a;
+}
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "VM/include/program.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define THEO_BYTECODE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Bytecode container format (version 1), all integers little-endian:
+ *
+ * header (96 bytes):
+ *   char[8] magic        "THEOBC\0\n"
+ *   u32     version
+ *   u32     instruction size (16)
+ *   u64     offset, count of the instruction section
+ *   u64     offset, count of the string table
+ *   u64     offset, count of the stack map section
+ *   u64     offset, count of the line table
+ *   u64     offset, count of the breakpoint table
+ *
+ * instruction section (offset 96, 16 byte aligned):
+ *   i32 opcode, i32 p0, i32 p1, i32 p2   (the parameter union as three ints)
+ * string table:
+ *   u32 length, followed by length bytes
+ * stack maps:
+ *   u32 name, u32 n, followed by n times: i32 register, u32 variable name
+ * line table (sorted by bytecode position):
+ *   i32 position, u32 file, i32 line
+ * breakpoint table (the line table sorted by file, line, position):
+ *   u32 file, i32 line, i32 position
+ *
+ * String references are indices into the string table. On little-endian
+ * hosts the instruction section has the same layout as Theo::Instruction,
+ * which allows executing it straight from a memory mapping.
+ */
+
+using namespace Theo;
+
+static const char bytecode_magic[8] = {'T', 'H', 'E', 'O', 'B', 'C', '\0', '\n'};
+static const std::uint32_t bytecode_version = 1;
+static const std::size_t header_size = 96;
+static const std::size_t instruction_size = 16;
+
+static const bool zero_copy_layout =
+    std::endian::native == std::endian::little &&
+    sizeof(Instruction) == instruction_size && sizeof(OpCode) == 4;
+
+struct Writer {
+  std::string out;
+
+  void u32(std::uint32_t v) {
+    for (int b = 0; b < 4; b++) out.push_back((char)((v >> (8 * b)) & 0xff));
+  }
+  void i32(std::int32_t v) { u32((std::uint32_t)v); }
+  void u64(std::uint64_t v) {
+    u32((std::uint32_t)(v & 0xffffffff));
+    u32((std::uint32_t)(v >> 32));
+  }
+  void patch64(std::size_t at, std::uint64_t v) {
+    for (int b = 0; b < 8; b++) out[at + b] = (char)((v >> (8 * b)) & 0xff);
+  }
+  void align(std::size_t to) {
+    while (out.size() % to != 0) out.push_back('\0');
+  }
+};
+
+struct Reader {
+  const unsigned char *bytes;
+  std::size_t size;
+  std::size_t pos;
+  bool ok = true;
+
+  bool need(std::size_t n) {
+    if (!ok || n > size || pos > size - n) ok = false;
+    return ok;
+  }
+  std::uint32_t u32() {
+    if (!need(4)) return 0;
+    std::uint32_t v = 0;
+    for (int b = 0; b < 4; b++) v |= (std::uint32_t)bytes[pos + b] << (8 * b);
+    pos += 4;
+    return v;
+  }
+  std::int32_t i32() { return (std::int32_t)u32(); }
+  std::uint64_t u64() {
+    std::uint64_t lo = u32();
+    std::uint64_t hi = u32();
+    return lo | (hi << 32);
+  }
+  std::string str(std::size_t n) {
+    if (!need(n)) return "";
+    std::string s((const char *)bytes + pos, n);
+    pos += n;
+    return s;
+  }
+};
+
+static void encode(const Instruction &i, std::int32_t (&p)[3]) {
+  static_assert(sizeof(i.parameters) == sizeof(p));
+  std::memcpy(p, &i.parameters, sizeof(p));
+}
+
+static Instruction decode(std::int32_t op, const std::int32_t (&p)[3]) {
+  Instruction i;
+  i.op = (OpCode)op;
+  std::memcpy(&i.parameters, p, sizeof(p));
+  return i;
+}
+
+bool Program::save(std::ostream &o) {
+  std::vector<std::string> strings = {};
+  std::map<std::string, std::uint32_t> string_ids = {};
+  auto intern = [&](const std::string &s) -> std::uint32_t {
+    auto itr = string_ids.find(s);
+    if (itr != string_ids.end()) return itr->second;
+    strings.push_back(s);
+    return string_ids[s] = strings.size() - 1;
+  };
+
+  Writer w;
+  w.out.append(bytecode_magic, sizeof(bytecode_magic));
+  w.u32(bytecode_version);
+  w.u32(instruction_size);
+  w.align(header_size);  // section table is patched in below
+
+  std::span<const Instruction> code = this->instructions();
+  std::size_t code_offset = w.out.size();
+  for (const Instruction &i : code) {
+    std::int32_t p[3];
+    encode(i, p);
+    w.i32((std::int32_t)i.op);
+    for (auto v : p) w.i32(v);
+  }
+
+  // intern all strings before the string table is written
+  for (auto &sm : this->stack_maps) {
+    intern(sm.func_name);
+    for (auto &e : sm.map) intern(e.second);
+  }
+  for (auto &f : this->files) intern(f);
+
+  std::size_t strings_offset = w.out.size();
+  for (auto &s : strings) {
+    w.u32(s.size());
+    w.out.append(s);
+  }
+  w.align(8);
+
+  std::size_t maps_offset = w.out.size();
+  for (auto &sm : this->stack_maps) {
+    w.u32(intern(sm.func_name));
+    w.u32(sm.map.size());
+    for (auto &e : sm.map) {
+      w.i32(e.first);
+      w.u32(intern(e.second));
+    }
+  }
+
+  std::size_t lines_offset = w.out.size();
+  for (auto &l : this->line_info) {
+    w.i32(l.index);
+    w.u32(intern(this->files[l.file]));
+    w.i32(l.line);
+  }
+
+  std::size_t breaks_offset = w.out.size();
+  for (auto &b : this->potential_breaks) {
+    w.u32(intern(this->files[b.file]));
+    w.i32(b.line);
+    w.i32(b.index);
+  }
+
+  w.patch64(16, code_offset);
+  w.patch64(24, code.size());
+  w.patch64(32, strings_offset);
+  w.patch64(40, strings.size());
+  w.patch64(48, maps_offset);
+  w.patch64(56, this->stack_maps.size());
+  w.patch64(64, lines_offset);
+  w.patch64(72, this->line_info.size());
+  w.patch64(80, breaks_offset);
+  w.patch64(88, this->potential_breaks.size());
+
+  o.write(w.out.data(), w.out.size());
+  return o.good();
+}
+
+bool Program::save(std::string path) {
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  if (!f.is_open()) return false;
+  return this->save(f);
+}
+
+#ifdef THEO_BYTECODE_MMAP
+struct MappedImage : CodeImage {
+  void *mapping;
+  std::size_t length;
+
+  ~MappedImage() override { munmap(this->mapping, this->length); }
+};
+#endif
+
+static BytecodeLoadResult fail(std::string msg) {
+  return {.loaded_correctly = false, .error = msg, .program = {}};
+}
+
+static BytecodeLoadResult parse(const unsigned char *bytes, std::size_t size,
+                                bool keep_code) {
+  Reader r = {bytes, size, 0};
+  Program p = {};
+
+  if (size < header_size ||
+      std::memcmp(bytes, bytecode_magic, sizeof(bytecode_magic)) != 0)
+    return fail("not a theo bytecode file");
+  r.pos = sizeof(bytecode_magic);
+  std::uint32_t version = r.u32();
+  if (version != bytecode_version)
+    return fail("unsupported bytecode version " + std::to_string(version));
+  if (r.u32() != instruction_size) return fail("unsupported instruction size");
+
+  std::uint64_t code_offset = r.u64(), code_count = r.u64(),
+                strings_offset = r.u64(), strings_count = r.u64(),
+                maps_offset = r.u64(), maps_count = r.u64(),
+                lines_offset = r.u64(), lines_count = r.u64(),
+                breaks_offset = r.u64(), breaks_count = r.u64();
+
+  if (code_offset % instruction_size != 0 || code_offset > size ||
+      code_count > (size - code_offset) / instruction_size)
+    return fail("instruction section exceeds file");
+
+  r.pos = code_offset;
+  // the positions breakpoints may be written to
+  std::vector<bool> breakable(code_count, false);
+  for (std::uint64_t k = 0; k < code_count; k++) {
+    std::int32_t op = r.i32();
+    if (op < (std::int32_t)OpCode::POTENTIAL_BREAK ||
+        op > (std::int32_t)OpCode::TAIL_EXEC)
+      return fail("invalid opcode at position " + std::to_string(k));
+    breakable[k] = op == (std::int32_t)OpCode::POTENTIAL_BREAK ||
+                   op == (std::int32_t)OpCode::BREAK;
+    std::int32_t params[3] = {r.i32(), r.i32(), r.i32()};
+    if (keep_code) p.code.push_back(decode(op, params));
+  }
+
+  std::vector<std::string> strings = {};
+  r.pos = strings_offset;
+  for (std::uint64_t k = 0; k < strings_count && r.ok; k++)
+    strings.push_back(r.str(r.u32()));
+  if (!r.ok) return fail("string table exceeds file");
+
+  bool strings_ok = true;
+  auto string = [&](std::uint32_t ind) -> std::string {
+    if (ind >= strings.size()) {
+      strings_ok = false;
+      return "";
+    }
+    return strings[ind];
+  };
+
+  r.pos = maps_offset;
+  for (std::uint64_t k = 0; k < maps_count && r.ok; k++) {
+    Program::StackMap sm;
+    sm.func_name = string(r.u32());
+    std::uint32_t entries = r.u32();
+    for (std::uint32_t e = 0; e < entries && r.ok; e++) {
+      RegisterIndex reg = r.i32();
+      sm.map[reg] = string(r.u32());
+    }
+    p.stack_maps.push_back(sm);
+  }
+
+  // file names are numbered in order of appearance in the line table
+  std::map<std::uint32_t, int> file_ids = {};
+  auto file = [&](std::uint32_t ind) -> int {
+    auto itr = file_ids.find(ind);
+    if (itr != file_ids.end()) return itr->second;
+    p.files.push_back(string(ind));
+    return file_ids[ind] = p.files.size() - 1;
+  };
+
+  r.pos = lines_offset;
+  for (std::uint64_t k = 0; k < lines_count && r.ok; k++) {
+    ProgramIndex ind = r.i32();
+    int f = file(r.u32());
+    p.line_info.push_back({.index = ind, .file = f, .line = r.i32()});
+  }
+
+  r.pos = breaks_offset;
+  for (std::uint64_t k = 0; k < breaks_count && r.ok; k++) {
+    int f = file(r.u32());
+    int line = r.i32();
+    p.potential_breaks.push_back({.index = r.i32(), .file = f, .line = line});
+  }
+
+  if (!r.ok) return fail("debug information exceeds file");
+  if (!strings_ok) return fail("invalid string reference");
+
+  auto by_index = [](const Program::LineEntry &e1,
+                     const Program::LineEntry &e2) -> bool {
+    return e1.index < e2.index;
+  };
+  if (!std::is_sorted(p.line_info.begin(), p.line_info.end(), by_index) ||
+      p.potential_breaks.size() != p.line_info.size())
+    return fail("malformed line table");
+  // breakpoints are set by writing to the positions of the entries
+  for (auto *table : {&p.line_info, &p.potential_breaks}) {
+    for (auto &e : *table) {
+      if (e.index < 0 || (std::uint64_t)e.index >= code_count ||
+          e.file < 0 || e.file >= (int)p.files.size())
+        return fail("line table entry outside of the program");
+      if (!breakable[e.index])
+        return fail("line table entry at position " +
+                    std::to_string(e.index) + " isn't a potential break");
+    }
+  }
+  // file numbering may differ from the writer's, restore the table order
+  p.sortLineTables();
+
+  return {.loaded_correctly = true, .error = "", .program = p};
+}
+
+BytecodeLoadResult Program::load(std::string path) {
+#ifdef THEO_BYTECODE_MMAP
+  if (zero_copy_layout) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail("couldn't open '" + path + "'");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return fail("couldn't read '" + path + "'");
+    }
+    std::size_t length = st.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return fail("couldn't map '" + path + "'");
+
+    auto image = std::make_shared<MappedImage>();
+    image->mapping = mapping;
+    image->length = length;
+
+    BytecodeLoadResult res =
+        parse((const unsigned char *)mapping, length, false);
+    if (!res.loaded_correctly) return res;
+
+    std::uint64_t code_offset = 0, code_count = 0;
+    std::memcpy(&code_offset, (const char *)mapping + 16, 8);
+    std::memcpy(&code_count, (const char *)mapping + 24, 8);
+    image->instructions =
+        (const Instruction *)((const char *)mapping + code_offset);
+    image->size = code_count;
+    res.program.image = image;
+    return res;
+  }
+#endif
+  std::ifstream f(path, std::ios::binary);
+  if (!f.is_open()) return fail("couldn't open '" + path + "'");
+  std::vector<unsigned char> buf((std::istreambuf_iterator<char>(f)),
+                                 std::istreambuf_iterator<char>());
+  return parse(buf.data(), buf.size(), true);
+}
+
+std::span<const Instruction> Program::instructions() const {
+  if (this->image)
+    return std::span<const Instruction>(this->image->instructions,
+                                        this->image->size);
+  return std::span<const Instruction>(this->code);
+}
@@ -0,0 +1,279 @@
+#include <algorithm>
+
+#include "VM/include/vm.hpp"
+
+/**
+ * closure engine: the instructions are translated into an array of
+ * closures, a handler per opcode plus its operands, with jump targets and
+ * return addresses already resolved to absolute positions;
+ *
+ * each handler executes its instruction and either returns true (the VM
+ * stops) or continues with the closure at the new instruction pointer:
+ * where the compiler guarantees tail calls ([[clang::musttail]]), handlers
+ * chain into each other until the budget of instructions is used up,
+ * otherwise they return to a trampoline loop after every instruction
+ */
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define THEO_MUSTTAIL [[clang::musttail]]
+#endif
+#endif
+
+#ifdef THEO_MUSTTAIL
+#define THEO_CONTINUE(vm, budget)                                 \
+  do {                                                            \
+    if (--budget == 0) return false;                              \
+    const VM::Closure *next = &vm.closures[vm.instruction_pointer]; \
+    THEO_MUSTTAIL return next->run(vm, next, budget);             \
+  } while (0)
+#else
+#define THEO_CONTINUE(vm, budget) return ((void)budget, false)
+#endif
+
+using namespace Theo;
+
+namespace Theo {
+
+struct ClosureHandlers {
+  typedef VM::Closure Closure;
+  typedef VM::InstructionCount InstructionCount;
+
+  static VM::Word &reg(VM &vm, RegisterIndex r) {
+    return vm.data[vm.stack.back().data_start + r];
+  }
+
+  static bool potentialBreak(VM &vm, [[maybe_unused]] const Closure *c,
+                             InstructionCount budget) {
+    vm.executed++;
+    vm.instruction_pointer++;
+    if (vm.stepping_mode_enabled) return true;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: position of the BREAK
+  static bool breakpoint(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    vm.instruction_pointer++;
+    if (vm.stepping_mode_enabled || vm.break_guards.empty()) return true;
+    if (vm.breakHolds(c->a)) return true;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  static bool halt(VM &vm, [[maybe_unused]] const Closure *c,
+                   [[maybe_unused]] InstructionCount budget) {
+    // HALT isn't counted, it is executed again whenever the VM is resumed
+    vm.last_watch = std::nullopt;
+    return true;
+  }
+
+  // a: target, b: source, c: constant
+  static bool add(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    reg(vm, c->a) = std::max(reg(vm, c->b) + c->c, 0);
+    vm.instruction_pointer++;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: target, b: op1, c: op2
+  static bool test(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    reg(vm, c->a) = reg(vm, c->b) == reg(vm, c->c) ? 0 : 1;
+    vm.instruction_pointer++;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: target, b: constant
+  static bool constant(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    reg(vm, c->a) = c->b;
+    vm.instruction_pointer++;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: absolute target
+  static bool jmp(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    vm.instruction_pointer = c->a;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: absolute target, b: source, c: the next position
+  static bool jmpc(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    vm.instruction_pointer = reg(vm, c->b) == 0 ? c->a : c->c;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: count, b: stack map, c: return target
+  static bool prepare(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    VM::WordIndex start = vm.data.size();
+    vm.data.resize(start + c->a, 0);
+    vm.stack.push_back(VM::Activation(&vm, start, c->a, c->c, -1, c->b));
+    if (vm.stack.size() == 1) vm.applyInputs();
+    vm.instruction_pointer++;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: target, b: source
+  static bool arg(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    VM::WordIndex source = (vm.stack.end() - 2)->data_start;
+    vm.data[vm.stack.back().data_start + c->a] = vm.data[source + c->b];
+    vm.instruction_pointer++;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: entry, b: return address
+  static bool exec(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    vm.stack.back().ret_addr = c->b;
+    vm.instruction_pointer = c->a;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: source
+  static bool ret(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    VM::Activation &callee = vm.stack.back();
+    VM::WordIndex target = (vm.stack.end() - 2)->data_start;
+    vm.data[target + callee.ret_target] = vm.data[callee.data_start + c->a];
+    if (target < vm.dirty_from) vm.dirty_from = target;
+    vm.instruction_pointer = callee.ret_addr;
+    vm.data.resize(callee.data_start);
+    vm.stack.pop_back();
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // a: entry
+  static bool tailExec(VM &vm, const Closure *c, InstructionCount budget) {
+    vm.executed++;
+    VM::Activation callee = vm.stack.back();
+    vm.stack.pop_back();
+    VM::Activation &frame = vm.stack.back();
+    auto from = vm.data.begin() + callee.data_start;
+    std::copy(from, from + callee.seg_size, vm.data.begin() + frame.data_start);
+    vm.data.resize(frame.data_start + callee.seg_size);
+    frame.seg_size = callee.seg_size;
+    frame.debug_info = callee.debug_info;
+    if (frame.data_start < vm.dirty_from) vm.dirty_from = frame.data_start;
+    vm.instruction_pointer = c->a;
+    THEO_CONTINUE(vm, budget);
+  }
+
+  // instrumented instructions take the regular path
+  static bool watch(VM &vm, [[maybe_unused]] const Closure *c,
+                    InstructionCount budget) {
+    vm.executed++;
+    if (vm.watched(vm.instructions[vm.instruction_pointer])) return true;
+    THEO_CONTINUE(vm, budget);
+  }
+};
+
+}  // namespace Theo
+
+void VM::setEngine(Engine e) { this->engine = e; }
+
+VM::Engine VM::getEngine() { return this->engine; }
+
+void VM::compileClosures() {
+  std::span<const Instruction> code(this->instructions, this->codeSize());
+  this->closures.resize(code.size());
+  for (std::size_t ind = 0; ind < code.size(); ind++) {
+    const Instruction &i = code[ind];
+    Closure &c = this->closures[ind];
+    c = {.run = NULL, .a = 0, .b = 0, .c = 0};
+    switch (i.op) {
+      case OpCode::POTENTIAL_BREAK:
+        c.run = ClosureHandlers::potentialBreak;
+        break;
+      case OpCode::BREAK:
+        c.run = ClosureHandlers::breakpoint;
+        c.a = ind;
+        break;
+      case OpCode::HALT:
+        c.run = ClosureHandlers::halt;
+        break;
+      case OpCode::ADD_CONST:
+        c.run = ClosureHandlers::add;
+        c.a = i.parameters.add.target;
+        c.b = i.parameters.add.source;
+        c.c = i.parameters.add.constant;
+        break;
+      case OpCode::TEST:
+        c.run = ClosureHandlers::test;
+        c.a = i.parameters.test.target;
+        c.b = i.parameters.test.op1;
+        c.c = i.parameters.test.op2;
+        break;
+      case OpCode::CONST:
+        c.run = ClosureHandlers::constant;
+        c.a = i.parameters.constant.target;
+        c.b = i.parameters.constant.constant;
+        break;
+      case OpCode::JMP:
+        c.run = ClosureHandlers::jmp;
+        c.a = ind + i.parameters.jmp.offset;
+        break;
+      case OpCode::JMPC:
+        c.run = ClosureHandlers::jmpc;
+        c.a = ind + i.parameters.jmpc.offset;
+        c.b = i.parameters.jmpc.source;
+        c.c = ind + 1;
+        break;
+      case OpCode::PREPARE_EXEC:
+        c.run = ClosureHandlers::prepare;
+        c.a = i.parameters.prepare.count;
+        c.b = i.parameters.prepare.index;
+        c.c = i.parameters.prepare.target;
+        break;
+      case OpCode::ARG:
+        c.run = ClosureHandlers::arg;
+        c.a = i.parameters.arg.target;
+        c.b = i.parameters.arg.source;
+        break;
+      case OpCode::EXEC:
+        c.run = ClosureHandlers::exec;
+        c.a = i.parameters.exec.entry;
+        c.b = ind + 1;
+        break;
+      case OpCode::RET:
+        c.run = ClosureHandlers::ret;
+        c.a = i.parameters.ret.source;
+        break;
+      case OpCode::TAIL_EXEC:
+        c.run = ClosureHandlers::tailExec;
+        c.a = i.parameters.exec.entry;
+        break;
+      case OpCode::WATCH:
+        c.run = ClosureHandlers::watch;
+        break;
+    }
+  }
+}
+
+bool VM::closureSlice(InstructionCount n) {
+  if (this->closures.empty()) this->compileClosures();
+
+  while (n > 0) {
+    // handlers don't take checkpoints, the budget ends where one is due
+    if (this->executed == this->next_checkpoint) this->checkpoint();
+    InstructionCount budget =
+        std::min(n, this->next_checkpoint - this->executed);
+    if (budget == 0) budget = n;
+
+    InstructionCount before = this->executed;
+#ifdef THEO_MUSTTAIL
+    const Closure *c = &this->closures[this->instruction_pointer];
+    if (c->run(*this, c, budget)) return true;
+#else
+    for (InstructionCount k = 0; k < budget; k++) {
+      const Closure *c = &this->closures[this->instruction_pointer];
+      if (c->run(*this, c, 1)) return true;
+    }
+#endif
+    n -= this->executed - before;
+  }
+  return false;
+}
@@ -56,6 +56,10 @@ Instruction Instruction::Exec(ProgramIndex entry) {
   return {.op = OpCode::EXEC, .parameters = {.exec = {.entry = entry}}};
 }
 
+Instruction Instruction::TailExec(ProgramIndex entry) {
+  return {.op = OpCode::TAIL_EXEC, .parameters = {.exec = {.entry = entry}}};
+}
+
 Instruction Instruction::Ret(RegisterIndex source) {
   return {.op = OpCode::RET, .parameters = {.ret = {.source = source}}};
 }
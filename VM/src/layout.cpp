@@ -0,0 +1,84 @@
+#include "VM/include/layout.hpp"
+
+using namespace Theo;
+
+int Layout::functionAt(ProgramIndex entry) const {
+  for (std::size_t f = 0; f < this->functions.size(); f++) {
+    if (this->functions[f].entry == entry) return f;
+  }
+  return -1;
+}
+
+Layout Layout::analyze(std::span<const Instruction> code) {
+  Layout l = {.functions = {}, .owner = {}, .calls = {}};
+  l.owner.assign(code.size(), -1);
+  if (code.empty()) return l;
+
+  auto in_range = [&code](ProgramIndex ind) -> bool {
+    return ind >= 0 && ind < (ProgramIndex)code.size();
+  };
+
+  // the root frame is prepared by the first instruction
+  Function root = {.entry = 0, .stack_map = -1, .frame_size = 0};
+  if (code[0].op == OpCode::PREPARE_EXEC) {
+    root.stack_map = code[0].parameters.prepare.index;
+    root.frame_size = code[0].parameters.prepare.count;
+  }
+  l.functions.push_back(root);
+
+  // functions are discovered while the previous ones are traversed
+  for (std::size_t f = 0; f < l.functions.size(); f++) {
+    std::vector<ProgramIndex> todo = {l.functions[f].entry};
+    while (!todo.empty()) {
+      ProgramIndex ind = todo.back();
+      todo.pop_back();
+      if (!in_range(ind) || l.owner[ind] != -1) continue;
+      l.owner[ind] = f;
+
+      const Instruction &i = code[ind];
+      switch (i.op) {
+        case OpCode::HALT:
+        case OpCode::RET:
+          break;
+        case OpCode::JMP:
+          todo.push_back(ind + i.parameters.jmp.offset);
+          break;
+        case OpCode::JMPC:
+          todo.push_back(ind + 1);
+          todo.push_back(ind + i.parameters.jmpc.offset);
+          break;
+        case OpCode::EXEC:
+        case OpCode::TAIL_EXEC: {
+          ProgramIndex prep = ind - 1;
+          while (prep >= 0 && code[prep].op == OpCode::ARG) prep--;
+          if (prep < 0 || code[prep].op != OpCode::PREPARE_EXEC) prep = -1;
+
+          ProgramIndex entry = i.parameters.exec.entry;
+          int callee = l.functionAt(entry);
+          if (callee == -1 && in_range(entry)) {
+            callee = l.functions.size();
+            l.functions.push_back(
+                {.entry = entry,
+                 .stack_map =
+                     prep == -1 ? -1 : code[prep].parameters.prepare.index,
+                 .frame_size =
+                     prep == -1 ? 0 : code[prep].parameters.prepare.count});
+          }
+          l.calls.push_back({.prepare = prep,
+                             .exec = ind,
+                             .caller = (int)f,
+                             .callee = callee,
+                             .tail = i.op == OpCode::TAIL_EXEC});
+          // the call returns to the next instruction, a tail call never
+          // returns here
+          if (i.op == OpCode::EXEC) todo.push_back(ind + 1);
+          break;
+        }
+        default:
+          todo.push_back(ind + 1);
+          break;
+      }
+    }
+  }
+  return l;
+}
@@ -0,0 +1,246 @@
+#include "VM/include/lockstep.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace Theo;
+
+LockstepVM::LockstepVM(Program code) {
+  this->code = code;
+  this->verified = this->code.verify().verified;
+}
+
+bool LockstepVM::isVerified() { return this->verified; }
+
+LockstepVM::Result LockstepVM::run(const std::vector<Inputs> &inputs) const {
+  Result res = {.ran = false, .error = "", .runs = {}};
+  if (!this->verified) {
+    res.error = "the program couldn't be verified";
+    return res;
+  }
+
+  // verified programs start by preparing the root frame
+  const Instruction &root = this->code.instructions()[0];
+  std::map<std::string_view, RegisterIndex> registers = {};
+  for (auto &v : this->code.stack_maps[root.parameters.prepare.index].map)
+    registers[v.second] = v.first;
+
+  res.runs.resize(inputs.size());
+  for (std::size_t chunk = 0; chunk < inputs.size(); chunk += width) {
+    std::size_t lanes = std::min(width, inputs.size() - chunk);
+    std::vector<Binding> bindings = {};
+    for (std::size_t l = 0; l < lanes; l++) {
+      for (auto &i : inputs[chunk + l]) {
+        if (!registers.contains(i.first) || i.second < 0) {
+          res.runs.clear();
+          res.error = "invalid input '" + i.first + "' of run " +
+                      std::to_string(chunk + l);
+          return res;
+        }
+        bindings.push_back(
+            {.lane = l, .reg = registers[i.first], .value = i.second});
+      }
+    }
+    this->runChunk(bindings, &res.runs[chunk], (Mask(1) << lanes) - 1);
+  }
+  res.ran = true;
+  return res;
+}
+
+void LockstepVM::runChunk(const std::vector<Binding> &bindings, Run *runs,
+                          Mask lanes) const {
+  std::vector<Group> groups = {{.ip = 0,
+                                .mask = lanes,
+                                .executed = 0,
+                                .skew = {},
+                                .stack = {},
+                                .data = {}}};
+  while (!groups.empty()) {
+    // the group furthest behind runs until it reaches the next one
+    std::size_t current = 0;
+    for (std::size_t k = 1; k < groups.size(); k++) {
+      if (groups[k].ip < groups[current].ip) current = k;
+    }
+    ProgramIndex stop = std::numeric_limits<ProgramIndex>::max();
+    for (auto &g : groups) {
+      if (g.ip > groups[current].ip) stop = std::min(stop, g.ip);
+    }
+
+    Group split;
+    switch (this->step(groups[current], stop, split, bindings)) {
+      case Stop::HALT:
+        this->finish(groups[current], runs);
+        groups.erase(groups.begin() + current);
+        break;
+      case Stop::SPLIT:
+        groups.push_back(std::move(split));
+        break;
+      case Stop::YIELD:
+        break;
+    }
+
+    for (std::size_t a = 0; a < groups.size(); a++) {
+      for (std::size_t b = a + 1; b < groups.size();) {
+        Group &x = groups[a], &y = groups[b];
+        if (x.ip == y.ip && x.stack == y.stack) {
+          this->merge(x, y);
+          groups.erase(groups.begin() + b);
+        } else {
+          b++;
+        }
+      }
+    }
+  }
+}
+
+LockstepVM::Stop LockstepVM::step(Group &g, ProgramIndex stop, Group &split,
+                                  const std::vector<Binding> &bindings) const {
+  const Instruction *code = this->code.instructions().data();
+  ProgramIndex ip = g.ip;
+  VM::InstructionCount executed = g.executed;
+  Lanes *regs = g.stack.empty() ? nullptr : &g.data[g.stack.back().base];
+
+  // every operation is a loop over the lanes of a register, which the
+  // compiler turns into vector instructions
+  for (;;) {
+    const Instruction &i = code[ip];
+    executed++;
+    switch (i.op) {
+      case OpCode::POTENTIAL_BREAK:
+      case OpCode::BREAK:
+        ip++;
+        break;
+      case OpCode::ADD_CONST: {
+        const Lanes &s = regs[i.parameters.add.source];
+        Constant c = i.parameters.add.constant;
+        Lanes r;
+        for (std::size_t l = 0; l < width; l++) r[l] = std::max(s[l] + c, 0);
+        regs[i.parameters.add.target] = r;
+        ip++;
+        break;
+      }
+      case OpCode::TEST: {
+        const Lanes &a = regs[i.parameters.test.op1];
+        const Lanes &b = regs[i.parameters.test.op2];
+        Lanes r;
+        for (std::size_t l = 0; l < width; l++) r[l] = a[l] == b[l] ? 0 : 1;
+        regs[i.parameters.test.target] = r;
+        ip++;
+        break;
+      }
+      case OpCode::CONST:
+        regs[i.parameters.constant.target].fill(i.parameters.constant.constant);
+        ip++;
+        break;
+      case OpCode::JMP:
+        ip += i.parameters.jmp.offset;
+        break;
+      case OpCode::JMPC: {
+        const Lanes &s = regs[i.parameters.jmpc.source];
+        Mask zero = 0;
+        for (std::size_t l = 0; l < width; l++)
+          zero |= Mask(s[l] == 0) << l;
+        zero &= g.mask;
+        if (zero == g.mask) {
+          ip += i.parameters.jmpc.offset;
+        } else if (zero == 0) {
+          ip++;
+        } else {
+          g.executed = executed;
+          split = g;
+          split.mask = zero;
+          split.ip = ip + i.parameters.jmpc.offset;
+          g.mask &= ~zero;
+          g.ip = ip + 1;
+          return Stop::SPLIT;
+        }
+        break;
+      }
+      case OpCode::PREPARE_EXEC: {
+        std::size_t base = g.data.size();
+        g.data.resize(base + i.parameters.prepare.count, Lanes{});
+        g.stack.push_back({.base = base,
+                           .size = i.parameters.prepare.count,
+                           .ret_target = i.parameters.prepare.target,
+                           .ret_addr = -1,
+                           .debug_info = i.parameters.prepare.index});
+        regs = &g.data[base];
+        if (g.stack.size() == 1) {
+          for (auto &b : bindings) regs[b.reg][b.lane] = b.value;
+        }
+        ip++;
+        break;
+      }
+      case OpCode::ARG: {
+        const Frame &caller = *(g.stack.end() - 2);
+        regs[i.parameters.arg.target] =
+            g.data[caller.base + i.parameters.arg.source];
+        ip++;
+        break;
+      }
+      case OpCode::EXEC:
+        g.stack.back().ret_addr = ip + 1;
+        ip = i.parameters.exec.entry;
+        break;
+      case OpCode::TAIL_EXEC: {
+        // the prepared frame replaces the current one
+        Frame callee = g.stack.back();
+        g.stack.pop_back();
+        Frame &frame = g.stack.back();
+        auto from = g.data.begin() + callee.base;
+        std::copy(from, from + callee.size, g.data.begin() + frame.base);
+        g.data.resize(frame.base + callee.size);
+        frame.size = callee.size;
+        frame.debug_info = callee.debug_info;
+        regs = &g.data[frame.base];
+        ip = i.parameters.exec.entry;
+        break;
+      }
+      case OpCode::RET: {
+        Frame callee = g.stack.back();
+        g.stack.pop_back();
+        Frame &caller = g.stack.back();
+        g.data[caller.base + callee.ret_target] = regs[i.parameters.ret.source];
+        g.data.resize(callee.base);
+        regs = &g.data[caller.base];
+        ip = callee.ret_addr;
+        break;
+      }
+      default:
+        // HALT, which isn't counted (like by VM); verified programs contain
+        // no other instructions
+        g.ip = ip;
+        g.executed = executed - 1;
+        return Stop::HALT;
+    }
+    if (ip >= stop) {
+      g.ip = ip;
+      g.executed = executed;
+      return Stop::YIELD;
+    }
+  }
+}
+
+void LockstepVM::merge(Group &into, const Group &from) const {
+  for (std::size_t l = 0; l < width; l++) {
+    if (!(from.mask & (Mask(1) << l))) continue;
+    for (std::size_t r = 0; r < into.data.size(); r++)
+      into.data[r][l] = from.data[r][l];
+    into.skew[l] = (long long)(from.executed - into.executed) + from.skew[l];
+  }
+  into.mask |= from.mask;
+}
+
+void LockstepVM::finish(const Group &g, Run *runs) const {
+  for (std::size_t l = 0; l < width; l++) {
+    if (!(g.mask & (Mask(1) << l))) continue;
+    Run &run = runs[l];
+    run.instructions = g.executed + g.skew[l];
+    run.variables = {};
+    // the root script's frame is the bottom of the stack
+    if (g.stack.empty()) continue;
+    const Frame &root = g.stack.front();
+    for (auto &v : this->code.stack_maps[root.debug_info].map)
+      run.variables.push_back({v.second, g.data[root.base + v.first][l]});
+  }
+}
@@ -0,0 +1,297 @@
+#include "VM/include/native.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "VM/include/layout.hpp"
+#include "VM/include/program.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define THEO_NATIVE_DLOPEN
+#include <dlfcn.h>
+#endif
+
+/**
+ * ahead-of-time translation of bytecode into C++:
+ *
+ * every function found by Layout::analyze becomes
+ *   static int f<k>(int *r, bool &halt)
+ * where r is its frame (stack frames become local arrays of the caller,
+ * sized by the count of the PREPARE_EXEC of the call) and the result is the
+ * value passed by RET; HALT sets halt and returns, every caller returns
+ * right after a call that halted; a tail call (TAIL_EXEC) returns the
+ * result of the callee directly;
+ *
+ * the shared object exports (with C linkage)
+ *   int theo_run(int *frame)            runs the program on the root frame
+ *   const int theo_frame_size           registers of the root frame
+ *   const int theo_variable_count
+ *   const char *const theo_variable_names[]
+ *   const int theo_variable_registers[]
+ * the root frame is the one created by the PREPARE_EXEC at position 0
+ */
+
+using namespace Theo;
+
+static std::string quoted(const std::string &s) {
+  std::string res = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') res += '\\';
+    res += c;
+  }
+  return res + "\"";
+}
+
+bool Program::emitCpp(std::ostream &o) {
+  std::span<const Instruction> code = this->instructions();
+  if (code.empty() || code[0].op != OpCode::PREPARE_EXEC) return false;
+  const int size = code.size();
+
+  Layout l = Layout::analyze(code);
+
+  // call sites by the position of their PREPARE_EXEC
+  std::map<ProgramIndex, const Layout::CallSite *> calls = {};
+  std::set<int> root_callees = {};
+  for (auto &c : l.calls) {
+    if (c.prepare == -1 || c.callee == -1) return false;
+    calls[c.prepare] = &c;
+    // the first PREPARE_EXEC creates the root frame, which has no caller
+    // to pass arguments from or return to
+    if (c.prepare == 0) {
+      if (c.exec != 1) return false;
+      root_callees.insert(c.callee);
+    }
+  }
+
+  std::stringstream defs;
+  for (std::size_t f = 0; f < l.functions.size(); f++) {
+    // halting keeps the frame as the result, which must be the root frame
+    bool root_frame = f == 0 || root_callees.contains(f);
+
+    // the instructions reachable from the entry, stepping over calls
+    std::set<ProgramIndex> reachable = {};
+    std::set<ProgramIndex> targets = {};
+    std::vector<ProgramIndex> todo = {l.functions[f].entry};
+    while (!todo.empty()) {
+      ProgramIndex ind = todo.back();
+      todo.pop_back();
+      if (ind < 0 || ind >= size) return false;
+      if (!reachable.insert(ind).second) continue;
+
+      const Instruction &i = code[ind];
+      switch (i.op) {
+        case OpCode::HALT:
+          if (!root_frame) return false;
+          break;
+        case OpCode::RET:
+          break;
+        case OpCode::JMP:
+          todo.push_back(ind + i.parameters.jmp.offset);
+          targets.insert(ind + i.parameters.jmp.offset);
+          break;
+        case OpCode::JMPC:
+          todo.push_back(ind + 1);
+          todo.push_back(ind + i.parameters.jmpc.offset);
+          targets.insert(ind + i.parameters.jmpc.offset);
+          break;
+        case OpCode::PREPARE_EXEC:
+          if (calls.contains(ind)) {
+            if (!calls[ind]->tail) todo.push_back(calls[ind]->exec + 1);
+          } else if (ind == 0 && f == 0) {
+            todo.push_back(ind + 1);
+          } else {
+            return false;
+          }
+          break;
+        // only valid as part of a call, which is translated at its
+        // PREPARE_EXEC
+        case OpCode::ARG:
+        case OpCode::EXEC:
+        case OpCode::TAIL_EXEC:
+        case OpCode::WATCH:
+          return false;
+        default:
+          todo.push_back(ind + 1);
+          break;
+      }
+    }
+
+    // functions that neither halt nor call don't use halt
+    defs << "int f" << f << "(int *r, [[maybe_unused]] bool &halt) {"
+         << std::endl;
+    // the positions between a PREPARE_EXEC and its EXEC aren't reachable,
+    // so all other instructions fall through to the next one emitted
+    for (ProgramIndex ind : reachable) {
+      const Instruction &i = code[ind];
+      if (targets.contains(ind)) defs << "L" << ind << ":" << std::endl;
+      defs << "  ";
+      switch (i.op) {
+        case OpCode::POTENTIAL_BREAK:
+        case OpCode::BREAK:
+          defs << ";";
+          break;
+        case OpCode::HALT:
+          defs << "halt = true;" << std::endl << "  return 0;";
+          break;
+        case OpCode::ADD_CONST:
+          defs << "r[" << i.parameters.add.target << "] = std::max(r["
+               << i.parameters.add.source << "] + "
+               << i.parameters.add.constant << ", 0);";
+          break;
+        case OpCode::TEST:
+          defs << "r[" << i.parameters.test.target << "] = r["
+               << i.parameters.test.op1 << "] == r[" << i.parameters.test.op2
+               << "] ? 0 : 1;";
+          break;
+        case OpCode::CONST:
+          defs << "r[" << i.parameters.constant.target
+               << "] = " << i.parameters.constant.constant << ";";
+          break;
+        case OpCode::JMP:
+          defs << "goto L" << ind + i.parameters.jmp.offset << ";";
+          break;
+        case OpCode::JMPC:
+          defs << "if (r[" << i.parameters.jmpc.source << "] == 0) goto L"
+               << ind + i.parameters.jmpc.offset << ";";
+          break;
+        case OpCode::RET:
+          defs << "return r[" << i.parameters.ret.source << "];";
+          break;
+        case OpCode::PREPARE_EXEC: {
+          if (!calls.contains(ind)) {
+            defs << ";";
+            break;
+          }
+          const Layout::CallSite &c = *calls[ind];
+          if (ind == 0) {
+            // the callee executes on the root frame
+            if (c.exec != 1) return false;
+            defs << "f" << c.callee << "(r, halt);" << std::endl
+                 << "  if (halt) return 0;";
+            break;
+          }
+          defs << "{" << std::endl
+               << "    int a[" << std::max(i.parameters.prepare.count, 1)
+               << "] = {};" << std::endl;
+          for (ProgramIndex k = ind + 1; k < c.exec; k++) {
+            defs << "    a[" << code[k].parameters.arg.target << "] = r["
+                 << code[k].parameters.arg.source << "];" << std::endl;
+          }
+          if (c.tail) {
+            defs << "    return f" << c.callee << "(a, halt);" << std::endl
+                 << "  }";
+            break;
+          }
+          defs << "    r[" << i.parameters.prepare.target << "] = f"
+               << c.callee << "(a, halt);" << std::endl
+               << "  }" << std::endl
+               << "  if (halt) return 0;";
+          break;
+        }
+        default:
+          return false;
+      }
+      defs << std::endl;
+    }
+    // every path ends in HALT, RET or a jump
+    defs << "}" << std::endl << std::endl;
+  }
+
+  const Instruction &root = code[0];
+  if (root.parameters.prepare.index < 0 ||
+      root.parameters.prepare.index >= (int)this->stack_maps.size())
+    return false;
+  const StackMap &root_map = this->stack_maps[root.parameters.prepare.index];
+
+  o << "// generated by libTheoVM (Program::emitCpp), do not edit" << std::endl
+    << "#include <algorithm>" << std::endl
+    << std::endl
+    << "namespace {" << std::endl
+    << std::endl;
+  for (std::size_t f = 0; f < l.functions.size(); f++)
+    o << "int f" << f << "(int *r, bool &halt);" << std::endl;
+  o << std::endl << defs.str() << "}  // namespace" << std::endl << std::endl;
+
+  o << "extern \"C\" const int theo_frame_size = "
+    << std::max(root.parameters.prepare.count, 1) << ";" << std::endl
+    << "extern \"C\" const int theo_variable_count = " << root_map.map.size()
+    << ";" << std::endl
+    << "extern \"C\" const char *const theo_variable_names[] = {";
+  for (auto &v : root_map.map) o << quoted(v.second) << ", ";
+  o << "nullptr};" << std::endl
+    << "extern \"C\" const int theo_variable_registers[] = {";
+  for (auto &v : root_map.map) o << v.first << ", ";
+  o << "-1};" << std::endl
+    << std::endl
+    << "extern \"C\" int theo_run(int *frame) {" << std::endl
+    << "  bool halt = false;" << std::endl
+    << "  f0(frame, halt);" << std::endl
+    << "  return halt ? 0 : 1;" << std::endl
+    << "}" << std::endl;
+  return (bool)o;
+}
+
+NativeProgram::NativeProgram() {
+  this->handle = NULL;
+  this->entry = NULL;
+  this->frame_size = 0;
+  this->variables = {};
+}
+
+NativeProgram::~NativeProgram() {
+#ifdef THEO_NATIVE_DLOPEN
+  if (this->handle != NULL) dlclose(this->handle);
+#endif
+}
+
+NativeProgram::Data NativeProgram::run() {
+  std::vector<int> frame(this->frame_size, 0);
+  this->entry(frame.data());
+  Data res = {};
+  for (auto &v : this->variables) res[v.first] = frame[v.second];
+  return res;
+}
+
+NativeLoadResult NativeProgram::load(std::string path) {
+  NativeLoadResult res = {
+      .loaded_correctly = false, .error = "", .program = nullptr};
+#ifdef THEO_NATIVE_DLOPEN
+  std::shared_ptr<NativeProgram> p(new NativeProgram());
+  p->handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (p->handle == NULL) {
+    const char *e = dlerror();
+    res.error = e == NULL ? "couldn't load '" + path + "'" : e;
+    return res;
+  }
+
+  p->entry = (int (*)(int *))dlsym(p->handle, "theo_run");
+  auto frame_size = (const int *)dlsym(p->handle, "theo_frame_size");
+  auto count = (const int *)dlsym(p->handle, "theo_variable_count");
+  auto names =
+      (const char *const *)dlsym(p->handle, "theo_variable_names");
+  auto registers = (const int *)dlsym(p->handle, "theo_variable_registers");
+  if (p->entry == NULL || frame_size == NULL || count == NULL ||
+      names == NULL || registers == NULL) {
+    res.error = "'" + path + "' wasn't generated by Program::emitCpp";
+    return res;
+  }
+
+  p->frame_size = *frame_size;
+  for (int k = 0; k < *count; k++) {
+    if (registers[k] < 0 || registers[k] >= p->frame_size) {
+      res.error = "variable '" + std::string(names[k]) + "' is out of range";
+      return res;
+    }
+    p->variables[names[k]] = registers[k];
+  }
+
+  res.loaded_correctly = true;
+  res.program = p;
+#else
+  res.error = "native programs aren't supported on this platform";
+#endif
+  return res;
+}
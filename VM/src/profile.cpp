@@ -0,0 +1,110 @@
+#include <algorithm>
+
+#include "VM/include/profile.hpp"
+
+using namespace Theo;
+
+void Profile::clear(std::size_t code_size) {
+  this->instructions.assign(code_size, 0);
+  this->paths = {CallPath{
+      .function = -1, .parent = 0, .calls = 0, .exclusive = 0, .callees = {}}};
+}
+
+std::size_t Profile::callee(std::size_t path, StackMapIndex function) {
+  auto itr = this->paths[path].callees.find(function);
+  if (itr != this->paths[path].callees.end()) return itr->second;
+  std::size_t c = this->paths.size();
+  this->paths.push_back(CallPath{.function = function,
+                                 .parent = path,
+                                 .calls = 0,
+                                 .exclusive = 0,
+                                 .callees = {}});
+  this->paths[path].callees[function] = c;
+  return c;
+}
+
+Profile::Count Profile::total() const {
+  Count t = 0;
+  for (auto &p : this->paths) t += p.exclusive;
+  return t;
+}
+
+static std::string function_name(const Program &p, StackMapIndex f) {
+  if (f < 0 || f >= (StackMapIndex)p.stack_maps.size()) return "?";
+  return p.stack_maps[f].func_name;
+}
+
+std::vector<Profile::LineCount> Profile::lines(const Program &p) const {
+  std::map<std::pair<int, int>, Count> per_line = {};
+  auto entry = p.line_info.begin();
+  const Program::LineEntry *current = NULL;
+  for (std::size_t ind = 0; ind < this->instructions.size(); ind++) {
+    while (entry != p.line_info.end() && entry->index <= (ProgramIndex)ind)
+      current = &*(entry++);
+    if (current == NULL || this->instructions[ind] == 0) continue;
+    per_line[{current->file, current->line}] += this->instructions[ind];
+  }
+
+  std::vector<LineCount> res = {};
+  for (auto &l : per_line) {
+    res.push_back({.line = p.toBreakPoint({.index = 0,
+                                           .file = l.first.first,
+                                           .line = l.first.second}),
+                   .instructions = l.second});
+  }
+  std::stable_sort(res.begin(), res.end(),
+                   [](const LineCount &a, const LineCount &b) -> bool {
+                     return a.instructions > b.instructions;
+                   });
+  return res;
+}
+
+std::vector<Profile::FunctionCount> Profile::functions(
+    const Program &p) const {
+  // callees are always created after their callers
+  std::vector<Count> inclusive(this->paths.size(), 0);
+  for (std::size_t k = this->paths.size(); k-- > 0;) {
+    inclusive[k] += this->paths[k].exclusive;
+    if (k != 0) inclusive[this->paths[k].parent] += inclusive[k];
+  }
+
+  std::map<StackMapIndex, FunctionCount> per_function = {};
+  for (std::size_t k = 0; k < this->paths.size(); k++) {
+    const CallPath &c = this->paths[k];
+    if (c.function < 0) continue;
+    FunctionCount &f = per_function[c.function];
+    f.name = function_name(p, c.function);
+    f.calls += c.calls;
+    f.exclusive += c.exclusive;
+
+    // recursive activations are already part of the outermost one
+    bool recursive = false;
+    for (std::size_t a = k; a != 0 && !recursive;) {
+      a = this->paths[a].parent;
+      recursive = this->paths[a].function == c.function;
+    }
+    if (!recursive) f.inclusive += inclusive[k];
+  }
+
+  std::vector<FunctionCount> res = {};
+  for (auto &f : per_function) res.push_back(f.second);
+  std::stable_sort(res.begin(), res.end(),
+                   [](const FunctionCount &a, const FunctionCount &b) -> bool {
+                     return a.inclusive > b.inclusive;
+                   });
+  return res;
+}
+
+void Profile::writeCollapsed(std::ostream &o, const Program &p) const {
+  for (std::size_t k = 0; k < this->paths.size(); k++) {
+    if (this->paths[k].exclusive == 0) continue;
+    std::vector<std::string> names = {};
+    for (std::size_t a = k;; a = this->paths[a].parent) {
+      names.push_back(function_name(p, this->paths[a].function));
+      if (a == 0) break;
+    }
+    for (std::size_t n = names.size(); n-- > 0;)
+      o << names[n] << (n == 0 ? " " : ";");
+    o << this->paths[k].exclusive << std::endl;
+  }
+}
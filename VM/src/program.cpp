@@ -9,24 +9,23 @@ std::string op_to_str[] = {
 using namespace Theo;
 #include <ostream>
 void Program::disassemble(std::ostream &o) {
-  for (size_t line = 0; line < this->code.size(); line++) {
-    Instruction i = this->code[line];
+  std::span<const Instruction> code = this->instructions();
+  for (size_t line = 0; line < code.size(); line++) {
+    Instruction i = code[line];
     o << std::to_string(line) << ":\t";
-    switch (this->code[line].op) {
+    switch (i.op) {
       case OpCode::TEST: {
         o << "r[" << i.parameters.test.target << "] = "
           << "r[" << i.parameters.test.op1 << "] == "
           << "r[" << i.parameters.test.op2 << "] ? 0 : 1" << std::endl;
         break;
       }
-      case OpCode::POTENTIAL_BREAK: {
-        BreakPoint bp = this->line_info[line];
-        o << "--\t\t\t\t" << bp.file << ":" << bp.line << std::endl;
-        break;
-      }
+      case OpCode::POTENTIAL_BREAK:
       case OpCode::BREAK: {
-        BreakPoint bp = this->line_info[line];
-        o << "++\t\t\t\t" << bp.file << ":" << bp.line << std::endl;
+        const LineEntry *e = this->lineAt(line);
+        BreakPoint bp = e ? this->toBreakPoint(*e) : BreakPoint{"", 0};
+        o << (i.op == OpCode::BREAK ? "++" : "--") << "\t\t\t\t" << bp.file
+          << ":" << bp.line << std::endl;
         break;
       }
       case OpCode::HALT:
@@ -57,6 +56,9 @@ void Program::disassemble(std::ostream &o) {
       case OpCode::EXEC:
         o << "exec " << i.parameters.exec.entry << std::endl;
         break;
+      case OpCode::TAIL_EXEC:
+        o << "tail exec " << i.parameters.exec.entry << std::endl;
+        break;
       case OpCode::RET:
         o << "return r[" << i.parameters.ret.source << "]" << std::endl;
         break;
@@ -64,6 +66,9 @@ void Program::disassemble(std::ostream &o) {
         o << "r[" << i.parameters.constant.target
           << "] = " << i.parameters.constant.constant << std::endl;
         break;
+      case OpCode::WATCH:
+        o << "<watched instruction>" << std::endl;
+        break;
     };
   }
 }
@@ -77,6 +82,61 @@ bool Theo::operator<(const BreakPoint &bp1, const BreakPoint &bp2) {
 std::set<BreakPoint> Program::getAvailableBreakpoints() {
   std::set<BreakPoint> result = {};
   std::for_each(potential_breaks.begin(), potential_breaks.end(),
-                [&result](auto &p) -> void { result.insert(p.first); });
+                [&](auto &e) -> void { result.insert(this->toBreakPoint(e)); });
   return result;
 }
+
+const Program::LineEntry *Program::lineAt(ProgramIndex ind) const {
+  auto itr = std::lower_bound(
+      line_info.begin(), line_info.end(), ind,
+      [](const LineEntry &e, ProgramIndex i) -> bool { return e.index < i; });
+  if (itr == line_info.end() || itr->index != ind) return NULL;
+  return &*itr;
+}
+
+static bool line_order(const Program::LineEntry &e1,
+                       const Program::LineEntry &e2) {
+  if (e1.file != e2.file) return e1.file < e2.file;
+  if (e1.line != e2.line) return e1.line < e2.line;
+  return e1.index < e2.index;
+}
+
+std::span<const Program::LineEntry> Program::breaksAt(
+    const BreakPoint &bp) const {
+  int file = this->fileIndex(bp.file);
+  if (file == -1) return {};
+  auto range = std::equal_range(
+      potential_breaks.begin(), potential_breaks.end(),
+      LineEntry{.index = 0, .file = file, .line = bp.line},
+      [](const LineEntry &e1, const LineEntry &e2) -> bool {
+        if (e1.file != e2.file) return e1.file < e2.file;
+        return e1.line < e2.line;
+      });
+  return std::span<const LineEntry>(range.first, range.second);
+}
+
+BreakPoint Program::toBreakPoint(const LineEntry &e) const {
+  return {this->files[e.file], e.line};
+}
+
+int Program::fileIndex(const std::string &file) const {
+  // programs reference few files, a linear search is sufficient
+  for (std::size_t i = 0; i < this->files.size(); i++)
+    if (this->files[i] == file) return i;
+  return -1;
+}
+
+void Program::addLine(ProgramIndex ind, const std::string &file, int line) {
+  int f = this->fileIndex(file);
+  if (f == -1) {
+    this->files.push_back(file);
+    f = this->files.size() - 1;
+  }
+  this->line_info.push_back({.index = ind, .file = f, .line = line});
+}
+
+void Program::sortLineTables() {
+  this->potential_breaks = this->line_info;
+  std::sort(this->potential_breaks.begin(), this->potential_breaks.end(),
+            line_order);
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <limits>
+
+#include "VM/include/vm.hpp"
+
+/**
+ * reverse execution: while recording, the VM takes a checkpoint (a snapshot)
+ * every checkpoint_interval instructions; going backwards restores the latest
+ * checkpoint before the current position and replays the instructions up to
+ * the stop that is sought; since execution is deterministic, the replay
+ * passes through exactly the states of the original run
+ */
+
+using namespace Theo;
+
+static const VM::InstructionCount initial_checkpoint_interval = 1 << 16;
+static const VM::InstructionCount never =
+    std::numeric_limits<VM::InstructionCount>::max();
+
+void VM::setRecording(bool mode) {
+  this->recording = mode;
+  this->clearCheckpoints();
+}
+
+bool VM::isRecordingEnabled() { return this->recording; }
+
+void VM::setRecordingBudget(std::size_t bytes) {
+  this->checkpoint_budget = bytes;
+  if (this->checkpoint_bytes > this->checkpoint_budget)
+    this->thinCheckpoints();
+}
+
+void VM::clearCheckpoints() {
+  this->checkpoints.clear();
+  this->checkpoint_bytes = 0;
+  this->checkpoint_interval = initial_checkpoint_interval;
+  this->next_checkpoint = this->recording ? this->executed : never;
+}
+
+std::size_t VM::checkpointCost(const Snapshot *prev, const Snapshot &s) {
+  std::size_t cost = sizeof(Checkpoint) + s.stack.size() * sizeof(Activation) +
+                     s.pages.size() * sizeof(s.pages[0]);
+  // pages shared with the previous checkpoint don't cost anything
+  for (std::size_t p = 0; p < s.pages.size(); p++) {
+    if (prev == NULL || p >= prev->pages.size() || prev->pages[p] != s.pages[p])
+      cost += sizeof(Page);
+  }
+  return cost;
+}
+
+void VM::checkpoint() {
+  Checkpoint c = {.state = this->snapshot(), .cost = 0};
+  const Snapshot *prev =
+      this->checkpoints.empty() ? NULL : &this->checkpoints.back().state;
+  c.cost = this->checkpointCost(prev, c.state);
+
+  this->checkpoint_bytes += c.cost;
+  this->checkpoints.push_back(c);
+  this->next_checkpoint = this->executed + this->checkpoint_interval;
+
+  if (this->checkpoint_bytes > this->checkpoint_budget)
+    this->thinCheckpoints();
+}
+
+void VM::thinCheckpoints() {
+  while (this->checkpoint_bytes > this->checkpoint_budget &&
+         this->checkpoints.size() > 2) {
+    // keep the first and the last checkpoint, drop every other in between
+    std::vector<Checkpoint> kept = {};
+    for (std::size_t k = 0; k < this->checkpoints.size(); k++) {
+      if (k % 2 == 0 || k + 1 == this->checkpoints.size())
+        kept.push_back(this->checkpoints[k]);
+    }
+    this->checkpoints = kept;
+    this->checkpoint_interval *= 2;
+
+    this->checkpoint_bytes = 0;
+    for (std::size_t k = 0; k < this->checkpoints.size(); k++) {
+      Checkpoint &c = this->checkpoints[k];
+      const Snapshot *prev = k == 0 ? NULL : &this->checkpoints[k - 1].state;
+      c.cost = this->checkpointCost(prev, c.state);
+      this->checkpoint_bytes += c.cost;
+    }
+  }
+
+  if (!this->checkpoints.empty() && this->next_checkpoint != never)
+    this->next_checkpoint =
+        std::max(this->executed, this->checkpoints.back().state.executed +
+                                     this->checkpoint_interval);
+}
+
+bool VM::reverse(bool lines) {
+  if (this->checkpoints.empty()) return false;
+
+  const InstructionCount now = this->executed;
+
+  // latest checkpoint strictly before the current position
+  auto itr = std::lower_bound(
+      this->checkpoints.begin(), this->checkpoints.end(), now,
+      [](const Checkpoint &c, InstructionCount n) -> bool {
+        return c.state.executed < n;
+      });
+  if (itr == this->checkpoints.begin()) {
+    this->restoreState(this->checkpoints.front().state);
+    return false;
+  }
+  std::size_t c = (itr - this->checkpoints.begin()) - 1;
+
+  // stops of conditional breakpoints are found by their condition alone
+  this->replaying = true;
+  InstructionCount until = now;
+  for (;;) {
+    const Snapshot &from = this->checkpoints[c].state;
+    this->restoreState(from);
+
+    // a stop is identified by the instruction count right after the
+    // (potential) breakpoint or watched instruction, which is where the
+    // VM halts
+    InstructionCount stop = 0;
+    bool found = false;
+    while (this->executed < until) {
+      OpCode op = this->instructions[this->instruction_pointer].op;
+      if (op == OpCode::HALT) break;
+      bool stopped = this->step();
+      bool line = op == OpCode::POTENTIAL_BREAK || op == OpCode::BREAK;
+      if (((stopped && (op == OpCode::BREAK || op == OpCode::WATCH)) ||
+           (lines && line)) &&
+          this->executed < now) {
+        stop = this->executed;
+        found = true;
+      }
+    }
+
+    if (found) {
+      this->restoreState(from);
+      while (this->executed < stop) this->step();
+      this->syncProfilePath();
+      this->replaying = false;
+      return true;
+    }
+
+    if (c == 0) {
+      this->restoreState(this->checkpoints[0].state);
+      this->replaying = false;
+      return false;
+    }
+    until = from.executed;
+    c--;
+  }
+}
+
+bool VM::reverseStep() { return this->reverse(true); }
+
+bool VM::reverseContinue() { return this->reverse(false); }
@@ -0,0 +1,34 @@
+#include "VM/include/scheduler.hpp"
+
+using namespace Theo;
+
+Scheduler::Scheduler(VM::InstructionCount slice) {
+  this->slice = slice == 0 ? 1 : slice;
+  this->tasks.clear();
+}
+
+void Scheduler::add(VM &vm) {
+  this->tasks.push_back({.vm = &vm, .execution = vm.run(this->slice)});
+}
+
+std::size_t Scheduler::size() { return this->tasks.size(); }
+
+std::size_t Scheduler::round(const BreakHandler &on_break) {
+  std::size_t kept = 0;
+  for (std::size_t k = 0; k < this->tasks.size(); k++) {
+    Task &t = this->tasks[k];
+    bool keep = t.execution.resume();
+    if (keep && t.execution.stop() == Execution::BREAK && on_break)
+      keep = on_break(*t.vm);
+    if (!keep) continue;
+    if (kept != k) this->tasks[kept] = std::move(t);
+    kept++;
+  }
+  this->tasks.erase(this->tasks.begin() + kept, this->tasks.end());
+  return kept;
+}
+
+void Scheduler::run(const BreakHandler &on_break) {
+  while (this->round(on_break) != 0) {
+  }
+}
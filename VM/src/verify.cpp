@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "VM/include/program.hpp"
+
+/**
+ * bytecode verification: the control flow is followed from position 0 and
+ * from every call target, like Layout::analyze does, and every reachable
+ * instruction is checked against the state the VM will be in when executing
+ * it:
+ *   - opcodes are valid, jumps, calls and return addresses stay inside the
+ *     program, control never runs past its end
+ *   - PREPARE_EXEC is followed by ARGs and one EXEC or TAIL_EXEC, ARG and
+ *     EXEC never occur (and are never jumped to) outside of such a sequence
+ *   - every function only accesses registers of its frame, whose size is the
+ *     smallest count of the PREPARE_EXECs creating it; ARG writes registers
+ *     of the prepared frame; stack maps only name registers of their frame
+ *   - RET only occurs in functions that always have a caller's frame to
+ *     return to (not in the root script, nor in what it calls on its frame)
+ *   - no instruction is shared between functions
+ *   - the line tables only refer to positions in the program and its files,
+ *     and only to POTENTIAL_BREAKs (or BREAKs), which setting a breakpoint
+ *     overwrites
+ * the VM executes verified programs without any runtime checks
+ */
+
+using namespace Theo;
+
+namespace {
+
+struct Function {
+  ProgramIndex entry;
+  std::vector<ProgramIndex> owned;
+};
+
+struct Call {
+  int caller;  // indices into the functions
+  int callee;
+  ProgramIndex prepare;
+  bool tail;
+};
+
+}  // namespace
+
+VerifyResult Program::verify() const {
+  std::span<const Instruction> code = this->instructions();
+  const ProgramIndex size = code.size();
+  VerifyResult res = {.verified = false, .error = "", .position = -1};
+  auto fail = [&res](ProgramIndex ind, std::string what) {
+    res.error = what;
+    res.position = ind;
+    return res;
+  };
+  auto in_range = [size](ProgramIndex ind) { return ind >= 0 && ind < size; };
+
+  if (size == 0) return fail(-1, "the program is empty");
+  if (code[0].op != OpCode::PREPARE_EXEC)
+    return fail(0, "the program doesn't start with PREPARE_EXEC");
+
+  // breakpoints are set by writing to the positions of the line tables
+  for (auto *table : {&this->line_info, &this->potential_breaks}) {
+    for (auto &e : *table) {
+      if (!in_range(e.index) || e.file < 0 ||
+          e.file >= (int)this->files.size())
+        return fail(e.index, "line table entry outside of the program");
+      if (code[e.index].op != OpCode::POTENTIAL_BREAK &&
+          code[e.index].op != OpCode::BREAK)
+        return fail(e.index, "line table entry isn't a potential break");
+    }
+  }
+
+  // control flow: the instructions of every function and the calls
+  std::vector<Function> functions = {{.entry = 0, .owned = {}}};
+  std::vector<Call> calls = {};
+  std::vector<int> owner(size, -1);
+  // ARGs and the EXEC of a call sequence
+  std::vector<bool> interior(size, false);
+  auto function_at = [&functions](ProgramIndex entry) {
+    for (std::size_t f = 0; f < functions.size(); f++) {
+      if (functions[f].entry == entry) return (int)f;
+    }
+    functions.push_back({.entry = entry, .owned = {}});
+    return (int)functions.size() - 1;
+  };
+
+  for (std::size_t f = 0; f < functions.size(); f++) {
+    // positions to visit, with the position control comes from
+    std::vector<std::pair<ProgramIndex, ProgramIndex>> todo = {
+        {functions[f].entry, -1}};
+    while (!todo.empty()) {
+      auto [ind, from] = todo.back();
+      todo.pop_back();
+      if (!in_range(ind)) return fail(from, "control leaves the program");
+      if (interior[ind]) return fail(from, "jump into a call sequence");
+      if (owner[ind] == (int)f) continue;
+      if (owner[ind] != -1)
+        return fail(ind, "instruction is shared between functions");
+      owner[ind] = f;
+      functions[f].owned.push_back(ind);
+
+      const Instruction &i = code[ind];
+      switch (i.op) {
+        case OpCode::POTENTIAL_BREAK:
+        case OpCode::BREAK:
+        case OpCode::ADD_CONST:
+        case OpCode::TEST:
+        case OpCode::CONST:
+          todo.push_back({ind + 1, ind});
+          break;
+        case OpCode::HALT:
+        case OpCode::RET:
+          break;
+        case OpCode::JMP:
+          todo.push_back({ind + i.parameters.jmp.offset, ind});
+          break;
+        case OpCode::JMPC:
+          todo.push_back({ind + 1, ind});
+          todo.push_back({ind + i.parameters.jmpc.offset, ind});
+          break;
+        case OpCode::PREPARE_EXEC: {
+          ProgramIndex exec = ind + 1;
+          while (in_range(exec) && code[exec].op == OpCode::ARG) {
+            interior[exec] = true;
+            exec++;
+          }
+          bool call = in_range(exec) && (code[exec].op == OpCode::EXEC ||
+                                         code[exec].op == OpCode::TAIL_EXEC);
+          // the root frame may be prepared without calling anything
+          if (ind == 0 && exec == 1 && !call) {
+            todo.push_back({1, 0});
+            break;
+          }
+          if (ind == 0 && exec != 1)
+            return fail(1, "ARG without a calling frame");
+          if (!call) return fail(exec, "PREPARE_EXEC without EXEC");
+          interior[exec] = true;
+
+          bool tail = code[exec].op == OpCode::TAIL_EXEC;
+          // the root frame is the only one, it can't be replaced
+          if (ind == 0 && tail) return fail(exec, "tail call without a frame");
+          ProgramIndex entry = code[exec].parameters.exec.entry;
+          if (!in_range(entry)) return fail(exec, "call leaves the program");
+          calls.push_back({.caller = (int)f,
+                           .callee = function_at(entry),
+                           .prepare = ind,
+                           .tail = tail});
+          // a function called on the root frame never returns
+          if (!tail && ind != 0) todo.push_back({exec + 1, exec});
+          break;
+        }
+        case OpCode::ARG:
+        case OpCode::EXEC:
+        case OpCode::TAIL_EXEC:
+          return fail(ind, "instruction outside of a call sequence");
+        default:
+          return fail(ind, "invalid opcode");
+      }
+    }
+  }
+
+  // frames: the smallest frame a function is called with, and whether it
+  // may run without a caller's frame below its own
+  std::vector<RegisterCount> frame(functions.size(), -1);
+  frame[0] = code[0].parameters.prepare.count;
+  std::set<int> rootless = {0};
+  for (auto &c : calls) {
+    RegisterCount count = code[c.prepare].parameters.prepare.count;
+    if (frame[c.callee] == -1 || count < frame[c.callee])
+      frame[c.callee] = count;
+    if (c.prepare == 0) rootless.insert(c.callee);
+  }
+  // tail calls keep the frame below the caller's
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &c : calls) {
+      if (c.tail && rootless.contains(c.caller))
+        changed |= rootless.insert(c.callee).second;
+    }
+  }
+
+  // registers
+  for (std::size_t f = 0; f < functions.size(); f++) {
+    RegisterCount frame_size = frame[f];
+    auto reg = [frame_size](RegisterIndex r) {
+      return r >= 0 && r < frame_size;
+    };
+    for (ProgramIndex ind : functions[f].owned) {
+      const Instruction &i = code[ind];
+      bool valid = true;
+      switch (i.op) {
+        case OpCode::ADD_CONST:
+          valid = reg(i.parameters.add.target) && reg(i.parameters.add.source);
+          break;
+        case OpCode::TEST:
+          valid = reg(i.parameters.test.target) &&
+                  reg(i.parameters.test.op1) && reg(i.parameters.test.op2);
+          break;
+        case OpCode::CONST:
+          valid = reg(i.parameters.constant.target);
+          break;
+        case OpCode::JMPC:
+          valid = reg(i.parameters.jmpc.source);
+          break;
+        case OpCode::RET:
+          if (rootless.contains(f))
+            return fail(ind, "RET without a caller's frame");
+          valid = reg(i.parameters.ret.source);
+          break;
+        case OpCode::PREPARE_EXEC: {
+          RegisterCount count = i.parameters.prepare.count;
+          StackMapIndex m = i.parameters.prepare.index;
+          if (count < 0) return fail(ind, "negative frame size");
+          if (m < 0 || m >= (StackMapIndex)this->stack_maps.size())
+            return fail(ind, "stack map out of range");
+          for (auto &v : this->stack_maps[m].map) {
+            if (v.first < 0 || v.first >= count)
+              return fail(ind, "variable '" + v.second + "' outside of frame");
+          }
+          // the return target is in the caller's frame
+          if (ind != 0) valid = reg(i.parameters.prepare.target);
+          for (ProgramIndex a = ind + 1;
+               in_range(a) && code[a].op == OpCode::ARG; a++) {
+            RegisterIndex target = code[a].parameters.arg.target;
+            if (target < 0 || target >= count ||
+                !reg(code[a].parameters.arg.source))
+              return fail(a, "register outside of frame");
+          }
+          break;
+        }
+        default:
+          break;
+      }
+      if (!valid) return fail(ind, "register outside of frame");
+    }
+  }
+
+  res.verified = true;
+  return res;
+}
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <atomic>
+#include <span>
+
 #include "VM/include/program.hpp"
 #include "VM/include/vm.hpp"
 
@@ -14,14 +18,26 @@ VM::Activation::Activation(VM *vm, VM::WordIndex data_start,
   this->debug_info = debug_info;
 }
 
+VM::Activation::Variables VM::Activation::getVariables() const {
+  return Variables(&this->vm->code.stack_maps[this->debug_info],
+                   this->vm->data.data() + this->data_start);
+}
+
+const std::string &VM::Activation::getFunctionName() const {
+  return this->vm->code.stack_maps[this->debug_info].func_name;
+}
+
+std::optional<VM::Word> VM::Activation::Variables::get(
+    std::string_view name) const {
+  for (auto v : *this) {
+    if (v.name == name) return v.value;
+  }
+  return std::nullopt;
+}
+
 VM::Activation::Data VM::Activation::getActivationVariables() {
   VM::Activation::Data res;
-  Program::StackMap stack_map = this->vm->code.stack_maps[this->debug_info];
-  for (int offset = 0; offset < this->seg_size; offset++) {
-    for (auto &entry : stack_map.map) {
-      res[entry.second] = this->vm->data[this->data_start + entry.first];
-    }
-  }
+  for (auto v : this->getVariables()) res[std::string(v.name)] = v.value;
   return res;
 }
 
@@ -29,40 +45,202 @@ VM::VM(Program code) {
   this->stepping_mode_enabled = false;
   this->instruction_pointer = 0;
   this->code = code;
+  this->verified = this->code.verify().verified;
+  this->checked = !this->verified;
+  this->inputs = {};
+  if (this->code.image) {
+    this->instructions = this->code.image->instructions;
+  } else {
+    this->patched_code = std::make_shared<std::vector<Instruction>>(
+        std::move(this->code.code));
+    this->code.code = {};
+    this->instructions = this->patched_code->data();
+  }
   this->enabled_breakpoints = {};
+  this->break_conditions = {};
+  this->break_hits = {};
+  this->break_guards = {};
+  this->replaying = false;
+  this->interrupt_requested = false;
+  this->interrupted = false;
+  this->enabled_watchpoints = {};
+  this->watched_ops = {};
+  this->watched_registers = {};
+  this->layout = std::nullopt;
+  this->last_watch = std::nullopt;
+  this->last_watch_at = 0;
   this->stack = {};
   this->data = {};
+  this->last_pages = {};
+  this->last_size = 0;
+  this->dirty_from = 0;
+  this->executed = 0;
+  this->recording = false;
+  this->checkpoint_budget = 64 << 20;
+  this->clearCheckpoints();
+  this->profiling = false;
+  this->profile = {};
+  this->profile_path = 0;
+  this->engine = Engine::SWITCH;
+  this->closures = {};
+  this->fault = std::nullopt;
+  if (this->codeSize() == 0) this->fault = "the program is empty";
+}
+
+std::size_t VM::codeSize() {
+  return this->patched_code ? this->patched_code->size()
+                            : this->code.image->size;
+}
+
+Instruction *VM::writableCode() {
+  // copies of this VM share the instructions until one of them patches them
+  if (!this->patched_code || this->patched_code.use_count() > 1) {
+    std::span<const Instruction> current(this->instructions, this->codeSize());
+    this->patched_code = std::make_shared<std::vector<Instruction>>(
+        current.begin(), current.end());
+    this->instructions = this->patched_code->data();
+  }
+  this->closures.clear();
+  return this->patched_code->data();
 }
 
 std::vector<VM::Activation> &VM::getActivations() { return this->stack; }
 
 BreakPoint VM::getCurrentBreak() {
-  auto itr = this->code.line_info.find(this->instruction_pointer - 1);
-  return (itr == this->code.line_info.end()) ? (BreakPoint{"none", -1})
-                                             : itr->second;
+  const Program::LineEntry *e =
+      this->code.lineAt(this->instruction_pointer - 1);
+  return (e == NULL) ? (BreakPoint{"none", -1}) : this->code.toBreakPoint(*e);
 }
 
 void VM::setSteppingMode(bool mode) { this->stepping_mode_enabled = mode; }
 
 bool VM::setBreakPoint(std::string file, int line, bool value) {
   BreakPoint bp = {file, line};
-  auto itr = this->code.potential_breaks.find(bp);
-  if (itr == this->code.potential_breaks.end()) return false;
+  auto breaks = this->code.breaksAt(bp);
+  if (breaks.empty()) return false;
+  // a previous condition doesn't survive
+  for (auto &e : breaks) this->break_guards.erase(e.index);
+  this->break_conditions.erase(bp);
+  this->break_hits.erase(bp);
+  Instruction *code = this->writableCode();
   if (!value) {
     this->enabled_breakpoints.erase(bp);
-    for (auto ind : itr->second)
-      this->code.code[ind].op = OpCode::POTENTIAL_BREAK;
+    for (auto &e : breaks) code[e.index].op = OpCode::POTENTIAL_BREAK;
   } else {
     this->enabled_breakpoints.insert(bp);
-    for (auto ind : itr->second) this->code.code[ind].op = OpCode::BREAK;
+    for (auto &e : breaks) code[e.index].op = OpCode::BREAK;
   }
   return true;
 }
 
+static RegisterIndex register_of(const Program::StackMap &sm,
+                                 const std::string &name) {
+  for (auto &entry : sm.map) {
+    if (entry.second == name) return entry.first;
+  }
+  return -1;
+}
+
+bool VM::setConditionalBreakPoint(std::string file, int line,
+                                  const BreakCondition &condition) {
+  BreakPoint bp = {file, line};
+  auto breaks = this->code.breaksAt(bp);
+  if (breaks.empty()) return false;
+
+  // resolve the variables in the frame of every BREAK of the line
+  const Layout &l = this->getLayout();
+  std::vector<std::pair<ProgramIndex, BreakGuard>> guards = {};
+  for (auto &e : breaks) {
+    BreakGuard g = {.cmp = condition.cmp,
+                    .lhs = -1,
+                    .rhs = -1,
+                    .constant = condition.constant,
+                    .ignore_count = condition.ignore_count,
+                    .bp = bp};
+    if (condition.cmp != BreakCondition::ALWAYS) {
+      int f = l.owner[e.index];
+      StackMapIndex m = (f == -1) ? -1 : l.functions[f].stack_map;
+      if (m < 0 || m >= (StackMapIndex)this->code.stack_maps.size())
+        return false;
+      const Program::StackMap &sm = this->code.stack_maps[m];
+      g.lhs = register_of(sm, condition.variable);
+      if (!condition.other.empty()) g.rhs = register_of(sm, condition.other);
+      if (g.lhs == -1 || (!condition.other.empty() && g.rhs == -1))
+        return false;
+    }
+    guards.push_back({e.index, g});
+  }
+
+  this->setBreakPoint(file, line, true);
+  this->break_conditions[bp] = condition;
+  this->break_hits[bp] = 0;
+  for (auto &g : guards) this->break_guards[g.first] = g.second;
+  return true;
+}
+
+std::optional<BreakCondition> VM::getBreakCondition(const BreakPoint &bp) {
+  auto itr = this->break_conditions.find(bp);
+  if (itr == this->break_conditions.end()) return std::nullopt;
+  return itr->second;
+}
+
+bool VM::breakHolds(ProgramIndex ind) {
+  auto itr = this->break_guards.find(ind);
+  if (itr == this->break_guards.end()) return true;
+  const BreakGuard &g = itr->second;
+
+  if (g.cmp != BreakCondition::ALWAYS) {
+    WordIndex base = this->stack.back().data_start;
+    Word l = this->data[base + g.lhs];
+    Word r = (g.rhs == -1) ? g.constant : this->data[base + g.rhs];
+    bool holds = false;
+    switch (g.cmp) {
+      case BreakCondition::EQ:
+        holds = l == r;
+        break;
+      case BreakCondition::NE:
+        holds = l != r;
+        break;
+      case BreakCondition::LT:
+        holds = l < r;
+        break;
+      case BreakCondition::LE:
+        holds = l <= r;
+        break;
+      case BreakCondition::GT:
+        holds = l > r;
+        break;
+      case BreakCondition::GE:
+        holds = l >= r;
+        break;
+      case BreakCondition::ALWAYS:
+        holds = true;
+        break;
+    }
+    if (!holds) return false;
+  }
+
+  // replays for reverse execution see the hits a second time
+  if (this->replaying) return true;
+  return ++this->break_hits[g.bp] > g.ignore_count;
+}
+
+const Layout &VM::getLayout() {
+  // first needed before any instruction is patched to WATCH
+  if (!this->layout)
+    this->layout = Layout::analyze({this->instructions, this->codeSize()});
+  return *this->layout;
+}
+
 void VM::clearBreakpoints() {
+  this->break_guards.clear();
+  this->break_conditions.clear();
+  this->break_hits.clear();
+  if (this->enabled_breakpoints.empty()) return;
+  Instruction *code = this->writableCode();
   for (auto const &bp : this->enabled_breakpoints) {
-    for (auto ind : this->code.potential_breaks[bp])
-      this->code.code[ind].op = OpCode::POTENTIAL_BREAK;
+    for (auto &e : this->code.breaksAt(bp))
+      code[e.index].op = OpCode::POTENTIAL_BREAK;
   }
   this->enabled_breakpoints.clear();
 }
@@ -77,16 +255,329 @@ void VM::reset() {
   this->stepping_mode_enabled = false;
   this->instruction_pointer = 0;
   this->clearBreakpoints();
+  this->clearWatchPoints();
+  this->last_watch = std::nullopt;
   this->data.clear();
   this->stack.clear();
+  this->last_pages.clear();
+  this->last_size = 0;
+  this->dirty_from = 0;
+  this->executed = 0;
+  this->clearCheckpoints();
+  this->syncProfilePath();
+  if (this->codeSize() != 0) this->fault = std::nullopt;
+}
+
+VM::WordIndex VM::firstDirtyPage() {
+  WordIndex clean = std::min(this->dirty_from, this->last_size);
+  clean = std::min(clean, (WordIndex)this->data.size());
+  return clean / page_size;
+}
+
+void VM::markClean() {
+  this->last_size = this->data.size();
+  // the top frame is written without further notice
+  this->dirty_from =
+      this->stack.empty() ? this->last_size : this->stack.back().data_start;
+}
+
+VM::Snapshot VM::snapshot() {
+  Snapshot s;
+  s.instruction_pointer = this->instruction_pointer;
+  s.executed = this->executed;
+  s.stack = this->stack;
+  s.size = this->data.size();
+
+  WordIndex shared = this->firstDirtyPage();
+  WordIndex pages = (s.size + page_size - 1) / page_size;
+  s.pages.reserve(pages);
+  for (WordIndex p = 0; p < pages; p++) {
+    if (p < shared) {
+      s.pages.push_back(this->last_pages[p]);
+      continue;
+    }
+    auto page = std::make_shared<Page>();
+    WordIndex begin = p * page_size;
+    WordIndex end = std::min(begin + page_size, s.size);
+    std::copy(this->data.begin() + begin, this->data.begin() + end,
+              page->begin());
+    s.pages.push_back(page);
+  }
+
+  this->last_pages = s.pages;
+  this->markClean();
+  return s;
+}
+
+void VM::restore(const Snapshot &s) {
+  this->restoreState(s);
+  // the recorded history may belong to another timeline
+  this->clearCheckpoints();
+}
+
+void VM::restoreState(const Snapshot &s) {
+  WordIndex unchanged = this->firstDirtyPage();
+
+  this->instruction_pointer = s.instruction_pointer;
+  this->executed = s.executed;
+  this->stack = s.stack;
+  for (auto &a : this->stack) a.vm = this;
+
+  this->data.resize(s.size);
+  WordIndex pages = (s.size + page_size - 1) / page_size;
+  for (WordIndex p = 0; p < pages; p++) {
+    // pages shared with the last snapshot are still in place
+    if (p < unchanged && p < (WordIndex)this->last_pages.size() &&
+        this->last_pages[p] == s.pages[p])
+      continue;
+    WordIndex begin = p * page_size;
+    WordIndex end = std::min(begin + page_size, s.size);
+    std::copy(s.pages[p]->begin(), s.pages[p]->begin() + (end - begin),
+              this->data.begin() + begin);
+  }
+
+  this->last_pages = s.pages;
+  this->markClean();
+  this->syncProfilePath();
+  // the state precedes any fault
+  if (this->codeSize() != 0) this->fault = std::nullopt;
+}
+
+void VM::setProfiling(bool mode) {
+  this->profiling = mode;
+  if (mode && this->profile.paths.empty()) this->clearProfile();
+}
+
+bool VM::isProfilingEnabled() { return this->profiling; }
+
+const Profile &VM::getProfile() { return this->profile; }
+
+void VM::clearProfile() {
+  this->profile.clear(this->codeSize());
+  this->syncProfilePath();
+}
+
+void VM::syncProfilePath() {
+  if (this->profile.paths.empty()) return;
+  this->profile_path = 0;
+  if (this->stack.empty()) return;
+  this->profile.paths[0].function = this->stack[0].debug_info;
+  // activations that were prepared but not entered yet don't count
+  for (std::size_t k = 1; k < this->stack.size(); k++) {
+    if (this->stack[k].ret_addr == -1) break;
+    this->profile_path =
+        this->profile.callee(this->profile_path, this->stack[k].debug_info);
+  }
+}
+
+VM::Word VM::Snapshot::at(WordIndex ind) const {
+  return (*this->pages[ind / page_size])[ind % page_size];
+}
+
+std::vector<VM::Change> VM::changedSince(const Snapshot &s) {
+  std::vector<Change> res = {};
+  std::size_t frames = std::min(this->stack.size(), s.stack.size());
+  for (std::size_t k = 0; k < frames; k++) {
+    const Activation &now = this->stack[k];
+    const Activation &then = s.stack[k];
+    if (now.data_start != then.data_start ||
+        now.debug_info != then.debug_info)
+      break;
+    for (auto v : now.getVariables()) {
+      Word before = s.at(then.data_start + v.reg);
+      if (before != v.value)
+        res.push_back(
+            {.frame = k, .name = v.name, .before = before, .after = v.value});
+    }
+  }
+  return res;
 }
 
 bool VM::isDone() {
-  return this->code.code[this->instruction_pointer].op == OpCode::HALT;
+  return this->fault ||
+         this->instructions[this->instruction_pointer].op == OpCode::HALT;
+}
+
+bool VM::setInput(std::string_view name, Word value) {
+  if (value < 0 || this->codeSize() == 0) return false;
+  const Instruction &root = this->instructions[0];
+  if (root.op != OpCode::PREPARE_EXEC) return false;
+  StackMapIndex m = root.parameters.prepare.index;
+  if (m < 0 || m >= (StackMapIndex)this->code.stack_maps.size()) return false;
+  for (auto &v : this->code.stack_maps[m].map) {
+    // the register must be part of the frame, even in unverified programs
+    if (v.second != name || v.first >= root.parameters.prepare.count)
+      continue;
+    this->inputs[v.first] = value;
+    return true;
+  }
+  return false;
+}
+
+void VM::clearInputs() { this->inputs.clear(); }
+
+void VM::preallocate(const Analysis &a) {
+  if (a.max_data) this->data.reserve(*a.max_data);
+  if (a.max_depth) this->stack.reserve(*a.max_depth);
+}
+
+void VM::applyInputs() {
+  WordIndex base = this->stack.back().data_start;
+  for (auto &i : this->inputs) this->data[base + i.first] = i.second;
+}
+
+bool VM::isVerified() { return this->verified; }
+
+void VM::setCheckedExecution(bool value) {
+  this->checked = value || !this->verified;
 }
 
+std::optional<std::string> VM::getFault() { return this->fault; }
+
+VM::InstructionCount VM::getExecutedInstructions() { return this->executed; }
+
 bool VM::executeSingle() {
-  Instruction i = this->code.code[this->instruction_pointer];
+  if (this->executed == this->next_checkpoint) this->checkpoint();
+  if (this->checked) return this->checkedStep();
+  return this->profiling ? this->profiledStep() : this->step();
+}
+
+bool VM::raiseFault(std::string what) {
+  this->fault =
+      what + " at position " + std::to_string(this->instruction_pointer);
+  return true;
+}
+
+bool VM::checkedStep() {
+  if (this->fault) return true;
+  const ProgramIndex size = this->codeSize();
+  ProgramIndex ip = this->instruction_pointer;
+  if (ip < 0 || ip >= size) return this->raiseFault("instruction pointer");
+
+  Instruction i = this->instructions[ip];
+  if (i.op == OpCode::WATCH) i.op = this->watched_ops[ip];
+  auto in_range = [size](ProgramIndex ind) { return ind >= 0 && ind < size; };
+  // registers of the top frame, and of the one below
+  auto reg = [this](RegisterIndex r, std::size_t depth = 1) {
+    return this->stack.size() >= depth && r >= 0 &&
+           r < (this->stack.end() - depth)->seg_size;
+  };
+
+  // the instruction pointer stays in range, so that isDone() can read the
+  // next instruction
+  bool valid = true;
+  switch (i.op) {
+    case OpCode::HALT:
+      break;
+    case OpCode::POTENTIAL_BREAK:
+    case OpCode::BREAK:
+      valid = in_range(ip + 1);
+      break;
+    case OpCode::ADD_CONST:
+      valid = reg(i.parameters.add.target) && reg(i.parameters.add.source) &&
+              in_range(ip + 1);
+      break;
+    case OpCode::TEST:
+      valid = reg(i.parameters.test.target) && reg(i.parameters.test.op1) &&
+              reg(i.parameters.test.op2) && in_range(ip + 1);
+      break;
+    case OpCode::CONST:
+      valid = reg(i.parameters.constant.target) && in_range(ip + 1);
+      break;
+    case OpCode::JMP:
+      valid = in_range(ip + i.parameters.jmp.offset);
+      break;
+    case OpCode::JMPC: {
+      if (!reg(i.parameters.jmpc.source)) {
+        valid = false;
+        break;
+      }
+      WordIndex base = this->stack.back().data_start;
+      valid = in_range(this->data[base + i.parameters.jmpc.source] == 0
+                           ? ip + i.parameters.jmpc.offset
+                           : ip + 1);
+      break;
+    }
+    case OpCode::PREPARE_EXEC: {
+      StackMapIndex m = i.parameters.prepare.index;
+      valid = i.parameters.prepare.count >= 0 && m >= 0 &&
+              m < (StackMapIndex)this->code.stack_maps.size() &&
+              in_range(ip + 1);
+      if (!valid) break;
+      // the debugger reads the variables of the frame
+      for (auto &v : this->code.stack_maps[m].map)
+        valid &= v.first >= 0 && v.first < i.parameters.prepare.count;
+      break;
+    }
+    case OpCode::ARG:
+      valid = reg(i.parameters.arg.target) &&
+              reg(i.parameters.arg.source, 2) && in_range(ip + 1);
+      break;
+    case OpCode::EXEC:
+      valid = !this->stack.empty() && in_range(i.parameters.exec.entry);
+      break;
+    case OpCode::TAIL_EXEC:
+      valid = this->stack.size() >= 2 && in_range(i.parameters.exec.entry);
+      break;
+    case OpCode::RET:
+      valid = reg(i.parameters.ret.source) &&
+              reg(this->stack.back().ret_target, 2) &&
+              in_range(this->stack.back().ret_addr);
+      break;
+    default:
+      valid = false;
+      break;
+  }
+  if (!valid) return this->raiseFault("invalid instruction");
+  return this->profiling ? this->profiledStep() : this->step();
+}
+
+bool VM::profiledStep() {
+  ProgramIndex ip = this->instruction_pointer;
+  OpCode op = this->instructions[ip].op;
+  if (op == OpCode::WATCH) op = this->watched_ops[ip];
+  if (op != OpCode::HALT) {
+    this->profile.instructions[ip]++;
+    this->profile.paths[this->profile_path].exclusive++;
+  }
+  bool stop = this->step();
+  switch (op) {
+    case OpCode::PREPARE_EXEC:
+      if (this->stack.size() == 1) {
+        this->profile.paths[0].function = this->stack[0].debug_info;
+        this->profile.paths[0].calls++;
+      }
+      break;
+    case OpCode::EXEC:
+      // the root activation was entered with its PREPARE_EXEC
+      if (this->stack.size() == 1) break;
+      this->profile_path = this->profile.callee(this->profile_path,
+                                                this->stack.back().debug_info);
+      this->profile.paths[this->profile_path].calls++;
+      break;
+    case OpCode::RET:
+      this->profile_path = this->profile.paths[this->profile_path].parent;
+      break;
+    case OpCode::TAIL_EXEC:
+      // the callee takes the place of the current call in the call tree
+      this->profile_path =
+          this->profile.callee(this->profile.paths[this->profile_path].parent,
+                               this->stack.back().debug_info);
+      this->profile.paths[this->profile_path].calls++;
+      break;
+    default:
+      break;
+  }
+  return stop;
+}
+
+bool VM::step() {
+  Instruction i = this->instructions[this->instruction_pointer];
+  if (i.op != OpCode::HALT) this->executed++;
+  return this->dispatch(i);
+}
+
+bool VM::dispatch(Instruction i) {
   switch (i.op) {
     case OpCode::POTENTIAL_BREAK: {
       // std::cout << "Potential Break" << std::endl;
@@ -99,11 +590,13 @@ bool VM::executeSingle() {
     case OpCode::BREAK: {
       // std::cout << "Break" << std::endl;
       this->instruction_pointer++;
-      return true;
-      break;
+      if (this->stepping_mode_enabled || this->break_guards.empty())
+        return true;
+      return this->breakHolds(this->instruction_pointer - 1);
     }
     case OpCode::HALT: {
       // std::cout << "Halt" << std::endl;
+      this->last_watch = std::nullopt;
       return true;
       break;
     }
@@ -157,12 +650,11 @@ bool VM::executeSingle() {
       int next_len = i.parameters.prepare.count;
       RegisterIndex ret_targ = i.parameters.prepare.target;
       StackMapIndex ind = i.parameters.prepare.index;
-      for (int k = 0; k < next_len; k++) {
-        this->data.push_back(0);
-      }
+      this->data.resize(next_offset + next_len, 0);
       // return address filled by EXEC
       this->stack.push_back(
           Activation(this, next_offset, next_len, ret_targ, -1, ind));
+      if (this->stack.size() == 1) this->applyInputs();
       this->instruction_pointer++;
       break;
     }
@@ -188,12 +680,95 @@ bool VM::executeSingle() {
       RegisterIndex ret_source = i.parameters.ret.source;
       WordIndex source_off = this->stack.back().data_start;
       this->data[target_off + ret_target] = this->data[source_off + ret_source];
+      if (target_off < this->dirty_from) this->dirty_from = target_off;
       this->instruction_pointer = this->stack.back().ret_addr;
+      // the frame is always the last one in data
+      this->data.resize(source_off);
       this->stack.pop_back();
       break;
     }
+    case OpCode::TAIL_EXEC: {
+      // the prepared frame replaces the current one, which keeps its return
+      // address and target
+      Activation callee = this->stack.back();
+      this->stack.pop_back();
+      Activation &frame = this->stack.back();
+      auto from = this->data.begin() + callee.data_start;
+      std::copy(from, from + callee.seg_size,
+                this->data.begin() + frame.data_start);
+      this->data.resize(frame.data_start + callee.seg_size);
+      frame.seg_size = callee.seg_size;
+      frame.debug_info = callee.debug_info;
+      if (frame.data_start < this->dirty_from)
+        this->dirty_from = frame.data_start;
+      this->instruction_pointer = i.parameters.exec.entry;
+      break;
+    }
+    case OpCode::WATCH: {
+      return this->watched(i);
+    }
   }
   return false;
 }
 
-void VM::execute() { while (!executeSingle()); }
+void VM::interrupt() {
+  std::atomic_ref<bool>(this->interrupt_requested)
+      .store(true, std::memory_order_relaxed);
+}
+
+bool VM::wasInterrupted() { return this->interrupted; }
+
+bool VM::pollInterrupt() {
+  if (!std::atomic_ref<bool>(this->interrupt_requested)
+           .exchange(false, std::memory_order_relaxed))
+    return false;
+  this->interrupted = true;
+  return true;
+}
+
+bool VM::executeSlice(InstructionCount n) {
+  if (!this->checked && !this->profiling && this->engine == Engine::CLOSURES)
+    return this->closureSlice(n);
+
+  while (n > 0) {
+    // steps don't take checkpoints, the budget ends where one is due
+    if (this->executed == this->next_checkpoint) this->checkpoint();
+    InstructionCount budget =
+        std::min(n, this->next_checkpoint - this->executed);
+    if (budget == 0) budget = n;
+
+    InstructionCount before = this->executed;
+    if (this->checked) {
+      for (InstructionCount k = 0; k < budget; k++)
+        if (this->checkedStep()) return true;
+    } else if (this->profiling) {
+      for (InstructionCount k = 0; k < budget; k++)
+        if (this->profiledStep()) return true;
+    } else {
+      for (InstructionCount k = 0; k < budget; k++)
+        if (this->step()) return true;
+    }
+    n -= this->executed - before;
+  }
+  return false;
+}
+
+void VM::execute() {
+  this->interrupted = false;
+  // the interrupt flag is only polled between slices of instructions
+  do {
+    if (this->executeSlice(interrupt_slice)) return;
+  } while (!this->pollInterrupt());
+}
+
+Execution VM::run(InstructionCount slice) {
+  for (;;) {
+    if (!this->executeSlice(slice)) {
+      co_yield Execution::SLICE;
+    } else if (this->isDone()) {
+      co_return Execution::HALT;
+    } else {
+      co_yield Execution::BREAK;
+    }
+  }
+}
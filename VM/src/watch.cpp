@@ -0,0 +1,195 @@
+#include "VM/include/vm.hpp"
+
+/**
+ * watchpoints: every instruction that may write a watched variable is
+ * patched to WATCH (like breakpoints patch POTENTIAL_BREAK to BREAK); WATCH
+ * executes the original instruction and compares the written register
+ * before and after; which instructions may write a variable follows from
+ * the layout of the program:
+ *   ADD_CONST, CONST, TEST  write into the frame of the owning function
+ *   ARG                     writes into the frame of the prepared callee
+ *   RET                     writes into the caller's frame, at the target
+ *                           register of the call site's PREPARE_EXEC (for a
+ *                           tail call, that of the call which reached the
+ *                           tail-calling function)
+ */
+
+using namespace Theo;
+
+bool Theo::operator<(const WatchPoint &wp1, const WatchPoint &wp2) {
+  if (wp1.program != wp2.program) return wp1.program < wp2.program;
+  if (wp1.variable != wp2.variable) return wp1.variable < wp2.variable;
+  return wp1.value < wp2.value;
+}
+
+bool VM::setWatchPoint(const WatchPoint &wp, bool value) {
+  bool exists = false;
+  for (auto &sm : this->code.stack_maps) {
+    if (sm.func_name != wp.program) continue;
+    for (auto &entry : sm.map) exists |= entry.second == wp.variable;
+  }
+  if (!exists) return false;
+
+  if (value)
+    this->enabled_watchpoints.insert(wp);
+  else
+    this->enabled_watchpoints.erase(wp);
+  this->instrumentWatchPoints();
+  return true;
+}
+
+void VM::clearWatchPoints() {
+  if (this->enabled_watchpoints.empty()) return;
+  this->enabled_watchpoints.clear();
+  this->instrumentWatchPoints();
+}
+
+std::set<WatchPoint> &VM::getEnabledWatchPoints() {
+  return this->enabled_watchpoints;
+}
+
+std::optional<VM::WatchHit> VM::getCurrentWatch() {
+  // a hit is only current until the next instruction is executed
+  if (this->last_watch_at != this->executed) return std::nullopt;
+  return this->last_watch;
+}
+
+void VM::instrumentWatchPoints() {
+  this->watched_registers.clear();
+  for (auto &wp : this->enabled_watchpoints) {
+    for (std::size_t m = 0; m < this->code.stack_maps.size(); m++) {
+      const Program::StackMap &sm = this->code.stack_maps[m];
+      if (sm.func_name != wp.program) continue;
+      for (auto &entry : sm.map) {
+        if (entry.second == wp.variable)
+          this->watched_registers[{(StackMapIndex)m, entry.first}].push_back(
+              wp);
+      }
+    }
+  }
+
+  std::size_t size = this->codeSize();
+  const Layout &l = this->getLayout();
+
+  auto original = [this](ProgramIndex ind) -> Instruction {
+    Instruction i = this->instructions[ind];
+    if (i.op == OpCode::WATCH) i.op = this->watched_ops[ind];
+    return i;
+  };
+  auto is_watched = [this](StackMapIndex m, RegisterIndex r) -> bool {
+    return this->watched_registers.contains({m, r});
+  };
+
+  std::set<ProgramIndex> wanted = {};
+  for (ProgramIndex ind = 0; ind < (ProgramIndex)size; ind++) {
+    if (l.owner[ind] == -1) continue;
+    StackMapIndex own = l.functions[l.owner[ind]].stack_map;
+    Instruction i = original(ind);
+    bool writes = false;
+    switch (i.op) {
+      case OpCode::ADD_CONST:
+        writes = is_watched(own, i.parameters.add.target);
+        break;
+      case OpCode::CONST:
+        writes = is_watched(own, i.parameters.constant.target);
+        break;
+      case OpCode::TEST:
+        writes = is_watched(own, i.parameters.test.target);
+        break;
+      case OpCode::ARG: {
+        ProgramIndex prep = ind - 1;
+        while (prep >= 0 && original(prep).op == OpCode::ARG) prep--;
+        if (prep >= 0 && original(prep).op == OpCode::PREPARE_EXEC)
+          writes = is_watched(original(prep).parameters.prepare.index,
+                              i.parameters.arg.target);
+        break;
+      }
+      case OpCode::RET: {
+        // follow tail calls back to the calls that created the frame
+        std::set<int> callees = {l.owner[ind]};
+        std::vector<int> todo = {l.owner[ind]};
+        while (!todo.empty()) {
+          int f = todo.back();
+          todo.pop_back();
+          for (auto &c : l.calls) {
+            if (c.callee != f) continue;
+            if (c.tail) {
+              if (callees.insert(c.caller).second) todo.push_back(c.caller);
+            } else if (c.prepare != -1) {
+              writes |=
+                  is_watched(l.functions[c.caller].stack_map,
+                             original(c.prepare).parameters.prepare.target);
+            }
+          }
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    if (writes) wanted.insert(ind);
+  }
+
+  // patch the difference to the current instrumentation
+  std::vector<ProgramIndex> unwanted = {};
+  for (auto &w : this->watched_ops) {
+    if (!wanted.contains(w.first)) unwanted.push_back(w.first);
+  }
+  for (auto ind : wanted) {
+    if (this->watched_ops.contains(ind)) continue;
+    Instruction *code = this->writableCode();
+    this->watched_ops[ind] = code[ind].op;
+    code[ind].op = OpCode::WATCH;
+  }
+  for (auto ind : unwanted) {
+    Instruction *code = this->writableCode();
+    code[ind].op = this->watched_ops[ind];
+    this->watched_ops.erase(ind);
+  }
+}
+
+bool VM::watched(Instruction i) {
+  i.op = this->watched_ops[this->instruction_pointer];
+
+  // the frame and register written by the original instruction
+  std::size_t frame = this->stack.size() - 1;
+  RegisterIndex reg = 0;
+  switch (i.op) {
+    case OpCode::ADD_CONST:
+      reg = i.parameters.add.target;
+      break;
+    case OpCode::CONST:
+      reg = i.parameters.constant.target;
+      break;
+    case OpCode::TEST:
+      reg = i.parameters.test.target;
+      break;
+    case OpCode::ARG:
+      reg = i.parameters.arg.target;
+      break;
+    case OpCode::RET:
+      frame = this->stack.size() - 2;
+      reg = this->stack.back().ret_target;
+      break;
+    default:
+      return this->dispatch(i);
+  }
+  WordIndex addr = this->stack[frame].data_start + reg;
+  auto itr = this->watched_registers.find({this->stack[frame].debug_info, reg});
+
+  Word before = this->data[addr];
+  bool stop = this->dispatch(i);
+  if (itr == this->watched_registers.end()) return stop;
+  Word after = this->data[addr];
+
+  for (auto &wp : itr->second) {
+    bool hit = wp.value ? (after == *wp.value && before != *wp.value)
+                        : (after != before);
+    if (hit) {
+      this->last_watch = WatchHit{.watch = wp, .before = before, .after = after};
+      this->last_watch_at = this->executed;
+      return true;
+    }
+  }
+  return stop;
+}
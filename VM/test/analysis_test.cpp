@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/analysis.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  classifies the PROGRAMs of a compiled source as terminating (only LOOPs,
+  calling only terminating PROGRAMs) or not (WHILE, backward GOTO), bounds
+  the depth of the stack by the deepest observed one, and finds recursion
+  in hand-compiled bytecode
+ */
+
+using namespace Theo;
+
+const char *source =
+    "PROGRAM add IN x0, x1 DO\n"
+    "  LOOP x1 DO\n"
+    "    x0 := x0 + 1\n"
+    "  END\n"
+    "END\n"
+    "PROGRAM mul IN x1, x2 DO\n"
+    "  LOOP x2 DO\n"
+    "    IF x1 = 0 THEN GOTO skip;\n"
+    "    x0 := RUN add WITH x0, x1 END;\n"
+    "    skip: _ := 0\n"
+    "  END\n"
+    "END\n"
+    "PROGRAM whileadd IN x0, x1 DO\n"
+    "  WHILE x1 != 0 DO\n"
+    "    x0 := x0 + 1;\n"
+    "    x1 := x1 - 1\n"
+    "  END\n"
+    "END\n"
+    "PROGRAM gotoadd IN x0, x1 DO\n"
+    "  start: IF x1 = 0 THEN GOTO finish;\n"
+    "  x0 := x0 + 1;\n"
+    "  x1 := x1 - 1;\n"
+    "  GOTO start;\n"
+    "  finish: _ := 0\n"
+    "END\n"
+    "PROGRAM usewhile IN x1 DO\n"
+    "  LOOP x1 DO\n"
+    "    x0 := RUN whileadd WITH x0, 2 END\n"
+    "  END\n"
+    "END\n"
+    "a := RUN mul WITH 3, 4 END;\n"
+    "b := RUN usewhile WITH 2 END;\n"
+    "c := RUN gotoadd WITH 1, 2 END\n";
+
+const Analysis::Function *find(const Analysis &a, const std::string &name) {
+  auto f = std::find_if(a.functions.begin(), a.functions.end(),
+                        [&name](auto &f) { return f.name == name; });
+  return f == a.functions.end() ? nullptr : &*f;
+}
+
+int main() {
+  CodegenResult cr = compile({{"analysis.theo", source}}, "analysis.theo");
+  if (!cr.generated_correctly) {
+    std::cout << "couldn't compile the program" << std::endl;
+    return 1;
+  }
+  Analysis a = Analysis::analyze(cr.code);
+
+  struct Expected {
+    std::string name;
+    bool loop_only;
+    bool terminates;
+  };
+  for (Expected e : {Expected{"add", true, true}, {"mul", true, true},
+                     {"whileadd", false, false}, {"gotoadd", false, false},
+                     {"usewhile", true, false}, {"#root", true, false}}) {
+    const Analysis::Function *f = find(a, e.name);
+    if (f == nullptr || f->recursive || f->loop_only != e.loop_only ||
+        f->terminates != e.terminates) {
+      std::cout << "wrong classification of " << e.name << std::endl;
+      return 1;
+    }
+  }
+  if (a.terminates() || !a.max_depth || !a.max_data) {
+    std::cout << "wrong bounds of the program" << std::endl;
+    return 1;
+  }
+
+  // every call is executed, the deepest stack is the bound
+  VM v(cr.code);
+  v.preallocate(a);
+  std::size_t depth = 0;
+  while (!v.executeSingle() || !v.isDone())
+    depth = std::max(depth, v.getActivations().size());
+  if (depth != *a.max_depth ||
+      v.getActivations().back().getActivationVariables()["a"] != 12) {
+    std::cout << "observed depth " << depth << ", bound " << *a.max_depth
+              << std::endl;
+    return 1;
+  }
+
+  // frames of 2, 3 and 4 registers
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(2, 0, 0), Instruction::PrepareExec(3, 1, 0),
+      Instruction::Exec(4), Instruction::Halt(),
+      // g
+      Instruction::PrepareExec(4, 2, 0), Instruction::Exec(7),
+      Instruction::Ret(0),
+      // h
+      Instruction::Ret(0)};
+  std::vector<Program::StackMap> sm = {{"#root", {}}, {"g", {}}, {"h", {}}};
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  Analysis b = Analysis::analyze(p);
+  if (!b.terminates() || b.max_depth != 3 || b.max_data != 9) {
+    std::cout << "wrong bounds of nested calls" << std::endl;
+    return 1;
+  }
+
+  // g replaces its frame by h, which calls itself
+  p.code = {Instruction::PrepareExec(2, 0, 0),
+            Instruction::PrepareExec(3, 1, 0),
+            Instruction::Exec(4),
+            Instruction::Halt(),
+            // g
+            Instruction::PrepareExec(4, 2, 0),
+            Instruction::TailExec(6),
+            // h
+            Instruction::PrepareExec(2, 2, 0),
+            Instruction::Exec(6),
+            Instruction::Ret(0)};
+  Analysis r = Analysis::analyze(p);
+  if (r.terminates() || r.max_depth || r.max_data || !find(r, "h") ||
+      !find(r, "h")->recursive || find(r, "g")->recursive) {
+    std::cout << "recursion wasn't found" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
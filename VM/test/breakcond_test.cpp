@@ -0,0 +1,105 @@
+#include <iostream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  conditional breakpoints on the loop of + in the hand-compiled program of
+  instr_test (7 * 13)
+ */
+
+using namespace Theo;
+
+int x0(VM &v) {
+  return *v.getActivations().back().getVariables().get("x0");
+}
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.addLine(13, "add.theo", 1);
+  p.sortLineTables();
+
+  VM v(p);
+  v.setRecording(true);
+
+  if (v.setConditionalBreakPoint(
+          "add.theo", 1, {BreakCondition::EQ, "x9", "", 0, 0})) {
+    std::cout << "condition on an unknown variable was accepted" << std::endl;
+    return 1;
+  }
+
+  // x0 runs through 0 ... 90 on this line, skip 50, 51 and 52
+  v.setConditionalBreakPoint("add.theo", 1,
+                             {BreakCondition::GE, "x0", "", 50, 3});
+  v.execute();
+  if (v.isDone() || x0(v) != 53) {
+    std::cout << "first stop at x0 = " << x0(v) << std::endl;
+    return 1;
+  }
+  v.execute();
+  if (v.isDone() || x0(v) != 54) {
+    std::cout << "second stop at x0 = " << x0(v) << std::endl;
+    return 1;
+  }
+  if (!v.reverseContinue() || x0(v) != 53) {
+    std::cout << "reverse continue stopped at x0 = " << x0(v) << std::endl;
+    return 1;
+  }
+
+  // a copy counts the hits of its own
+  VM original(p);
+  original.setConditionalBreakPoint("add.theo", 1,
+                                    {BreakCondition::GE, "x0", "", 50, 3});
+  VM copy(original);
+  original.execute();
+  copy.execute();
+  if (copy.isDone() || x0(copy) != 53) {
+    std::cout << "copy stopped at x0 = " << x0(copy) << std::endl;
+    return 1;
+  }
+
+  // comparison of two variables, x2 is always 7
+  v.reset();
+  v.setConditionalBreakPoint("add.theo", 1,
+                             {BreakCondition::EQ, "x0", "x2", 0, 0});
+  int stops = 0;
+  for (v.execute(); !v.isDone(); v.execute()) {
+    if (x0(v) != 7) {
+      std::cout << "stopped at x0 = " << x0(v) << std::endl;
+      return 1;
+    }
+    stops++;
+  }
+  if (stops != 1) {
+    std::cout << "stopped " << stops << " times instead of once" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  saves the hand-compiled program of instr_test (7 * 13) with some debug
+  information, loads it again and executes the loaded program
+ */
+
+using namespace Theo;
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(17), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+4, 2),
+      Instruction::Add(0, 0, 1), Instruction::Add(2, 2, -1),
+      Instruction::Jmp(-3), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.sortLineTables();
+
+  std::string path =
+      (std::filesystem::temp_directory_path() / "theo_bytecode_test.theob")
+          .string();
+
+  if (!p.save(path)) {
+    std::cout << "couldn't save bytecode to " << path << std::endl;
+    return 1;
+  }
+
+  BytecodeLoadResult lr = Program::load(path);
+  if (!lr.loaded_correctly) {
+    std::cout << "couldn't load bytecode: " << lr.error << std::endl;
+    return 1;
+  }
+
+  std::span<const Instruction> loaded = lr.program.instructions();
+  if (loaded.size() != code.size()) {
+    std::cout << "expected " << code.size() << " instructions, got "
+              << loaded.size() << std::endl;
+    return 1;
+  }
+  for (size_t k = 0; k < code.size(); k++) {
+    if (loaded[k].op != code[k].op ||
+        std::memcmp(&loaded[k].parameters, &code[k].parameters,
+                    sizeof(code[k].parameters)) != 0) {
+      std::cout << "instruction " << k << " differs after loading" << std::endl;
+      return 1;
+    }
+  }
+
+  if (lr.program.stack_maps.size() != 3 ||
+      lr.program.stack_maps[2].func_name != "*" ||
+      lr.program.stack_maps[2].map[2] != "x2") {
+    std::cout << "stack maps differ after loading" << std::endl;
+    return 1;
+  }
+
+  auto points = lr.program.getAvailableBreakpoints();
+  if (!points.contains({"main.theo", 1}) || !points.contains({"main.theo", 2})) {
+    std::cout << "breakpoints differ after loading" << std::endl;
+    return 1;
+  }
+
+  VM v(lr.program);
+  v.setBreakPoint("main.theo", 2, true);
+  v.execute();
+  BreakPoint bp = v.getCurrentBreak();
+  if (bp.file != "main.theo" || bp.line != 2) {
+    std::cout << "expected to halt on main.theo:2, but halted on " << bp.file
+              << ":" << bp.line << std::endl;
+    return 1;
+  }
+  v.execute();
+
+  VM::Activation::Data res = v.getActivations().back().getActivationVariables();
+  if (!v.isDone() || res["x0"] != 91) {
+    std::cout << "loaded program computed 7 * 13 = " << res["x0"] << std::endl;
+    return 1;
+  }
+
+  // the loaded image itself must not have been patched by the breakpoint
+  if (lr.program.instructions()[5].op != OpCode::POTENTIAL_BREAK) {
+    std::cout << "setting a breakpoint modified the loaded program" << std::endl;
+    return 1;
+  }
+
+  // line table entries outside of the code must be rejected, setting a
+  // breakpoint would write there
+  Program outside = p;
+  outside.addLine(code.size(), "main.theo", 3);
+  outside.sortLineTables();
+  if (!outside.save(path) || Program::load(path).loaded_correctly) {
+    std::cout << "line table entry outside of the code was accepted"
+              << std::endl;
+    return 1;
+  }
+  Program halt = p;
+  halt.addLine(10, "main.theo", 3);
+  halt.sortLineTables();
+  if (!halt.save(path) || Program::load(path).loaded_correctly) {
+    std::cout << "line table entry at HALT was accepted" << std::endl;
+    return 1;
+  }
+  p.save(path);
+
+  // a truncated file must be rejected
+  std::filesystem::resize_file(path, 120);
+  if (Program::load(path).loaded_correctly) {
+    std::cout << "truncated bytecode file was accepted" << std::endl;
+    return 1;
+  }
+
+  std::filesystem::remove(path);
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  executes the hand-compiled program of breakcond_test (7 * 13) with both
+  engines under every kind of stop; the sequence of stops (instructions
+  executed, x0) has to be identical
+ */
+
+using namespace Theo;
+
+typedef std::vector<std::pair<VM::InstructionCount, int>> Trace;
+
+int x0(VM &v) {
+  return *v.getActivations().back().getVariables().get("x0");
+}
+
+Trace trace(const Program &p, VM::Engine e, std::function<void(VM &)> setup) {
+  VM v(p);
+  v.setEngine(e);
+  setup(v);
+  Trace t = {};
+  for (v.execute(); !v.isDone(); v.execute())
+    t.push_back({v.getExecutedInstructions(), x0(v)});
+  t.push_back({v.getExecutedInstructions(), x0(v)});
+  return t;
+}
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.addLine(13, "add.theo", 1);
+  p.sortLineTables();
+
+  std::vector<std::pair<std::string, std::function<void(VM &)>>> setups = {
+      {"no stops", [](VM &) {}},
+      {"breakpoint", [](VM &v) { v.setBreakPoint("add.theo", 1, true); }},
+      {"conditional breakpoint",
+       [](VM &v) {
+         v.setConditionalBreakPoint("add.theo", 1,
+                                    {BreakCondition::GE, "x0", "", 50, 3});
+       }},
+      {"watchpoint", [](VM &v) { v.setWatchPoint({"*", "x2", 49}, true); }},
+      {"stepping", [](VM &v) { v.setSteppingMode(true); }},
+      {"recording", [](VM &v) { v.setRecording(true); }}};
+
+  for (auto &s : setups) {
+    Trace expected = trace(p, VM::Engine::SWITCH, s.second);
+    Trace actual = trace(p, VM::Engine::CLOSURES, s.second);
+    if (actual != expected || expected.back().second != 91) {
+      std::cout << "engines differ with " << s.first << " (" << expected.size()
+                << " / " << actual.size() << " stops)" << std::endl;
+      return 1;
+    }
+  }
+
+  // breakpoints changed between executions take effect
+  VM v(p);
+  v.setEngine(VM::Engine::CLOSURES);
+  v.setRecording(true);
+  v.setBreakPoint("main.theo", 2, true);
+  v.execute();
+  v.setBreakPoint("main.theo", 2, false);
+  v.setBreakPoint("add.theo", 1, true);
+  v.execute();
+  if (v.isDone() || v.getCurrentBreak().line != 1 || x0(v) != 0) {
+    std::cout << "changed breakpoint wasn't hit" << std::endl;
+    return 1;
+  }
+  v.execute();
+  if (!v.reverseContinue() || x0(v) != 0) {
+    std::cout << "reverse continue stopped at x0 = " << x0(v) << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
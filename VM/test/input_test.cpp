@@ -0,0 +1,68 @@
+#include <iostream>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  one compiled program run on several inputs: the inputs are root variables
+  the script reads but never assigns, they are set before every run and
+  survive reset(), with both execution engines
+ */
+
+using namespace Theo;
+
+const char *source =
+    "PROGRAM add IN x0, x1 OUT x0 DO\n"
+    "  LOOP x1 DO\n"
+    "    x0 := x0 + 1\n"
+    "  END\n"
+    "END\n"
+    "sum := RUN add WITH a, b END;\n"
+    "twice := RUN add WITH sum, sum END\n";
+
+int main() {
+  CodegenResult cr = compile({{"input.theo", source}}, "input.theo");
+  if (!cr.generated_correctly) {
+    std::cout << "couldn't compile the program" << std::endl;
+    return 1;
+  }
+
+  for (VM::Engine e : {VM::Engine::SWITCH, VM::Engine::CLOSURES}) {
+    VM v(cr.code);
+    v.setEngine(e);
+    if (v.setInput("c", 1) || v.setInput("a", -1)) {
+      std::cout << "invalid input was accepted" << std::endl;
+      return 1;
+    }
+    for (VM::Word a = 0; a < 4; a++) {
+      v.reset();
+      if (!v.setInput("a", a)) {
+        std::cout << "couldn't set input a" << std::endl;
+        return 1;
+      }
+      // b keeps its value from the first run
+      if (a == 0 && !v.setInput("b", 5)) {
+        std::cout << "couldn't set input b" << std::endl;
+        return 1;
+      }
+      v.execute();
+      auto vars = v.getActivations().back().getActivationVariables();
+      if (vars["sum"] != a + 5 || vars["twice"] != 2 * (a + 5)) {
+        std::cout << "unexpected results for a = " << a << ": "
+                  << vars["sum"] << ", " << vars["twice"] << std::endl;
+        return 1;
+      }
+    }
+
+    v.clearInputs();
+    v.reset();
+    v.execute();
+    auto vars = v.getActivations().back().getActivationVariables();
+    if (vars["sum"] != 0) {
+      std::cout << "inputs weren't cleared" << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
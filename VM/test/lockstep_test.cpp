@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/lockstep.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  runs a program on more inputs than fit into one chunk of lanes, with
+  loops of different lengths per input, a branch taken by some inputs only
+  and calls (including a tail call), and compares every run to a VM
+  executing it alone
+ */
+
+using namespace Theo;
+
+const char *source =
+    "PROGRAM add IN x0, x1 DO\n"
+    "  LOOP x1 DO\n"
+    "    x0 := x0 + 1\n"
+    "  END\n"
+    "END\n"
+    "PROGRAM count IN x1 DO\n"
+    "  WHILE x1 != 0 DO\n"
+    "    x1 := x1 - 1;\n"
+    "    x0 := x0 + 2\n"
+    "  END\n"
+    "END\n"
+    "PROGRAM next IN a DO\n"
+    "  b := a + 1;\n"
+    "  x0 := RUN add WITH b, a END\n"
+    "END\n"
+    "s := RUN add WITH n, m END;\n"
+    "IF n = 3 THEN GOTO skip;\n"
+    "t := RUN count WITH n END;\n"
+    "skip: u := RUN next WITH m END\n";
+
+int main() {
+  CodegenResult cr = compile({{"lockstep.theo", source}}, "lockstep.theo");
+  if (!cr.generated_correctly) {
+    std::cout << "couldn't compile the program" << std::endl;
+    return 1;
+  }
+
+  std::vector<LockstepVM::Inputs> inputs = {};
+  for (VM::Word k = 0; k < 3 * (VM::Word)LockstepVM::width - 3; k++)
+    inputs.push_back({{"n", k % 5}, {"m", k % 7}});
+  LockstepVM l(cr.code);
+  LockstepVM::Result r = l.run(inputs);
+  if (!r.ran || r.runs.size() != inputs.size()) {
+    std::cout << "lockstep execution failed: " << r.error << std::endl;
+    return 1;
+  }
+
+  for (std::size_t k = 0; k < inputs.size(); k++) {
+    VM v(cr.code);
+    for (auto &i : inputs[k]) v.setInput(i.first, i.second);
+    v.execute();
+    std::vector<std::pair<std::string, VM::Word>> expected = {};
+    for (auto var : v.getActivations().front().getVariables())
+      expected.push_back({std::string(var.name), var.value});
+    if (r.runs[k].variables != expected ||
+        r.runs[k].instructions != v.getExecutedInstructions()) {
+      std::cout << "run " << k << " differs from the VM" << std::endl;
+      return 1;
+    }
+  }
+
+  if (l.run({{{"q", 1}}}).ran) {
+    std::cout << "unknown input was accepted" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
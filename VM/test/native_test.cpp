@@ -0,0 +1,72 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/native.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  runs a module translated to C++ at build time (see cmake/TheoNative.cmake)
+  and the same program in the VM, the results must be identical
+  usage: native_test <module> <source file>
+ */
+
+using namespace Theo;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cout << "usage: native_test <module> <source file>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream f(argv[2]);
+  std::stringstream source;
+  source << f.rdbuf();
+  CodegenResult cr = compile({{"native_test.theo", source.str()}},
+                             "native_test.theo");
+  if (!cr.generated_correctly) {
+    std::cout << "couldn't compile " << argv[2] << std::endl;
+    return 1;
+  }
+
+  VM v(cr.code);
+  v.execute();
+  auto expected = v.getActivations().back().getActivationVariables();
+
+  NativeLoadResult lr = NativeProgram::load(argv[1]);
+  if (!lr.loaded_correctly) {
+    std::cout << "couldn't load module: " << lr.error << std::endl;
+    return 1;
+  }
+
+  // run twice, every run starts from a fresh frame
+  for (int k = 0; k < 2; k++) {
+    auto actual = lr.program->run();
+    if (actual != expected) {
+      std::cout << "native results differ:" << std::endl;
+      for (auto &p : expected)
+        std::cout << p.first << ": " << p.second << " / " << actual[p.first]
+                  << std::endl;
+      return 1;
+    }
+  }
+  if (expected["floor"] != 0 || expected["product"] != 13 * 42 ||
+      expected["quad"] != 20) {
+    std::cout << "unexpected results of the VM" << std::endl;
+    return 1;
+  }
+
+  // a call without PREPARE_EXEC can't be translated
+  Program broken = cr.code;
+  std::vector<Instruction> code = {Instruction::Exec(1), Instruction::Halt()};
+  broken.code = code;
+  broken.image = nullptr;
+  std::stringstream out;
+  if (broken.emitCpp(out) || out.str() != "") {
+    std::cout << "malformed bytecode was translated" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
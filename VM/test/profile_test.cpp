@@ -0,0 +1,95 @@
+#include <iostream>
+#include <sstream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  profiles the hand-compiled program of instr_test (7 * 13) and checks the
+  counts per PROGRAM and per line against the known control flow
+ */
+
+using namespace Theo;
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.addLine(11, "add.theo", 1);
+  p.addLine(13, "add.theo", 2);
+  p.addLine(18, "mul.theo", 1);
+  p.sortLineTables();
+
+  VM v(p);
+  v.setProfiling(true);
+  v.execute();
+
+  const Profile &prof = v.getProfile();
+  if (prof.total() != v.getExecutedInstructions()) {
+    std::cout << "profile counted " << prof.total() << " of "
+              << v.getExecutedInstructions() << " instructions" << std::endl;
+    return 1;
+  }
+
+  // 13 calls of +, each adding 7 with 5 instructions per iteration
+  for (auto &f : prof.functions(p)) {
+    if (f.name == "+" && (f.calls != 13 || f.exclusive != 13 * (7 * 5 + 3))) {
+      std::cout << "+ was called " << f.calls << " times and executed "
+                << f.exclusive << " instructions" << std::endl;
+      return 1;
+    }
+    if (f.name == "*" && (f.calls != 1 || f.inclusive <= f.exclusive)) {
+      std::cout << "wrong inclusive count for *" << std::endl;
+      return 1;
+    }
+    if (f.name == "main" && (f.calls != 1 || f.inclusive != prof.total())) {
+      std::cout << "main was called " << f.calls << " times" << std::endl;
+      return 1;
+    }
+  }
+
+  // the loop body of + (and its RET, which follows it) is the hottest line
+  auto lines = prof.lines(p);
+  if (lines.empty() || lines[0].line.file != "add.theo" ||
+      lines[0].line.line != 2 || lines[0].instructions != 13 * (7 * 4 + 1)) {
+    std::cout << "unexpected hottest line" << std::endl;
+    return 1;
+  }
+
+  std::stringstream collapsed;
+  prof.writeCollapsed(collapsed, p);
+  if (collapsed.str().find("main;*;+ " +
+                           std::to_string(13 * (7 * 5 + 3))) ==
+          std::string::npos ||
+      collapsed.str().find("main;main") != std::string::npos) {
+    std::cout << "unexpected collapsed stacks:" << std::endl
+              << collapsed.str();
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  steps through the hand-compiled program of instr_test (x0 := 70 * 1000,
+  with a line inside the loop of +) and steps back again, with a memory
+  budget small enough that checkpoints have to be thinned out
+ */
+
+using namespace Theo;
+
+struct Stop {
+  VM::InstructionCount executed;
+  int x0;
+};
+
+Stop current(VM &v) {
+  return {v.getExecutedInstructions(),
+          v.getActivations().back().getActivationVariables()["x0"]};
+}
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 70),
+      Instruction::Add(1, 1, 1000), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.addLine(13, "main.theo", 3);
+  p.sortLineTables();
+
+  VM v(p);
+  v.setRecording(true);
+  v.setRecordingBudget(16 << 10);
+
+  // step forward through every line
+  std::vector<Stop> stops = {};
+  v.setSteppingMode(true);
+  for (v.execute(); !v.isDone(); v.execute()) stops.push_back(current(v));
+  v.setSteppingMode(false);
+
+  if (current(v).x0 != 70000 || stops.size() != 70002) {
+    std::cout << "forward execution failed" << std::endl;
+    return 1;
+  }
+
+  // step back over the last lines
+  for (std::size_t k = stops.size(); k-- > stops.size() - 100;) {
+    if (!v.reverseStep()) {
+      std::cout << "couldn't step back to stop " << k << std::endl;
+      return 1;
+    }
+    Stop s = current(v);
+    if (s.executed != stops[k].executed || s.x0 != stops[k].x0) {
+      std::cout << "stepped back to " << s.executed << " (x0 = " << s.x0
+                << "), expected " << stops[k].executed << " (x0 = "
+                << stops[k].x0 << ")" << std::endl;
+      return 1;
+    }
+  }
+
+  // back to the only breakpoint on line 2, which is the second stop
+  v.setBreakPoint("main.theo", 2, true);
+  if (!v.reverseContinue() || v.getExecutedInstructions() != stops[1].executed ||
+      v.getCurrentBreak().line != 2) {
+    std::cout << "reverse continue missed the breakpoint" << std::endl;
+    return 1;
+  }
+  if (v.reverseContinue() || v.getExecutedInstructions() != 0) {
+    std::cout << "reverse continue didn't stop at the start" << std::endl;
+    return 1;
+  }
+
+  // and forward again
+  v.clearBreakpoints();
+  v.execute();
+  if (!v.isDone() || current(v).x0 != 70000) {
+    std::cout << "re-execution computed " << current(v).x0 << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
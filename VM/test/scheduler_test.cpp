@@ -0,0 +1,112 @@
+#include <iostream>
+#include <vector>
+
+#include "VM/include/program.hpp"
+#include "VM/include/scheduler.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  interleaves many VMs executing the hand-compiled program of breakcond_test
+  (7 * 13) on one thread, one of them with a breakpoint
+ */
+
+using namespace Theo;
+
+int x0(VM &v) {
+  return *v.getActivations().back().getVariables().get("x0");
+}
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+  p.addLine(2, "main.theo", 1);
+  p.addLine(5, "main.theo", 2);
+  p.addLine(13, "add.theo", 1);
+  p.sortLineTables();
+
+  VM reference(p);
+  reference.execute();
+  VM::InstructionCount total = reference.getExecutedInstructions();
+
+  // a single execution, resumed slice by slice
+  VM single(p);
+  Execution e = single.run(10);
+  int slices = 0;
+  while (e.resume()) slices++;
+  if (e.stop() != Execution::HALT || x0(single) != 91 ||
+      slices != (int)((total - 1) / 10)) {
+    std::cout << "resumable execution ended after " << slices
+              << " slices with " << x0(single) << std::endl;
+    return 1;
+  }
+
+  std::vector<VM> vms(1000, VM(p));
+  vms[0].setBreakPoint("add.theo", 1, true);
+
+  Scheduler s(16);
+  for (auto &v : vms) s.add(v);
+
+  // every VM gets the same share of the first round
+  s.round();
+  for (auto &v : vms) {
+    if (v.getExecutedInstructions() != 16 &&
+        !(&v == &vms[0] && v.getExecutedInstructions() < 16)) {
+      std::cout << "unfair first round: " << v.getExecutedInstructions()
+                << std::endl;
+      return 1;
+    }
+  }
+
+  int breaks = 1;
+  s.run([&](VM &v) -> bool {
+    breaks += &v == &vms[0];
+    return true;
+  });
+
+  if (s.size() != 0 || breaks != 7 * 13 + 1) {
+    std::cout << breaks << " breaks, " << s.size() << " VMs left" << std::endl;
+    return 1;
+  }
+  for (auto &v : vms) {
+    if (!v.isDone() || x0(v) != 91 || v.getExecutedInstructions() != total) {
+      std::cout << "scheduled VM computed " << x0(v) << std::endl;
+      return 1;
+    }
+  }
+
+  // unscheduling on the first breakpoint
+  VM stopped(p);
+  stopped.setBreakPoint("add.theo", 1, true);
+  Scheduler once(1 << 20);
+  once.add(stopped);
+  once.run([](VM &) -> bool { return false; });
+  if (stopped.isDone() || stopped.getCurrentBreak().line != 1) {
+    std::cout << "VM wasn't unscheduled on the breakpoint" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
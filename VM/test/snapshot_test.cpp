@@ -0,0 +1,114 @@
+#include <iostream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  takes snapshots while executing the hand-compiled program of instr_test
+  (x0 := 7 * 1000, so that the data segment spans several pages) and
+  resumes from them, in the same and in a fresh VM
+ */
+
+using namespace Theo;
+
+int result(VM &v) {
+  return v.getActivations().back().getActivationVariables()["x0"];
+}
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::Add(0, 0, 7), Instruction::Add(1, 1, 1000),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(15), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+4, 2),
+      Instruction::Add(0, 0, 1), Instruction::Add(2, 2, -1),
+      Instruction::Jmp(-3), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(9), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = {sm},
+               .potential_breaks = {},
+               .line_info = {}};
+
+  VM v(p);
+
+  // take a snapshot every 500 instructions
+  std::vector<VM::Snapshot> snapshots = {};
+  std::vector<std::size_t> depths = {};
+  for (int steps = 0; !v.isDone(); steps++) {
+    if (steps % 500 == 0) {
+      snapshots.push_back(v.snapshot());
+      depths.push_back(v.getActivations().size());
+    }
+    v.executeSingle();
+  }
+
+  if (result(v) != 7000 || snapshots.size() < 5) {
+    std::cout << "initial execution failed" << std::endl;
+    return 1;
+  }
+
+  // resume from every snapshot, latest first
+  for (std::size_t k = snapshots.size(); k-- > 0;) {
+    v.restore(snapshots[k]);
+    if (v.getActivations().size() != depths[k]) {
+      std::cout << "snapshot " << k << " restored " << v.getActivations().size()
+                << " activations instead of " << depths[k] << std::endl;
+      return 1;
+    }
+    v.execute();
+    if (result(v) != 7000) {
+      std::cout << "resuming from snapshot " << k << " computed "
+                << result(v) << std::endl;
+      return 1;
+    }
+  }
+
+  // fork a continuation into another VM
+  VM fork(p);
+  fork.restore(snapshots[snapshots.size() / 2]);
+  fork.execute();
+  if (!fork.isDone() || result(fork) != 7000) {
+    std::cout << "forked continuation computed " << result(fork) << std::endl;
+    return 1;
+  }
+
+  // variables changed since a snapshot, inside the loop of +
+  v.restore(snapshots[2]);
+  VM::Snapshot stop = v.snapshot();
+  auto before = v.getActivations().back().getActivationVariables();
+  for (int k = 0; k < 5; k++) v.executeSingle();
+  auto changes = v.changedSince(stop);
+  auto &top = v.getActivations().back();
+  for (auto var : top.getVariables()) {
+    bool changed = before[std::string(var.name)] != var.value;
+    bool reported = false;
+    for (auto &c : changes) {
+      reported |= c.frame + 1 == v.getActivations().size() &&
+                  c.name == var.name && c.after == var.value;
+    }
+    if (changed != reported) {
+      std::cout << "change of " << var.name << " reported incorrectly"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (changes.empty() || top.getVariables().get("x0") != result(v)) {
+    std::cout << "variable view differs from getActivationVariables"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
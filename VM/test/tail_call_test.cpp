@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "Compiler/include/compiler.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  a chain of PROGRAMs that return the result of their last call: every such
+  call is a tail call, the whole chain runs in a single frame below the root
+  frame, and the result still reaches the variable of the root frame
+ */
+
+using namespace Theo;
+
+const char *source =
+    "PROGRAM inc IN a DO\n"
+    "  x0 := a + 1\n"
+    "END\n"
+    "PROGRAM p1 IN a DO\n"
+    "  b := a + 1;\n"
+    "  x0 := RUN inc WITH b END\n"
+    "END\n"
+    "PROGRAM p2 IN a DO\n"
+    "  b := a + 1;\n"
+    "  x0 := RUN p1 WITH b END\n"
+    "END\n"
+    "PROGRAM p3 IN a DO\n"
+    "  b := a + 1;\n"
+    "  x0 := RUN p2 WITH b END\n"
+    "END\n"
+    "PROGRAM notail IN a DO\n"
+    "  x0 := RUN p3 WITH a END;\n"
+    "  x0 := x0 + 1\n"
+    "END\n"
+    "r := RUN p3 WITH 10 END;\n"
+    "s := RUN notail WITH 0 END\n";
+
+int main() {
+  CodegenResult cr = compile({{"tail.theo", source}}, "tail.theo");
+  if (!cr.generated_correctly) {
+    std::cout << "couldn't compile the program" << std::endl;
+    return 1;
+  }
+
+  std::stringstream dis;
+  cr.code.disassemble(dis);
+  std::string d = dis.str();
+  std::size_t tails = 0;
+  for (std::size_t at = d.find("tail exec"); at != std::string::npos;
+       at = d.find("tail exec", at + 1))
+    tails++;
+  if (tails != 3) {
+    std::cout << "expected 3 tail calls, found " << tails << std::endl;
+    return 1;
+  }
+
+  for (VM::Engine e : {VM::Engine::SWITCH, VM::Engine::CLOSURES}) {
+    VM v(cr.code);
+    v.setEngine(e);
+    v.execute();
+    auto vars = v.getActivations().back().getActivationVariables();
+    if (vars["r"] != 14 || vars["s"] != 5) {
+      std::cout << "unexpected results " << vars["r"] << ", " << vars["s"]
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // the chain of p3 never needs more than one frame below the root
+  VM v(cr.code);
+  v.setSteppingMode(true);
+  std::size_t depth = 0;
+  for (v.execute(); !v.isDone(); v.execute()) {
+    if (v.getActivations().back().getFunctionName() == "notail") break;
+    depth = std::max(depth, v.getActivations().size());
+  }
+  if (depth != 2) {
+    std::cout << "tail calls used " << depth << " activations" << std::endl;
+    return 1;
+  }
+
+  // the RET of inc writes r of the root frame, through the tail calls
+  VM w(cr.code);
+  if (!w.setWatchPoint({"#root", "r", 14}, true)) {
+    std::cout << "couldn't set the watchpoint" << std::endl;
+    return 1;
+  }
+  w.execute();
+  if (w.isDone() || !w.getCurrentWatch()) {
+    std::cout << "watchpoint on the result wasn't hit" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
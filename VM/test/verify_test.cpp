@@ -0,0 +1,124 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  verifies the hand-compiled program of breakcond_test (7 * 13) and broken
+  variants of it; verified programs give the same results with and without
+  checks, broken ones stop with a fault on the checked path instead of
+  accessing memory out of bounds
+ */
+
+using namespace Theo;
+
+std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                     {"+", {{0, "x0"}, {1, "x2"}}},
+                                     {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+Program program(std::vector<Instruction> code) {
+  return {.code = code,
+          .stack_maps = sm,
+          .potential_breaks = {},
+          .line_info = {}};
+}
+
+int run(const Program &p, bool checked) {
+  VM v(p);
+  v.setCheckedExecution(checked);
+  v.execute();
+  if (!v.isDone() || v.getFault()) return -1;
+  return *v.getActivations().back().getVariables().get("x0");
+}
+
+int main() {
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 7),
+      Instruction::Add(1, 1, 13), Instruction::PotentialBreak(),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(18), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+5, 2),
+      Instruction::PotentialBreak(), Instruction::Add(0, 0, 1),
+      Instruction::Add(2, 2, -1), Instruction::Jmp(-4), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(11), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = program(code);
+  if (!p.verify().verified || !VM(p).isVerified()) {
+    std::cout << "valid program wasn't verified: " << p.verify().error
+              << std::endl;
+    return 1;
+  }
+  if (run(p, false) != 91 || run(p, true) != 91) {
+    std::cout << "checked execution differs" << std::endl;
+    return 1;
+  }
+
+  struct Broken {
+    std::string what;
+    ProgramIndex at;
+    Instruction i;
+  };
+  std::vector<Broken> broken = {
+      {"jump out of the program", 16, Instruction::Jmp(-400)},
+      {"register outside of the frame", 3, Instruction::Add(9, 0, 7)},
+      {"ARG without a calling frame", 1, Instruction::Arg(0, 0)},
+      {"RET from the root frame", 10, Instruction::Ret(0)},
+      {"jump into a call sequence", 25, Instruction::Jmp(-3)},
+      {"frame without stack map", 20, Instruction::PrepareExec(3, 7, 2)}};
+  for (auto &b : broken) {
+    std::vector<Instruction> c = code;
+    c[b.at] = b.i;
+    Program bp = program(c);
+    VerifyResult r = bp.verify();
+    if (r.verified) {
+      std::cout << b.what << " was verified" << std::endl;
+      return 1;
+    }
+    VM v(bp);
+    v.execute();
+    if (v.isVerified() || !v.isDone() || !v.getFault()) {
+      std::cout << b.what << " didn't fault" << std::endl;
+      return 1;
+    }
+  }
+
+  // breakpoints are set at the positions of the line table
+  Program lines = program(code);
+  lines.addLine(code.size(), "main.theo", 1);
+  lines.sortLineTables();
+  if (lines.verify().verified) {
+    std::cout << "line table entry outside of the code was verified"
+              << std::endl;
+    return 1;
+  }
+
+  // ... and only at POTENTIAL_BREAKs, a BREAK written over the HALT would
+  // let execution run past the end
+  Program halt = program(code);
+  halt.addLine(10, "main.theo", 1);
+  halt.sortLineTables();
+  if (halt.verify().verified) {
+    std::cout << "line table entry at HALT was verified" << std::endl;
+    return 1;
+  }
+
+  // invalid code that is never executed doesn't stop the checked path
+  Program unused = program({Instruction::PrepareExec(2, 0, 0),
+                            Instruction::LoadConstant(0, 1),
+                            Instruction::JmpC(100, 0), Instruction::Halt()});
+  if (unused.verify().verified || run(unused, false) != 1) {
+    std::cout << "unverified program didn't run" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+
+#include "VM/include/program.hpp"
+#include "VM/include/vm.hpp"
+
+/*
+  watches variables of the hand-compiled program of instr_test (7 * 13),
+  written by ADD_CONST, ARG and RET
+ */
+
+using namespace Theo;
+
+int main() {
+  std::vector<Program::StackMap> sm = {{"main", {{0, "x0"}, {1, "x1"}}},
+                                       {"+", {{0, "x0"}, {1, "x2"}}},
+                                       {"*", {{0, "x0"}, {1, "x1"}, {2, "x2"}}}};
+
+  std::vector<Instruction> code = {
+      Instruction::PrepareExec(3, 0, 0), Instruction::Exec(2),
+      // main
+      Instruction::Add(0, 0, 7), Instruction::Add(1, 1, 13),
+      Instruction::PrepareExec(4, 2, 0), Instruction::Arg(0, 0),
+      Instruction::Arg(1, 1), Instruction::Exec(15), Instruction::Halt(),
+      // +
+      Instruction::Add(2, 1, 0), Instruction::JmpC(+4, 2),
+      Instruction::Add(0, 0, 1), Instruction::Add(2, 2, -1),
+      Instruction::Jmp(-3), Instruction::Ret(0),
+      // *
+      Instruction::Add(3, 1, 0), Instruction::JmpC(7, 3),
+      Instruction::PrepareExec(3, 1, 2), Instruction::Arg(0, 2),
+      Instruction::Arg(1, 0), Instruction::Exec(9), Instruction::Add(3, 3, -1),
+      Instruction::Jmp(-6), Instruction::Ret(2)};
+
+  Program p = {.code = code,
+               .stack_maps = sm,
+               .potential_breaks = {},
+               .line_info = {}};
+
+  VM v(p);
+  if (v.setWatchPoint({"+", "x9", std::nullopt}, true)) {
+    std::cout << "watching an unknown variable succeeded" << std::endl;
+    return 1;
+  }
+
+  // x0 of + is written by ARG (except in the first call, where the argument
+  // is still 0) and by every increment
+  v.setWatchPoint({"+", "x0", std::nullopt}, true);
+  int hits = 0;
+  for (v.execute(); !v.isDone(); v.execute()) {
+    auto hit = v.getCurrentWatch();
+    if (!hit || hit->watch.variable != "x0" || hit->after == hit->before) {
+      std::cout << "stopped without a watchpoint hit" << std::endl;
+      return 1;
+    }
+    hits++;
+  }
+  if (hits != 12 + 13 * 7) {
+    std::cout << "x0 of + changed " << hits << " times" << std::endl;
+    return 1;
+  }
+
+  // x2 of * is written by the RET of +
+  v.reset();
+  v.setWatchPoint({"*", "x2", 49}, true);
+  v.execute();
+  auto hit = v.getCurrentWatch();
+  if (!hit || hit->after != 49 || hit->before != 42) {
+    std::cout << "watchpoint on the result of + failed" << std::endl;
+    return 1;
+  }
+
+  // without watchpoints the program runs through
+  v.clearWatchPoints();
+  v.execute();
+  if (!v.isDone() || v.getCurrentWatch() ||
+      v.getActivations().back().getActivationVariables()["x0"] != 91) {
+    std::cout << "execution after clearing the watchpoints failed"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,22 @@
+# theo_add_native_module(<name> <main.theo> [<other.theo> ...])
+#
+# translates Theo sources to C++ (theo --emit-cpp) and compiles them into a
+# loadable module <name>, which can be executed by `theo --run-native` or
+# Theo::NativeProgram; relative paths are relative to the current source
+# directory
+function(theo_add_native_module name main)
+    set(sources ${main} ${ARGN})
+    set(generated ${CMAKE_CURRENT_BINARY_DIR}/${name}.cpp)
+
+    add_custom_command(
+        OUTPUT ${generated}
+        COMMAND theo --emit-cpp ${generated} ${sources}
+        DEPENDS theo ${sources}
+        WORKING_DIRECTORY ${CMAKE_CURRENT_SOURCE_DIR}
+        COMMENT "Translating ${main} to C++"
+        VERBATIM
+    )
+
+    add_library(${name} MODULE ${generated})
+    set_target_properties(${name} PROPERTIES PREFIX "")
+endfunction()